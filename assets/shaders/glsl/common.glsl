@@ -0,0 +1,15 @@
+// Shared by all shaders through #include
+
+layout(std140, binding = 0) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+};
+
+// Per-shape flags, see OpenGLDrawRecord
+const uint FLAG_TEXTURE = 1u;
+const uint FLAG_NORMAL = 2u;
+const uint FLAG_COLOR = 4u;
+const uint FLAG_POINT = 8u;
+const uint FLAG_QUANTIZED = 16u;        // Vertex encoding, only used to pull vertices
+const uint FLAG_OCT_NORMALS = 32u;
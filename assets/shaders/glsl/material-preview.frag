@@ -1,25 +1,32 @@
 #version 450 core
 
+#include "common.glsl"
+
 in vec2 TexCoords;
 in vec3 FragPos;
 in vec3 Normal;
+in vec3 Color;
+flat in uint Flags;
 out vec4 FragColor;
 
 uniform sampler2D texture_diffuse;
-uniform bool hasTexture;
-uniform mat4 view;
 
 void main() {
+    // Round splats for point clouds
+    if ((Flags & FLAG_POINT) != 0u && length(gl_PointCoord - vec2(0.5)) > 0.5) discard;
 
-    if (hasTexture) {
+    vec3 baseColor = (Flags & FLAG_COLOR) != 0u ? Color : vec3(0.6, 0.6, 0.6);
+    if ((Flags & FLAG_TEXTURE) != 0u) {
         FragColor = texture(texture_diffuse, TexCoords);
+    } else if ((Flags & FLAG_NORMAL) == 0u) {    // Unlit, e.g. point clouds without normals
+        FragColor = vec4(baseColor, 1.0);
     } else {    // No Texture, the same as solid
         vec3 lightDir = normalize(vec3(view * vec4(-0.2, -1.0, -0.3, 0.0)));
         vec3 norm = normalize(Normal);
         float diff = max(dot(norm, lightDir), 0.0);
         vec3 ambient= vec3(0.3, 0.3, 0.3);
         vec3 diffuse = diff * vec3(0.8, 0.8, 0.8);
-        vec3 result = vec3(0.6, 0.6, 0.6) * (ambient + diffuse);
+        vec3 result = baseColor * (ambient + diffuse);
         FragColor = vec4(result, 1.0);
     }
     
@@ -0,0 +1,21 @@
+#version 450 core
+
+// Paint the band `width` pixels wide around the selection, blended over the frame with an antialiased outer edge
+
+layout(binding = 0) uniform isampler2D seeds;   // Output of the last flood pass
+
+uniform float width;
+uniform vec2 viewportOrigin;    // Of the frame, the seeds start at its corner
+
+out vec4 FragColor;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy - viewportOrigin);
+    ivec2 seed = texelFetch(seeds, pixel, 0).xy;
+    if (seed.x < 0 || seed == pixel) discard;
+    // Distance to the edge of the selected pixel, not its center
+    float edge = length(vec2(seed - pixel)) - 0.5;
+    float alpha = clamp(width + 0.5 - edge, 0.0, 1.0);
+    if (alpha <= 0.0) discard;
+    FragColor = vec4(0.95, 0.7, 0.3, alpha);     // Highlight yellow
+}
@@ -0,0 +1,36 @@
+#version 450 core
+
+// One jump flood pass over the selection mask: each pixel keeps the nearest selected pixel among the seeds of
+// itself and the 8 pixels `jump` away. The first pass seeds from the mask with a jump of 1, the next ones halve
+// the jump from a power of two down to 1, so a pixel finds its nearest selected pixel within twice that power.
+
+layout(binding = 0) uniform isampler2D seeds;   // Nearest selected pixel so far, -1 when none
+layout(binding = 1) uniform sampler2D mask;     // Non-zero where the selection was drawn
+
+uniform int jump;
+uniform bool fromMask;
+
+out ivec2 Seed;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 size = textureSize(mask, 0);
+    ivec2 nearest = ivec2(-1);
+    int nearestSquared = 0x7fffffff;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x) {
+            ivec2 neighbor = pixel + ivec2(x, y) * jump;
+            if (any(lessThan(neighbor, ivec2(0))) || any(greaterThanEqual(neighbor, size))) continue;
+            ivec2 seed = fromMask ? (texelFetch(mask, neighbor, 0).r > 0.0 ? neighbor : ivec2(-1))
+                                  : texelFetch(seeds, neighbor, 0).xy;
+            if (seed.x < 0) continue;
+            ivec2 offset = seed - pixel;
+            int squared = offset.x * offset.x + offset.y * offset.y;
+            if (squared < nearestSquared) {
+                nearest = seed;
+                nearestSquared = squared;
+            }
+        }
+    }
+    Seed = nearest;
+}
@@ -1,7 +1,9 @@
 #version 450 core
 
+// Selection mask of the outline pass, see outline-flood.frag
+
 out vec4 FragColor;
 
 void main() {
-    FragColor = vec4(0.95, 0.7, 0.3, 0.5);   //hightlight yellow
+    FragColor = vec4(1.0);
 }
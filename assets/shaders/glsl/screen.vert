@@ -0,0 +1,8 @@
+#version 450 core
+
+// Full-screen triangle for post passes, drawn with glDrawArrays(GL_TRIANGLES, 0, 3) and no attributes
+
+void main() {
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -1,17 +1,27 @@
 #version 450 core
 
+#include "common.glsl"
+
 in vec3 FragPos;
 in vec3 Normal;
+in vec3 Color;
+flat in uint Flags;
 out vec4 FragColor;
 
-uniform mat4 view;
-
 void main() {
+    // Round splats for point clouds
+    if ((Flags & FLAG_POINT) != 0u && length(gl_PointCoord - vec2(0.5)) > 0.5) discard;
+
+    vec3 baseColor = (Flags & FLAG_COLOR) != 0u ? Color : vec3(0.6, 0.6, 0.6);
+    if ((Flags & FLAG_NORMAL) == 0u) {   // Unlit, e.g. point clouds without normals
+        FragColor = vec4(baseColor, 1.0);
+        return;
+    }
     vec3 lightDir = normalize(vec3(view * vec4(-0.2, -1.0, -0.3, 0.0)));
     vec3 norm = normalize(Normal);
     float diff = max(dot(norm, lightDir), 0.0);
     vec3 ambient= vec3(0.3, 0.3, 0.3);
     vec3 diffuse = diff * vec3(0.8, 0.8, 0.8);
-    vec3 result = vec3(0.6, 0.6, 0.6) * (ambient + diffuse);
+    vec3 result = baseColor * (ambient + diffuse);
     FragColor = vec4(result, 1.0);
 }
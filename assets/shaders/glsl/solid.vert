@@ -1,17 +1,17 @@
 #version 450 core
 
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
+#include "vertex.glsl"
 
 out vec3 FragPos;
 out vec3 Normal;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+out vec3 Color;
+flat out uint Flags;
 
 void main() {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+    Vertex v = fetchVertex();
+    FragPos = vec3(v.world * vec4(v.position, 1.0));
+    Normal = v.normalMatrix * v.normal;
+    Color = v.color;
+    Flags = v.flags;
+    gl_Position = viewProjection * vec4(FragPos, 1.0);
 }
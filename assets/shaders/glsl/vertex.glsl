@@ -0,0 +1,148 @@
+// Vertex input of all vertex shaders: fetchVertex() reads the current vertex from the shape's VAO,
+// or with VERTEX_PULLING defined, from the geometry arena block the draw's batch is bound to.
+#ifdef VERTEX_PULLING
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+
+#include "common.glsl"
+
+struct Vertex {
+    vec3 position;          // Decoded, in model space
+    vec3 normal;
+    vec2 texCoord;
+    vec3 color;
+    mat4 world;             // Model matrix times instance matrix
+    mat3 normalMatrix;      // Its inverse transpose
+    uint flags;             // FLAG_*
+    uint pickId;
+};
+
+vec3 octDecode(vec2 n) {
+    vec3 v = vec3(n.xy, 1.0 - abs(n.x) - abs(n.y));
+    if (v.z < 0.0) v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(v);
+}
+
+#ifdef VERTEX_PULLING
+
+// Must match OpenGLDrawRecord, offsets and strides are in 4-byte words
+struct DrawRecord {
+    vec4 positionOffset;    // Quantized positions are offset + scale * [0, 1]
+    vec4 positionScale;
+    uint vertexBase;        // First word of the shape in `vertexWords`
+    uint vertexStride;
+    uint normalOffset;      // In the vertex, 0 if the shape has none
+    uint texCoordOffset;
+    uint colorOffset;
+    uint flags;
+    uint object;            // Into `objects`
+    uint pickId;            // Of the model, or of its first instance
+};
+
+struct ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+};
+
+// Must match OpenGLInstance
+struct InstanceData {
+    mat4 matrix;
+    uint index;
+    mat4 normalMatrix;
+};
+
+layout(std430, binding = 0) readonly buffer SceneVertices { uint vertexWords[]; };
+layout(std430, binding = 1) readonly buffer DrawRecords { DrawRecord records[]; };
+layout(std430, binding = 2) readonly buffer CommandRecords { uint commandRecords[]; };    // Record of every command
+layout(std430, binding = 3) readonly buffer Objects { ObjectData objects[]; };
+layout(std430, binding = 4) readonly buffer Instances { InstanceData instances[]; };
+layout(std430, binding = 5) readonly buffer InstanceIndices { uint instanceIndices[]; };   // Of the draw's instances
+
+uniform uint firstCommand;      // Of the current multi-draw in the frame's commands
+
+vec3 loadVec3(uint word) {
+    return uintBitsToFloat(uvec3(vertexWords[word], vertexWords[word + 1u], vertexWords[word + 2u]));
+}
+
+Vertex fetchVertex() {
+    DrawRecord record = records[commandRecords[firstCommand + uint(gl_DrawIDARB)]];
+    // Non-instanced models have one identity instance
+    InstanceData instance = instances[instanceIndices[gl_BaseInstanceARB + gl_InstanceID]];
+    uint base = record.vertexBase + uint(gl_VertexID) * record.vertexStride;
+    bool quantized = (record.flags & FLAG_QUANTIZED) != 0u;
+
+    Vertex v;
+    vec3 p = quantized ? vec3(unpackUnorm2x16(vertexWords[base]), unpackUnorm2x16(vertexWords[base + 1u]).x) : loadVec3(base);
+    v.position = record.positionOffset.xyz + record.positionScale.xyz * p;
+
+    v.normal = vec3(0.0);
+    if (record.normalOffset != 0u) {
+        uint word = base + record.normalOffset;
+        if ((record.flags & FLAG_OCT_NORMALS) != 0u) {
+            v.normal = octDecode(unpackSnorm2x16(vertexWords[word]));
+        } else if (quantized) {     // GL_INT_2_10_10_10_REV
+            int n = int(vertexWords[word]);
+            v.normal = max(vec3(bitfieldExtract(n, 0, 10), bitfieldExtract(n, 10, 10), bitfieldExtract(n, 20, 10)) / 511.0, -1.0);
+        } else {
+            v.normal = loadVec3(word);
+        }
+    }
+
+    v.texCoord = vec2(0.0);
+    if (record.texCoordOffset != 0u) {
+        uint word = base + record.texCoordOffset;
+        v.texCoord = quantized ? unpackHalf2x16(vertexWords[word]) : uintBitsToFloat(uvec2(vertexWords[word], vertexWords[word + 1u]));
+    }
+
+    v.color = vec3(0.0);
+    if (record.colorOffset != 0u) {
+        uint word = base + record.colorOffset;
+        v.color = quantized ? unpackUnorm4x8(vertexWords[word]).rgb : loadVec3(word);
+    }
+
+    ObjectData object = objects[record.object];
+    v.world = object.model * instance.matrix;
+    v.normalMatrix = mat3(object.normalMatrix) * mat3(instance.normalMatrix);
+    v.flags = record.flags;
+    v.pickId = record.pickId + instance.index;
+    return v;
+}
+
+#else
+
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoords;
+layout(location = 3) in vec3 aColor;
+layout(location = 4) in mat4 aInstance;          // Identity unless the model is instanced
+layout(location = 8) in uint aInstanceIndex;
+layout(location = 9) in mat3 aInstanceNormal;    // Its normal matrix
+
+layout(std140, binding = 1) uniform Object {
+    mat4 model;
+    mat4 normalMatrix;      // Inverse transpose of the model matrix, from the CPU
+};
+
+uniform vec3 positionOffset;   // Quantized positions are relative to the shape bounds
+uniform vec3 positionScale;
+uniform bool octNormals;
+uniform bool hasTexture;
+uniform bool hasNormal;
+uniform bool hasColor;
+uniform bool isPoint;
+uniform int modelIdx;   // Pick id of the model, or of its first instance
+
+Vertex fetchVertex() {
+    Vertex v;
+    v.position = positionOffset + positionScale * aPos;
+    v.normal = octNormals ? octDecode(aNormal.xy) : aNormal;
+    v.texCoord = aTexCoords;
+    v.color = aColor;
+    v.world = model * aInstance;
+    v.normalMatrix = mat3(normalMatrix) * aInstanceNormal;
+    v.flags = (hasTexture ? FLAG_TEXTURE : 0u) | (hasNormal ? FLAG_NORMAL : 0u) | (hasColor ? FLAG_COLOR : 0u) | (isPoint ? FLAG_POINT : 0u);
+    v.pickId = uint(modelIdx) + aInstanceIndex;
+    return v;
+}
+
+#endif
@@ -1,12 +1,8 @@
 #version 450 core
 
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "vertex.glsl"
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    Vertex v = fetchVertex();
+    gl_Position = viewProjection * v.world * vec4(v.position, 1.0);
 }
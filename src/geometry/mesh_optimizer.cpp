@@ -0,0 +1,311 @@
+#include "mesh_optimizer.h"
+#include "utils/parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+
+namespace {
+
+constexpr size_t kMeasureCacheSize = 16;    // FIFO cache used for ACMR and overdraw clustering, typical of real GPUs
+
+// Forsyth's scoring parameters, from "Linear-Speed Vertex Cache Optimisation"
+constexpr size_t kScoringCacheSize = 32;
+constexpr float kCacheDecayPower = 1.5f;
+constexpr float kLastTriangleScore = 0.75f;
+constexpr float kValenceBoostScale = 2.0f;
+constexpr float kValenceBoostPower = 0.5f;
+constexpr size_t kValenceTableSize = 32;
+
+constexpr float kOverdrawThreshold = 1.05f; // Accept clusters up to 5% worse than the cache-optimal ACMR
+
+constexpr uint32_t kInvalid = ~0u;
+
+// FIFO post-transform cache simulation: a vertex hits while fewer than `size` misses happened since it was loaded
+class FIFOCache {
+public:
+    FIFOCache(size_t vertexCount, size_t size) : mSize(static_cast<uint32_t>(size)), mTimestamps(vertexCount, 0), mTime(mSize + 1) {}
+
+    // Returns true on a miss
+    bool access(uint32_t vertex) {
+        if (mTime - mTimestamps[vertex] > mSize) {
+            mTimestamps[vertex] = mTime++;
+            return true;
+        }
+        return false;
+    }
+    void reset() { mTime += mSize + 1; }
+
+private:
+    uint32_t mSize;
+    std::vector<uint32_t> mTimestamps;
+    uint32_t mTime;
+};
+
+unsigned triangleMisses(FIFOCache& cache, const uint32_t* triangle) {
+    return unsigned(cache.access(triangle[0])) + unsigned(cache.access(triangle[1])) + unsigned(cache.access(triangle[2]));
+}
+
+struct ScoreTables {
+    float cache[kScoringCacheSize];
+    float valence[kValenceTableSize];
+
+    ScoreTables() {
+        for (size_t i = 0; i < kScoringCacheSize; ++i) {
+            // The last triangle's vertices get a fixed score, so it doesn't just continue in a strip
+            if (i < 3) cache[i] = kLastTriangleScore;
+            else cache[i] = std::pow(1.0f - float(i - 3) / float(kScoringCacheSize - 3), kCacheDecayPower);
+        }
+        valence[0] = 0.0f;
+        for (size_t i = 1; i < kValenceTableSize; ++i) {
+            valence[i] = kValenceBoostScale * std::pow(float(i), -kValenceBoostPower);
+        }
+    }
+
+    [[nodiscard]] float score(int cachePosition, uint32_t remainingValence) const {
+        if (remainingValence == 0) return -1.0f;    // No triangles left to use it
+        float result = cachePosition >= 0 ? cache[cachePosition] : 0.0f;
+        result += remainingValence < kValenceTableSize
+            ? valence[remainingValence]
+            : kValenceBoostScale * std::pow(float(remainingValence), -kValenceBoostPower);
+        return result;
+    }
+};
+
+std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount) {
+    static const ScoreTables tables;
+    size_t triangleCount = indices.size() / 3;
+
+    // Vertex -> triangle adjacency; the first `remaining[v]` entries of a vertex are its unemitted triangles
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (uint32_t index : indices) remaining[index]++;
+    std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) adjacencyStart[v + 1] = adjacencyStart[v] + remaining[v];
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (size_t t = 0; t < triangleCount; ++t)
+            for (size_t k = 0; k < 3; ++k) adjacency[fill[indices[3 * t + k]]++] = static_cast<uint32_t>(t);
+    }
+
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) vertexScores[v] = tables.score(-1, remaining[v]);
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    uint32_t best = kInvalid;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        triangleScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+        if (best == kInvalid || triangleScores[t] > triangleScores[best]) best = static_cast<uint32_t>(t);
+    }
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    std::vector<uint32_t> cache, newCache;
+    cache.reserve(kScoringCacheSize + 3);
+    newCache.reserve(kScoringCacheSize + 3);
+    size_t cursor = 0;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+        if (best == kInvalid) {
+            // Dead end, no triangle touches the cache: continue with the next unemitted triangle in input order
+            while (emitted[cursor]) cursor++;
+            best = static_cast<uint32_t>(cursor);
+        }
+
+        const uint32_t* triangle = &indices[3 * best];
+        emitted[best] = true;
+        for (size_t k = 0; k < 3; ++k) {
+            uint32_t v = triangle[k];
+            result.push_back(v);
+            // Drop the triangle from the vertex's live adjacency
+            uint32_t* begin = &adjacency[adjacencyStart[v]];
+            uint32_t* last = begin + remaining[v] - 1;
+            *std::find(begin, last + 1, best) = *last;
+            *last = best;
+            remaining[v]--;
+        }
+
+        // The triangle's vertices move to the front of the LRU cache
+        newCache.assign(triangle, triangle + 3);
+        for (uint32_t v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) newCache.push_back(v);
+        }
+        for (size_t i = 0; i < newCache.size(); ++i) {
+            cachePositions[newCache[i]] = i < kScoringCacheSize ? static_cast<int>(i) : -1;
+        }
+        for (uint32_t v : newCache) vertexScores[v] = tables.score(cachePositions[v], remaining[v]);
+
+        // Rescore the live triangles around the cache, and pick the best of them
+        best = kInvalid;
+        for (uint32_t v : newCache) {
+            for (uint32_t i = adjacencyStart[v]; i < adjacencyStart[v] + remaining[v]; ++i) {
+                uint32_t t = adjacency[i];
+                triangleScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+                if (cachePositions[v] >= 0 &&
+                    (best == kInvalid || triangleScores[t] > triangleScores[best] || (triangleScores[t] == triangleScores[best] && t < best))) {
+                    best = t;
+                }
+            }
+        }
+
+        if (newCache.size() > kScoringCacheSize) newCache.resize(kScoringCacheSize);
+        std::swap(cache, newCache);
+    }
+    return result;
+}
+
+// Split the cache-optimized order into clusters and sort them so outward-facing ones are drawn first
+std::vector<uint32_t> optimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& vertices) {
+    size_t triangleCount = indices.size() / 3;
+    FIFOCache cache(vertices.size(), kMeasureCacheSize);
+
+    // Hard boundaries: the cache got flushed, all three vertices of the triangle miss
+    std::vector<size_t> hardBoundaries = {0};
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (triangleMisses(cache, &indices[3 * t]) == 3 && t > 0) hardBoundaries.push_back(t);
+    }
+    hardBoundaries.push_back(triangleCount);
+
+    // Soft boundaries: inside a hard cluster, cut as soon as the running ACMR is close enough to the cluster's
+    std::vector<size_t> clusters;
+    for (size_t c = 0; c + 1 < hardBoundaries.size(); ++c) {
+        size_t begin = hardBoundaries[c], end = hardBoundaries[c + 1];
+        cache.reset();
+        size_t clusterMisses = 0;
+        for (size_t t = begin; t < end; ++t) clusterMisses += triangleMisses(cache, &indices[3 * t]);
+        double threshold = kOverdrawThreshold * double(clusterMisses) / double(end - begin);
+
+        cache.reset();
+        size_t start = begin, misses = 0;
+        clusters.push_back(begin);
+        for (size_t t = begin; t < end; ++t) {
+            misses += triangleMisses(cache, &indices[3 * t]);
+            if (t + 1 < end && double(misses) / double(t + 1 - start) <= threshold) {
+                clusters.push_back(t + 1);
+                cache.reset();
+                start = t + 1;
+                misses = 0;
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    // Area-weighted centroid and normal of every cluster, and of the whole mesh
+    size_t clusterCount = clusters.size() - 1;
+    std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+    std::vector<float> areas(clusterCount, 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; ++c) {
+        for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+            const glm::vec3& p0 = vertices[indices[3 * t]];
+            const glm::vec3& p1 = vertices[indices[3 * t + 1]];
+            const glm::vec3& p2 = vertices[indices[3 * t + 2]];
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+            centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+            normals[c] += normal;
+            areas[c] += area;
+        }
+        meshCentroid += centroids[c];
+        meshArea += areas[c];
+    }
+    if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+    std::vector<float> keys(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; ++c) {
+        float normalLength = glm::length(normals[c]);
+        if (areas[c] <= 0.0f || normalLength <= 0.0f) continue;
+        keys[c] = glm::dot(centroids[c] / areas[c] - meshCentroid, normals[c] / normalLength);
+    }
+
+    std::vector<uint32_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (uint32_t c : order) {
+        result.insert(result.end(), indices.begin() + static_cast<long long>(3 * clusters[c]),
+                      indices.begin() + static_cast<long long>(3 * clusters[c + 1]));
+    }
+    return result;
+}
+
+template <typename T>
+void permute(std::vector<T>& values, const std::vector<uint32_t>& remap) {
+    if (values.size() != remap.size()) return;
+    std::vector<T> result(values.size());
+    for (size_t v = 0; v < values.size(); ++v) result[remap[v]] = values[v];
+    values = std::move(result);
+}
+
+// Renumber vertices in first-use order; unreferenced vertices keep their relative order at the end
+void optimizeVertexFetch(Shape& shape) {
+    size_t vertexCount = shape.vertices.size();
+    std::vector<uint32_t> remap(vertexCount, kInvalid);
+    uint32_t next = 0;
+    for (uint32_t& index : shape.indices) {
+        if (remap[index] == kInvalid) remap[index] = next++;
+        index = remap[index];
+    }
+    for (size_t v = 0; v < vertexCount; ++v) {
+        if (remap[v] == kInvalid) remap[v] = next++;
+    }
+
+    permute(shape.vertices, remap);
+    permute(shape.normals, remap);
+    permute(shape.texCoords, remap);
+    permute(shape.colors, remap);
+}
+
+}
+
+double calcACMR(const std::vector<uint32_t>& indices, size_t vertexCount, size_t cacheSize) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return 0.0;
+    FIFOCache cache(vertexCount, cacheSize);
+    size_t misses = 0;
+    for (size_t t = 0; t < triangleCount; ++t) misses += triangleMisses(cache, &indices[3 * t]);
+    return double(misses) / double(triangleCount);
+}
+
+std::vector<uint32_t> optimizeTriangleOrder(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& vertices) {
+    return optimizeOverdraw(optimizeVertexCache(indices, vertices.size()), vertices);
+}
+
+MeshOptimizeStats optimizeMesh(Shape& shape) {
+    MeshOptimizeStats stats;
+    if (shape.primitive != PRIMITIVE_TYPE::Triangles || shape.indices.size() < 3) return stats;
+    shape.indices.resize(shape.indices.size() / 3 * 3);
+
+    stats.acmrBefore = calcACMR(shape.indices, shape.vertices.size());
+    shape.indices = optimizeTriangleOrder(shape.indices, shape.vertices);
+    optimizeVertexFetch(shape);
+    stats.acmrAfter = calcACMR(shape.indices, shape.vertices.size());
+    return stats;
+}
+
+void optimizeModel(Model& model) {
+    std::vector<MeshOptimizeStats> stats(model.getShapeCount());
+    parallelTasks(model.getShapeCount(), [&](size_t i) {
+        stats[i] = optimizeMesh(model.getShape(i));
+    });
+
+    // Triangle-weighted over all shapes
+    double before = 0.0, after = 0.0;
+    size_t triangles = 0;
+    for (size_t i = 0; i < stats.size(); ++i) {
+        size_t count = model.getIndices(i).size() / 3;
+        before += stats[i].acmrBefore * double(count);
+        after += stats[i].acmrAfter * double(count);
+        triangles += count;
+    }
+    if (triangles == 0) return;
+    std::cout << "Optimized " << model.getName() << ": ACMR " << std::fixed << std::setprecision(3)
+              << before / double(triangles) << " -> " << after / double(triangles) << std::defaultfloat << std::endl;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "viewer/scene.h"
+
+struct MeshOptimizeStats {
+    double acmrBefore = 0.0;    // Average cache miss ratio (post-transform cache misses per triangle)
+    double acmrAfter = 0.0;
+};
+
+// Simulated misses per triangle of a FIFO post-transform vertex cache, 0.5 is ideal for large meshes and 3 the worst
+double calcACMR(const std::vector<uint32_t>& indices, size_t vertexCount, size_t cacheSize = 16);
+
+// Reorder a triangle shape for the GPU, in place and deterministically:
+// 1. triangles for post-transform vertex cache hits (Forsyth's linear-speed algorithm)
+// 2. clusters of those triangles, outward-facing first, to reduce overdraw (Sander et al. 2007)
+// 3. vertices in first-use order, so vertex fetch walks memory linearly
+// Point clouds are left untouched.
+MeshOptimizeStats optimizeMesh(Shape& shape);
+
+// Steps 1 and 2 of optimizeMesh only, for extra index lists over already optimized vertices (e.g. LODs)
+std::vector<uint32_t> optimizeTriangleOrder(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& vertices);
+
+// Optimize every shape of the model in parallel, logging the ACMR before and after
+void optimizeModel(Model& model);
@@ -0,0 +1,148 @@
+#include "meshlets.h"
+#include "utils/parallel.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr size_t kGrain = 1 << 10;      // Meshlets per parallel range, at minimum
+
+void computeBounds(const Shape& shape, Meshlet& meshlet) {
+    const uint32_t* indices = &shape.indices[meshlet.indexOffset];
+
+    glm::vec3 minBound = shape.vertices[indices[0]], maxBound = minBound;
+    for (uint32_t i = 0; i < meshlet.indexCount; ++i) {
+        minBound = glm::min(minBound, shape.vertices[indices[i]]);
+        maxBound = glm::max(maxBound, shape.vertices[indices[i]]);
+    }
+    glm::vec3 center = (minBound + maxBound) * 0.5f;
+    float radius = 0.0f;
+    for (uint32_t i = 0; i < meshlet.indexCount; ++i) radius = std::max(radius, glm::length(shape.vertices[indices[i]] - center));
+    meshlet.boundingSphere = glm::vec4(center, radius);
+
+    // Normal cone: average face normal, opened up to the face normal furthest from it
+    std::vector<glm::vec3> normals;
+    normals.reserve(meshlet.indexCount / 3);
+    glm::vec3 axis(0.0f);
+    for (uint32_t t = 0; t < meshlet.indexCount; t += 3) {
+        const glm::vec3& p0 = shape.vertices[indices[t]];
+        glm::vec3 normal = glm::cross(shape.vertices[indices[t + 1]] - p0, shape.vertices[indices[t + 2]] - p0);
+        float length = glm::length(normal);
+        if (length <= 0.0f) continue;
+        normals.push_back(normal / length);
+        axis += normals.back();
+    }
+    float axisLength = glm::length(axis);
+    if (normals.empty() || axisLength <= 0.0f) {
+        meshlet.cone = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+        return;
+    }
+    axis /= axisLength;
+    float minDot = 1.0f;
+    for (const auto& normal : normals) minDot = std::min(minDot, glm::dot(axis, normal));
+
+    // Cutoff is the sine of the cone's half angle; cones of 90 degrees or wider can never be culled (cutoff 1)
+    float cutoff = minDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+    meshlet.cone = glm::vec4(axis, cutoff);
+}
+
+}
+
+void buildMeshlets(Shape& shape) {
+    shape.meshlets.clear();
+    if (shape.primitive != PRIMITIVE_TYPE::Triangles || shape.indices.size() < 3) return;
+
+    const std::vector<uint32_t>& indices = shape.indices;
+    size_t vertexCount = shape.vertices.size();
+    size_t triangleCount = indices.size() / 3;
+
+    // Vertex -> triangle adjacency
+    std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i) adjacencyStart[indices[i] + 1]++;
+    for (size_t v = 0; v < vertexCount; ++v) adjacencyStart[v + 1] += adjacencyStart[v];
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    {
+        std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (size_t t = 0; t < triangleCount; ++t)
+            for (size_t k = 0; k < 3; ++k) adjacency[fill[indices[3 * t + k]]++] = static_cast<uint32_t>(t);
+    }
+
+    std::vector<glm::vec3> faceNormals(triangleCount, glm::vec3(0.0f));
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const glm::vec3& p0 = shape.vertices[indices[3 * t]];
+        glm::vec3 normal = glm::cross(shape.vertices[indices[3 * t + 1]] - p0, shape.vertices[indices[3 * t + 2]] - p0);
+        float length = glm::length(normal);
+        if (length > 0.0f) faceNormals[t] = normal / length;
+    }
+
+    // Grow each meshlet over adjacent triangles, taking the one adding the fewest vertices and, among those,
+    // the one best aligned with the meshlet's normal, so meshlets stay compact and their cones narrow
+    std::vector<uint32_t> stamps(vertexCount, ~0u);       // Vertices of the current meshlet carry its number
+    std::vector<bool> used(triangleCount, false);
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(triangleCount * 3);
+    size_t seed = 0;
+
+    while (result.size() < triangleCount * 3) {
+        auto stamp = static_cast<uint32_t>(shape.meshlets.size());
+        Meshlet meshlet{};
+        meshlet.indexOffset = static_cast<uint32_t>(result.size());
+        uint32_t meshletVertices = 0;
+        glm::vec3 normalSum(0.0f);
+        candidates.clear();
+
+        while (seed < triangleCount && used[seed]) seed++;
+        auto next = static_cast<uint32_t>(seed);
+        while (next != ~0u) {
+            const uint32_t* triangle = &indices[3 * next];
+            used[next] = true;
+            for (size_t k = 0; k < 3; ++k) {
+                uint32_t v = triangle[k];
+                if (stamps[v] == stamp) continue;
+                stamps[v] = stamp;
+                meshletVertices++;
+                for (uint32_t i = adjacencyStart[v]; i < adjacencyStart[v + 1]; ++i) {
+                    if (!used[adjacency[i]]) candidates.push_back(adjacency[i]);
+                }
+            }
+            result.insert(result.end(), triangle, triangle + 3);
+            meshlet.indexCount += 3;
+            normalSum += faceNormals[next];
+            if (meshlet.indexCount / 3 >= kMeshletMaxTriangles) break;
+
+            // Pick the best candidate that still fits
+            next = ~0u;
+            uint32_t bestNew = 4;
+            float bestAlignment = -2.0f;
+            size_t write = 0;
+            for (uint32_t t : candidates) {
+                if (used[t]) continue;
+                candidates[write++] = t;
+                const uint32_t* c = &indices[3 * t];
+                uint32_t newVertices = uint32_t(stamps[c[0]] != stamp) + uint32_t(stamps[c[1]] != stamp && c[1] != c[0]) +
+                                       uint32_t(stamps[c[2]] != stamp && c[2] != c[0] && c[2] != c[1]);
+                if (meshletVertices + newVertices > kMeshletMaxVertices) continue;
+                float alignment = glm::dot(faceNormals[t], normalSum);
+                if (newVertices < bestNew || (newVertices == bestNew && (alignment > bestAlignment || (alignment == bestAlignment && t < next)))) {
+                    next = t;
+                    bestNew = newVertices;
+                    bestAlignment = alignment;
+                }
+            }
+            candidates.resize(write);
+        }
+        shape.meshlets.push_back(meshlet);
+    }
+    shape.indices = std::move(result);
+
+    parallelFor(shape.meshlets.size(), kGrain, [&shape](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) computeBounds(shape, shape.meshlets[i]);
+    });
+}
+
+void buildModelMeshlets(Model& model) {
+    parallelTasks(model.getShapeCount(), [&model](size_t i) {
+        buildMeshlets(model.getShape(i));
+    });
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "viewer/scene.h"
+
+// Split the shape's full-detail triangles into meshlets (`shape.meshlets`) of at most kMeshletMaxVertices
+// unique vertices and kMeshletMaxTriangles triangles, grown over adjacent triangles so they stay compact.
+// `shape.indices` is rewritten in meshlet order, so a meshlet draw is just an index range.
+// Each meshlet gets a bounding sphere and a normal cone for frustum and backface culling.
+void buildMeshlets(Shape& shape);
+
+// Build meshlets for every shape of the model in parallel
+void buildModelMeshlets(Model& model);
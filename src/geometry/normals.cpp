@@ -0,0 +1,188 @@
+#include "normals.h"
+#include "utils/parallel.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr size_t kGrain = 1 << 15;          // Triangles/vertices per parallel range, at minimum
+constexpr size_t kMaxPartialSums = 8;       // Cap on per-thread accumulation buffers (each is one normal per vertex)
+
+float cornerAngle(const glm::vec3& corner, const glm::vec3& a, const glm::vec3& b) {
+    glm::vec3 e0 = a - corner;
+    glm::vec3 e1 = b - corner;
+    float lengths = glm::length(e0) * glm::length(e1);
+    if (lengths <= 0.0f) return 0.0f;
+    return std::acos(glm::clamp(glm::dot(e0, e1) / lengths, -1.0f, 1.0f));
+}
+
+// Weighted contribution of triangle `t` to each of its three corners
+void triangleContributions(const Shape& shape, size_t t, NORMAL_WEIGHTING weighting, glm::vec3 (&out)[3]) {
+    const glm::vec3& v0 = shape.vertices[shape.indices[3 * t + 0]];
+    const glm::vec3& v1 = shape.vertices[shape.indices[3 * t + 1]];
+    const glm::vec3& v2 = shape.vertices[shape.indices[3 * t + 2]];
+    glm::vec3 normal = glm::cross(v1 - v0, v2 - v0);    // Length is twice the triangle area
+
+    if (weighting == NORMAL_WEIGHTING::Area) {
+        out[0] = out[1] = out[2] = normal;
+        return;
+    }
+
+    float length = glm::length(normal);
+    if (length <= 0.0f) {
+        out[0] = out[1] = out[2] = glm::vec3(0.0f);
+        return;
+    }
+    normal /= length;
+    out[0] = normal * cornerAngle(v0, v1, v2);
+    out[1] = normal * cornerAngle(v1, v2, v0);
+    out[2] = normal * cornerAngle(v2, v0, v1);
+}
+
+inline glm::vec3 safeNormalize(const glm::vec3& v) {
+    float length = glm::length(v);
+    return length > 0.0f ? v / length : glm::vec3(0.0f);
+}
+
+void generateSmoothNormals(Shape& shape, NORMAL_WEIGHTING weighting) {
+    size_t vertexCount = shape.vertices.size();
+    size_t triangleCount = shape.indices.size() / 3;
+
+    // Every partition accumulates its triangle range into its own buffer, so no atomics are needed
+    size_t partitions = std::min({getWorkerCount(), kMaxPartialSums, (triangleCount + kGrain - 1) / kGrain});
+    partitions = std::max<size_t>(1, partitions);
+    std::vector<std::vector<glm::vec3>> partialSums(partitions);
+    parallelTasks(partitions, [&](size_t p) {
+        std::vector<glm::vec3>& sums = partialSums[p];
+        sums.assign(vertexCount, glm::vec3(0.0f));
+        size_t begin = triangleCount * p / partitions;
+        size_t end = triangleCount * (p + 1) / partitions;
+        glm::vec3 contributions[3];
+        for (size_t t = begin; t < end; ++t) {
+            triangleContributions(shape, t, weighting, contributions);
+            for (int k = 0; k < 3; ++k) sums[shape.indices[3 * t + k]] += contributions[k];
+        }
+    });
+
+    // Reduce the partial sums vertex range by vertex range
+    shape.normals = std::move(partialSums[0]);
+    parallelFor(vertexCount, kGrain, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            glm::vec3 sum = shape.normals[v];
+            for (size_t p = 1; p < partitions; ++p) sum += partialSums[p][v];
+            shape.normals[v] = safeNormalize(sum);
+        }
+    });
+}
+
+void generateCreasedNormals(Shape& shape, NORMAL_WEIGHTING weighting, float creaseAngle) {
+    size_t vertexCount = shape.vertices.size();
+    size_t cornerCount = shape.indices.size() / 3 * 3;
+    size_t triangleCount = cornerCount / 3;
+    float cosCrease = std::cos(glm::radians(creaseAngle));
+
+    // Unit face normals (for the crease test) and weighted per-corner contributions
+    std::vector<glm::vec3> faceNormals(triangleCount);
+    std::vector<glm::vec3> contributions(cornerCount);
+    parallelFor(triangleCount, kGrain, [&](size_t begin, size_t end) {
+        glm::vec3 corner[3];
+        for (size_t t = begin; t < end; ++t) {
+            const glm::vec3& v0 = shape.vertices[shape.indices[3 * t + 0]];
+            faceNormals[t] = safeNormalize(glm::cross(shape.vertices[shape.indices[3 * t + 1]] - v0,
+                                                      shape.vertices[shape.indices[3 * t + 2]] - v0));
+            triangleContributions(shape, t, weighting, corner);
+            for (int k = 0; k < 3; ++k) contributions[3 * t + k] = corner[k];
+        }
+    });
+
+    // Vertex -> corners adjacency in CSR form (counting sort keeps corners in index order)
+    std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+    for (size_t c = 0; c < cornerCount; ++c) adjacencyStart[shape.indices[c] + 1]++;
+    for (size_t v = 0; v < vertexCount; ++v) adjacencyStart[v + 1] += adjacencyStart[v];
+    std::vector<uint32_t> adjacency(cornerCount);
+    {
+        std::vector<uint32_t> cursor(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (size_t c = 0; c < cornerCount; ++c) adjacency[cursor[shape.indices[c]]++] = static_cast<uint32_t>(c);
+    }
+
+    // Per-corner normal: sum over the vertex's corners whose faces are within the crease angle.
+    // Corners of a vertex sum in the same order, so corners on the same smooth patch get bit-identical normals.
+    std::vector<glm::vec3> cornerNormals(cornerCount);
+    std::vector<uint32_t> splitCounts(vertexCount, 0);
+    parallelFor(vertexCount, kGrain, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            uint32_t first = adjacencyStart[v], last = adjacencyStart[v + 1];
+            for (uint32_t i = first; i < last; ++i) {
+                uint32_t c = adjacency[i];
+                const glm::vec3& faceNormal = faceNormals[c / 3];
+                glm::vec3 sum(0.0f);
+                for (uint32_t j = first; j < last; ++j) {
+                    uint32_t other = adjacency[j];
+                    if (glm::dot(faceNormal, faceNormals[other / 3]) >= cosCrease) sum += contributions[other];
+                }
+                cornerNormals[c] = safeNormalize(sum);
+            }
+
+            // Count distinct normals around the vertex, each becomes one output vertex
+            uint32_t distinct = 0;
+            for (uint32_t i = first; i < last; ++i) {
+                bool seen = false;
+                for (uint32_t j = first; j < i && !seen; ++j) seen = cornerNormals[adjacency[j]] == cornerNormals[adjacency[i]];
+                if (!seen) distinct++;
+            }
+            splitCounts[v] = std::max<uint32_t>(distinct, 1);   // Unreferenced vertices are kept as they are
+        }
+    });
+
+    std::vector<uint32_t> outputStart(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) outputStart[v + 1] = outputStart[v] + splitCounts[v];
+    size_t outputCount = outputStart[vertexCount];
+
+    bool hasTexCoords = shape.texCoords.size() == vertexCount;
+    bool hasColors = shape.colors.size() == vertexCount;
+    std::vector<glm::vec3> vertices(outputCount);
+    std::vector<glm::vec3> normals(outputCount, glm::vec3(0.0f));
+    std::vector<glm::vec2> texCoords(hasTexCoords ? outputCount : 0);
+    std::vector<glm::vec3> colors(hasColors ? outputCount : 0);
+    std::vector<uint32_t> indices(shape.indices.begin(), shape.indices.begin() + static_cast<long long>(cornerCount));
+
+    parallelFor(vertexCount, kGrain, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            uint32_t first = adjacencyStart[v], last = adjacencyStart[v + 1];
+            uint32_t base = outputStart[v];
+            for (uint32_t k = 0; k < splitCounts[v]; ++k) {
+                vertices[base + k] = shape.vertices[v];
+                if (hasTexCoords) texCoords[base + k] = shape.texCoords[v];
+                if (hasColors) colors[base + k] = shape.colors[v];
+            }
+
+            uint32_t used = 0;
+            for (uint32_t i = first; i < last; ++i) {
+                uint32_t c = adjacency[i];
+                uint32_t slot = used;
+                for (uint32_t k = 0; k < used; ++k) {
+                    if (normals[base + k] == cornerNormals[c]) { slot = k; break; }
+                }
+                if (slot == used) normals[base + used++] = cornerNormals[c];
+                indices[c] = base + slot;
+            }
+        }
+    });
+
+    shape.vertices = std::move(vertices);
+    shape.normals = std::move(normals);
+    if (hasTexCoords) shape.texCoords = std::move(texCoords);
+    if (hasColors) shape.colors = std::move(colors);
+    shape.indices = std::move(indices);
+}
+
+}
+
+void generateNormals(Shape& shape, NORMAL_WEIGHTING weighting, float creaseAngle) {
+    if (shape.vertices.empty()) return;
+    if (creaseAngle < 180.0f) {
+        generateCreasedNormals(shape, weighting, creaseAngle);
+    } else {
+        generateSmoothNormals(shape, weighting);
+    }
+}
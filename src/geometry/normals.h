@@ -0,0 +1,10 @@
+#pragma once
+
+#include "utils/enum.h"
+#include "viewer/scene.h"
+
+// Generate smooth per-vertex normals for the shape's indexed triangles, replacing `shape.normals`.
+// Face normals are accumulated in parallel into per-thread partial sums over flat arrays.
+// With a crease angle below 180 degrees, a vertex is split wherever the faces around it meet at a
+// sharper angle, so hard edges stay hard; the split duplicates positions, texcoords and colors and rewrites indices.
+void generateNormals(Shape& shape, NORMAL_WEIGHTING weighting = NORMAL_WEIGHTING::Area, float creaseAngle = 180.0f);
@@ -0,0 +1,274 @@
+#include "simplify.h"
+#include "mesh_optimizer.h"
+#include "utils/parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <tuple>
+
+namespace {
+
+constexpr size_t kMaxLODs = 4;              // Levels besides the full-detail one
+constexpr float kLODReduction = 0.5f;       // Triangle ratio between successive levels
+constexpr float kMinLODProgress = 0.85f;    // Stop the chain when a level keeps more than this ratio of triangles
+constexpr size_t kMinLODIndices = 3 * 32;   // No point in simplifying tiny shapes further
+constexpr double kBorderWeight = 10.0;      // Extra weight of the planes that keep borders in place
+constexpr size_t kMaxPasses = 32;
+
+enum class VertexKind : uint8_t {
+    Manifold,   // Free to collapse onto any neighbor
+    Border,     // On an open edge, may only collapse along it
+    Locked,     // Shares its position with other vertices (attribute seam), never moves
+};
+
+// Symmetric 4x4 quadric of squared distances to a set of weighted planes
+struct Quadric {
+    double a2 = 0, b2 = 0, c2 = 0, d2 = 0, ab = 0, ac = 0, ad = 0, bc = 0, bd = 0, cd = 0;
+    double weight = 0;
+
+    void addPlane(const glm::dvec3& n, double d, double w) {
+        a2 += w * n.x * n.x; b2 += w * n.y * n.y; c2 += w * n.z * n.z; d2 += w * d * d;
+        ab += w * n.x * n.y; ac += w * n.x * n.z; ad += w * n.x * d;
+        bc += w * n.y * n.z; bd += w * n.y * d; cd += w * n.z * d;
+        weight += w;
+    }
+
+    Quadric& operator+=(const Quadric& q) {
+        a2 += q.a2; b2 += q.b2; c2 += q.c2; d2 += q.d2;
+        ab += q.ab; ac += q.ac; ad += q.ad; bc += q.bc; bd += q.bd; cd += q.cd;
+        weight += q.weight;
+        return *this;
+    }
+
+    [[nodiscard]] double evaluate(const glm::vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double result = a2 * x * x + b2 * y * y + c2 * z * z + d2
+            + 2.0 * (ab * x * y + ac * x * z + ad * x + bc * y * z + bd * y + cd * z);
+        return std::max(result, 0.0);
+    }
+};
+
+struct Collapse {
+    double cost;
+    uint32_t from, to;
+};
+
+std::vector<VertexKind> classifyVertices(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& vertices) {
+    size_t vertexCount = vertices.size();
+    std::vector<VertexKind> kinds(vertexCount, VertexKind::Manifold);
+
+    // Seams: vertices sharing a position
+    std::vector<uint32_t> order(vertexCount);
+    std::iota(order.begin(), order.end(), 0);
+    auto position = [&vertices](uint32_t v) { return std::make_tuple(vertices[v].x, vertices[v].y, vertices[v].z); };
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return position(a) < position(b); });
+    for (size_t i = 1; i < vertexCount; ++i) {
+        if (position(order[i]) == position(order[i - 1])) kinds[order[i]] = kinds[order[i - 1]] = VertexKind::Locked;
+    }
+
+    // Borders: a half-edge without its twin
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    edges.reserve(indices.size());
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        for (size_t k = 0; k < 3; ++k) edges.emplace_back(indices[t + k], indices[t + (k + 1) % 3]);
+    }
+    std::sort(edges.begin(), edges.end());
+    for (const auto& [a, b] : edges) {
+        if (!std::binary_search(edges.begin(), edges.end(), std::make_pair(b, a))) {
+            if (kinds[a] == VertexKind::Manifold) kinds[a] = VertexKind::Border;
+            if (kinds[b] == VertexKind::Manifold) kinds[b] = VertexKind::Border;
+        }
+    }
+    return kinds;
+}
+
+void buildQuadrics(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& vertices,
+                   const std::vector<std::pair<uint32_t, uint32_t>>& sortedEdges, std::vector<Quadric>& quadrics) {
+    quadrics.assign(vertices.size(), Quadric());
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        glm::dvec3 p[3] = { glm::dvec3(vertices[indices[t]]), glm::dvec3(vertices[indices[t + 1]]), glm::dvec3(vertices[indices[t + 2]]) };
+        glm::dvec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        double area = glm::length(normal);
+        if (area <= 0.0) continue;
+        normal /= area;
+        for (size_t k = 0; k < 3; ++k) quadrics[indices[t + k]].addPlane(normal, -glm::dot(normal, p[0]), area * 0.5);
+
+        // Planes through the open edges, perpendicular to the triangle, keep the border from shrinking
+        for (size_t k = 0; k < 3; ++k) {
+            uint32_t a = indices[t + k], b = indices[t + (k + 1) % 3];
+            if (std::binary_search(sortedEdges.begin(), sortedEdges.end(), std::make_pair(b, a))) continue;
+            glm::dvec3 edge = p[(k + 1) % 3] - p[k];
+            double length = glm::length(edge);
+            if (length <= 0.0) continue;
+            glm::dvec3 borderNormal = glm::normalize(glm::cross(edge, normal));
+            double d = -glm::dot(borderNormal, p[k]);
+            quadrics[a].addPlane(borderNormal, d, kBorderWeight * length * length);
+            quadrics[b].addPlane(borderNormal, d, kBorderWeight * length * length);
+        }
+    }
+}
+
+// Would moving `from` onto `to` flip or collapse any surviving triangle around `from`?
+bool flipsTriangles(uint32_t from, uint32_t to, const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& vertices,
+                    const std::vector<uint32_t>& remap, const uint32_t* triangles, size_t triangleCount) {
+    for (size_t i = 0; i < triangleCount; ++i) {
+        uint32_t t = triangles[i];
+        uint32_t v[3] = { remap[indices[3 * t]], remap[indices[3 * t + 1]], remap[indices[3 * t + 2]] };
+        if (v[0] == v[1] || v[1] == v[2] || v[0] == v[2]) continue;   // Already gone
+        if (v[0] == to || v[1] == to || v[2] == to) continue;          // Removed by this collapse
+        glm::vec3 before = glm::cross(vertices[v[1]] - vertices[v[0]], vertices[v[2]] - vertices[v[0]]);
+        for (uint32_t& x : v) if (x == from) x = to;
+        glm::vec3 after = glm::cross(vertices[v[1]] - vertices[v[0]], vertices[v[2]] - vertices[v[0]]);
+        if (glm::dot(before, after) <= 0.0f) return true;
+    }
+    return false;
+}
+
+}
+
+std::vector<uint32_t> simplifyMesh(const std::vector<uint32_t>& input, const std::vector<glm::vec3>& vertices,
+                                   size_t targetIndexCount, float& resultError) {
+    resultError = 0.0f;
+    std::vector<uint32_t> indices(input.begin(), input.begin() + static_cast<long long>(input.size() / 3 * 3));
+    size_t vertexCount = vertices.size();
+    if (indices.size() <= targetIndexCount) return indices;
+
+    std::vector<VertexKind> kinds = classifyVertices(indices, vertices);
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    edges.reserve(indices.size());
+    for (size_t t = 0; t < indices.size(); t += 3) {
+        for (size_t k = 0; k < 3; ++k) edges.emplace_back(indices[t + k], indices[t + (k + 1) % 3]);
+    }
+    std::sort(edges.begin(), edges.end());
+    std::vector<Quadric> quadrics;
+    buildQuadrics(indices, vertices, edges, quadrics);
+
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<uint32_t> triangleStart(vertexCount + 1);
+    std::vector<uint32_t> triangleList;
+    std::vector<Collapse> collapses;
+    double maxCost = 0.0;
+
+    for (size_t pass = 0; pass < kMaxPasses && indices.size() > targetIndexCount; ++pass) {
+        size_t triangleCount = indices.size() / 3;
+
+        // Vertex -> triangle adjacency of the current mesh
+        std::fill(triangleStart.begin(), triangleStart.end(), 0);
+        for (uint32_t index : indices) triangleStart[index + 1]++;
+        for (size_t v = 0; v < vertexCount; ++v) triangleStart[v + 1] += triangleStart[v];
+        triangleList.resize(indices.size());
+        {
+            std::vector<uint32_t> fill(triangleStart.begin(), triangleStart.end() - 1);
+            for (size_t t = 0; t < triangleCount; ++t)
+                for (size_t k = 0; k < 3; ++k) triangleList[fill[indices[3 * t + k]]++] = static_cast<uint32_t>(t);
+        }
+        edges.clear();
+        for (size_t t = 0; t < indices.size(); t += 3) {
+            for (size_t k = 0; k < 3; ++k) edges.emplace_back(indices[t + k], indices[t + (k + 1) % 3]);
+        }
+        std::sort(edges.begin(), edges.end());
+        auto isBorderEdge = [&edges](uint32_t a, uint32_t b) {
+            return !std::binary_search(edges.begin(), edges.end(), std::make_pair(b, a)) ||
+                   !std::binary_search(edges.begin(), edges.end(), std::make_pair(a, b));
+        };
+        auto canCollapse = [&](uint32_t from, uint32_t to) {
+            if (kinds[from] == VertexKind::Manifold) return true;
+            if (kinds[from] == VertexKind::Border) return kinds[to] != VertexKind::Manifold && isBorderEdge(from, to);
+            return false;
+        };
+
+        // Cheapest direction of every edge, each undirected edge once
+        collapses.clear();
+        for (const auto& [a, b] : edges) {
+            bool hasTwin = std::binary_search(edges.begin(), edges.end(), std::make_pair(b, a));
+            if (hasTwin && a > b) continue;
+            Quadric q = quadrics[a];
+            q += quadrics[b];
+            double weight = std::max(q.weight, 1e-30);
+            Collapse best{std::numeric_limits<double>::infinity(), 0, 0};
+            if (canCollapse(a, b)) best = {q.evaluate(vertices[b]) / weight, a, b};
+            if (canCollapse(b, a)) {
+                double cost = q.evaluate(vertices[a]) / weight;
+                if (cost < best.cost) best = {cost, b, a};
+            }
+            if (std::isfinite(best.cost)) collapses.push_back(best);
+        }
+        if (collapses.empty()) break;
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+            return std::tie(x.cost, x.from, x.to) < std::tie(y.cost, y.from, y.to);
+        });
+
+        // Apply the cheapest collapses that don't share vertices, until enough triangles are gone
+        std::iota(remap.begin(), remap.end(), 0);
+        std::fill(touched.begin(), touched.end(), false);
+        size_t trianglesToRemove = (indices.size() - targetIndexCount) / 3;
+        size_t removed = 0;
+        size_t applied = 0;
+        for (const Collapse& collapse : collapses) {
+            if (removed >= trianglesToRemove) break;
+            if (touched[collapse.from] || touched[collapse.to]) continue;
+            const uint32_t* around = &triangleList[triangleStart[collapse.from]];
+            size_t aroundCount = triangleStart[collapse.from + 1] - triangleStart[collapse.from];
+            if (flipsTriangles(collapse.from, collapse.to, indices, vertices, remap, around, aroundCount)) continue;
+
+            for (size_t i = 0; i < aroundCount; ++i) {
+                const uint32_t* triangle = &indices[3 * around[i]];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) removed++;
+            }
+            // Lock the whole neighborhood, so the flip test above stays exact for the rest of the pass
+            for (size_t i = 0; i < aroundCount; ++i) {
+                for (size_t k = 0; k < 3; ++k) touched[indices[3 * around[i] + k]] = true;
+            }
+            touched[collapse.to] = true;
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+            maxCost = std::max(maxCost, collapse.cost);
+            applied++;
+        }
+        if (applied == 0) break;
+
+        // Rewrite the triangles, dropping the degenerate ones
+        size_t write = 0;
+        for (size_t t = 0; t < indices.size(); t += 3) {
+            uint32_t a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+            if (a == b || b == c || a == c) continue;
+            indices[write++] = a;
+            indices[write++] = b;
+            indices[write++] = c;
+        }
+        indices.resize(write);
+    }
+
+    resultError = static_cast<float>(std::sqrt(maxCost));
+    return indices;
+}
+
+void generateLODs(Shape& shape) {
+    shape.lods.clear();
+    if (shape.primitive != PRIMITIVE_TYPE::Triangles) return;
+
+    const std::vector<uint32_t>* previous = &shape.indices;
+    float previousError = 0.0f;
+    for (size_t level = 0; level < kMaxLODs; ++level) {
+        if (previous->size() < kMinLODIndices) break;
+        size_t target = static_cast<size_t>(static_cast<float>(previous->size() / 3) * kLODReduction) * 3;
+        float error = 0.0f;
+        std::vector<uint32_t> indices = simplifyMesh(*previous, shape.vertices, target, error);
+        if (indices.empty() || static_cast<float>(indices.size()) > kMinLODProgress * static_cast<float>(previous->size())) break;
+
+        ShapeLOD lod;
+        lod.indices = optimizeTriangleOrder(indices, shape.vertices);
+        lod.error = previousError + error;      // Deviations of successive levels add up at worst
+        shape.lods.push_back(std::move(lod));
+        previous = &shape.lods.back().indices;
+        previousError = shape.lods.back().error;
+    }
+}
+
+void generateModelLODs(Model& model) {
+    parallelTasks(model.getShapeCount(), [&model](size_t i) {
+        generateLODs(model.getShape(i));
+    });
+}
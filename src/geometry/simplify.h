@@ -0,0 +1,18 @@
+#pragma once
+
+#include "viewer/scene.h"
+
+// Quadric error edge-collapse simplification of an indexed triangle list towards `targetIndexCount`.
+// Vertices only ever collapse onto other existing vertices, so the result indexes the same vertex arrays
+// and every LOD of a shape can share one vertex buffer. Vertices on attribute seams (several vertices at
+// one position) stay locked, and border vertices only slide along the border, so no cracks open up.
+// `resultError` receives the largest deviation introduced, in the units of `vertices`.
+std::vector<uint32_t> simplifyMesh(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& vertices,
+                                   size_t targetIndexCount, float& resultError);
+
+// Build the shape's LOD chain (`shape.lods`), each level about half the triangles of the previous one.
+// The chain stops early once simplification no longer makes real progress.
+void generateLODs(Shape& shape);
+
+// Build LOD chains for every shape of the model in parallel
+void generateModelLODs(Model& model);
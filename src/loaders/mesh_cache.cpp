@@ -0,0 +1,295 @@
+#include "mesh_cache.h"
+#include "utils/file.h"
+#include "utils/hash.h"
+#include "utils/mapped_file.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+constexpr char kMagic[8] = {'T', 'R', 'M', 'E', 'S', 'H', '\0', '\0'};
+constexpr uint32_t kVersion = 5;
+constexpr uint32_t kEndianMarker = 0x01020304;
+constexpr size_t kAlignment = 16;
+constexpr uintmax_t kDefaultMaxBytes = uintmax_t(4) << 30;     // 4GB
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianMarker;
+    uint64_t sourceSize;
+    int64_t sourceMTime;
+    uint64_t contentHash;
+    uint32_t shapeCount;
+    uint32_t pathLength;        // Source path follows the header, then the model name
+    uint32_t nameLength;
+    uint32_t reserved;
+};
+
+// Per-shape table entry, all offsets are from the start of the file
+struct ShapeRecord {
+    uint64_t vertexCount, normalCount, texCoordCount, colorCount, indexCount;
+    uint64_t vertexOffset, normalOffset, texCoordOffset, colorOffset, indexOffset;
+    uint64_t nameOffset, texturePathOffset;
+    uint32_t nameLength, texturePathLength;
+    uint32_t primitive, lodCount;
+    uint64_t lodOffset;                 // Table of LODRecord
+    uint64_t meshletCount, meshletOffset;
+};
+
+struct LODRecord {
+    uint64_t indexCount, indexOffset;
+    float error;
+    uint32_t reserved;
+};
+
+size_t align(size_t offset) {
+    return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+template <typename T>
+bool copyArray(const MappedFile& file, uint64_t offset, uint64_t count, std::vector<T>& out) {
+    if (offset > file.size() || count > (file.size() - offset) / sizeof(T)) return false;
+    out.resize(count);
+    if (count > 0) std::memcpy(out.data(), file.data() + offset, count * sizeof(T));
+    return true;
+}
+
+bool copyString(const MappedFile& file, uint64_t offset, uint64_t length, std::string& out) {
+    if (offset > file.size() || length > file.size() - offset) return false;
+    out.assign(file.data() + offset, length);
+    return true;
+}
+
+bool validIndices(const std::vector<uint32_t>& indices, size_t vertexCount) {
+    return indices.size() % 3 == 0 && std::all_of(indices.begin(), indices.end(), [&](uint32_t index) { return index < vertexCount; });
+}
+
+// What the renderer relies on without checking, a stale or damaged entry may break any of it
+bool validShape(const Shape& shape) {
+    size_t vertexCount = shape.vertices.size();
+    for (size_t count : {shape.normals.size(), shape.texCoords.size(), shape.colors.size()}) {
+        if (count != 0 && count != vertexCount) return false;
+    }
+    if (!validIndices(shape.indices, vertexCount)) return false;
+    for (const auto& lod : shape.lods) {
+        if (!validIndices(lod.indices, vertexCount)) return false;
+    }
+    return std::all_of(shape.meshlets.begin(), shape.meshlets.end(), [&](const Meshlet& meshlet) {
+        return uint64_t(meshlet.indexOffset) + meshlet.indexCount <= shape.indices.size();
+    });
+}
+
+}
+
+MeshCache::MeshCache(std::filesystem::path directory, uintmax_t maxBytes)
+    : mDirectory(std::move(directory)), mMaxBytes(maxBytes) {}
+
+MeshCache& MeshCache::instance() {
+    static MeshCache cache(std::filesystem::path("cache") / "meshes", kDefaultMaxBytes);
+    return cache;
+}
+
+std::filesystem::path MeshCache::entryPath(const std::string& sourcePath) const {
+    std::string canonical = std::filesystem::weakly_canonical(sourcePath).string();
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(fnv1a(canonical.data(), canonical.size())));
+    return mDirectory / (std::string(name) + ".mesh");
+}
+
+bool MeshCache::load(const std::string& sourcePath, Model& model) {
+    std::error_code error;
+    std::filesystem::path path = entryPath(sourcePath);
+    if (!std::filesystem::exists(path, error)) return false;
+
+    try {
+        MappedFile file(path.string());
+        if (file.size() < sizeof(FileHeader)) return false;
+        FileHeader header{};
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+            header.endianMarker != kEndianMarker) {
+            return false;
+        }
+
+        // Validate against the source: same path, size and mtime, then the sampled content hash
+        std::string cachedPath, name;
+        std::string canonical = std::filesystem::weakly_canonical(sourcePath).string();
+        if (!copyString(file, sizeof(FileHeader), header.pathLength, cachedPath) || cachedPath != canonical) return false;
+        if (header.sourceSize != std::filesystem::file_size(sourcePath) ||
+            header.sourceMTime != fileModificationTime(sourcePath)) {
+            return false;
+        }
+        if (header.contentHash != sampledContentHash(sourcePath)) return false;
+        if (!copyString(file, sizeof(FileHeader) + header.pathLength, header.nameLength, name)) return false;
+
+        size_t tableOffset = align(sizeof(FileHeader) + header.pathLength + header.nameLength);
+        if (tableOffset + uint64_t(header.shapeCount) * sizeof(ShapeRecord) > file.size()) return false;
+
+        std::vector<Shape> shapes(header.shapeCount);
+        for (uint32_t i = 0; i < header.shapeCount; ++i) {
+            ShapeRecord record{};
+            std::memcpy(&record, file.data() + tableOffset + i * sizeof(ShapeRecord), sizeof(record));
+            Shape& shape = shapes[i];
+            if (!copyArray(file, record.vertexOffset, record.vertexCount, shape.vertices) ||
+                !copyArray(file, record.normalOffset, record.normalCount, shape.normals) ||
+                !copyArray(file, record.texCoordOffset, record.texCoordCount, shape.texCoords) ||
+                !copyArray(file, record.colorOffset, record.colorCount, shape.colors) ||
+                !copyArray(file, record.indexOffset, record.indexCount, shape.indices) ||
+                !copyString(file, record.nameOffset, record.nameLength, shape.name) ||
+                !copyString(file, record.texturePathOffset, record.texturePathLength, shape.texturePath)) {
+                return false;
+            }
+            if (record.primitive > static_cast<uint32_t>(PRIMITIVE_TYPE::Points)) return false;
+            shape.primitive = static_cast<PRIMITIVE_TYPE>(record.primitive);
+            if (!copyArray(file, record.meshletOffset, record.meshletCount, shape.meshlets)) return false;
+
+            if (record.lodOffset > file.size() || record.lodCount > (file.size() - record.lodOffset) / sizeof(LODRecord)) return false;
+            shape.lods.resize(record.lodCount);
+            for (uint32_t level = 0; level < record.lodCount; ++level) {
+                LODRecord lodRecord{};
+                std::memcpy(&lodRecord, file.data() + record.lodOffset + level * sizeof(LODRecord), sizeof(lodRecord));
+                if (!copyArray(file, lodRecord.indexOffset, lodRecord.indexCount, shape.lods[level].indices)) return false;
+                shape.lods[level].error = lodRecord.error;
+            }
+            if (!validShape(shape)) return false;
+        }
+
+        model.setName(name);
+        for (auto& shape : shapes) {
+            model.addShape(std::move(shape));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to read mesh cache entry: " << path.string() << std::endl << e.what() << std::endl;
+        return false;
+    }
+
+    // Mark as recently used for LRU eviction
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    return true;
+}
+
+void MeshCache::store(const std::string& sourcePath, const Model& model) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::error_code error;
+    std::filesystem::create_directories(mDirectory, error);
+
+    std::filesystem::path path = entryPath(sourcePath);
+    std::filesystem::path tempPath = path;
+    tempPath += ".tmp";
+
+    try {
+        std::string canonical = std::filesystem::weakly_canonical(sourcePath).string();
+        FileHeader header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.endianMarker = kEndianMarker;
+        header.sourceSize = std::filesystem::file_size(sourcePath);
+        header.sourceMTime = fileModificationTime(sourcePath);
+        header.contentHash = sampledContentHash(sourcePath);
+        header.shapeCount = static_cast<uint32_t>(model.getShapeCount());
+        header.pathLength = static_cast<uint32_t>(canonical.size());
+        header.nameLength = static_cast<uint32_t>(model.getName().size());
+
+        // Lay out the shape table and the data blocks
+        size_t tableOffset = align(sizeof(FileHeader) + header.pathLength + header.nameLength);
+        size_t offset = align(tableOffset + header.shapeCount * sizeof(ShapeRecord));
+        std::vector<ShapeRecord> records(header.shapeCount);
+        std::vector<std::vector<LODRecord>> lodRecords(header.shapeCount);
+        for (size_t i = 0; i < records.size(); ++i) {
+            ShapeRecord& record = records[i];
+            record.vertexCount = model.getVertices(i).size();
+            record.normalCount = model.getNormals(i).size();
+            record.texCoordCount = model.getTexCoords(i).size();
+            record.colorCount = model.getColors(i).size();
+            record.indexCount = model.getIndices(i).size();
+            record.primitive = static_cast<uint32_t>(model.getPrimitiveType(i));
+            record.nameLength = static_cast<uint32_t>(model.getShapeName(i).size());
+            record.texturePathLength = static_cast<uint32_t>(model.getTexturePath(i).size());
+            record.vertexOffset = offset;       offset = align(offset + record.vertexCount * sizeof(glm::vec3));
+            record.normalOffset = offset;       offset = align(offset + record.normalCount * sizeof(glm::vec3));
+            record.texCoordOffset = offset;     offset = align(offset + record.texCoordCount * sizeof(glm::vec2));
+            record.colorOffset = offset;        offset = align(offset + record.colorCount * sizeof(glm::vec3));
+            record.indexOffset = offset;        offset = align(offset + record.indexCount * sizeof(uint32_t));
+            record.nameOffset = offset;         offset += record.nameLength;
+            record.texturePathOffset = offset;  offset = align(offset + record.texturePathLength);
+
+            record.meshletCount = model.getMeshlets(i).size();
+            record.meshletOffset = offset;      offset = align(offset + record.meshletCount * sizeof(Meshlet));
+
+            const std::vector<ShapeLOD>& lods = model.getLODs(i);
+            record.lodCount = static_cast<uint32_t>(lods.size());
+            record.lodOffset = offset;          offset = align(offset + lods.size() * sizeof(LODRecord));
+            for (const auto& lod : lods) {
+                lodRecords[i].push_back({lod.indices.size(), offset, lod.error, 0});
+                offset = align(offset + lod.indices.size() * sizeof(uint32_t));
+            }
+        }
+
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("Failed to create " + tempPath.string());
+        auto padTo = [&out](size_t target) {
+            static const char zeros[kAlignment] = {};
+            auto current = static_cast<size_t>(out.tellp());
+            if (target > current) out.write(zeros, static_cast<std::streamsize>(target - current));
+        };
+        auto writeBytes = [&out](const void* data, size_t size) {
+            out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        };
+
+        writeBytes(&header, sizeof(header));
+        writeBytes(canonical.data(), canonical.size());
+        writeBytes(model.getName().data(), model.getName().size());
+        padTo(tableOffset);
+        writeBytes(records.data(), records.size() * sizeof(ShapeRecord));
+        for (size_t i = 0; i < records.size(); ++i) {
+            const ShapeRecord& record = records[i];
+            padTo(record.vertexOffset);     writeBytes(model.getVertices(i).data(), record.vertexCount * sizeof(glm::vec3));
+            padTo(record.normalOffset);     writeBytes(model.getNormals(i).data(), record.normalCount * sizeof(glm::vec3));
+            padTo(record.texCoordOffset);   writeBytes(model.getTexCoords(i).data(), record.texCoordCount * sizeof(glm::vec2));
+            padTo(record.colorOffset);      writeBytes(model.getColors(i).data(), record.colorCount * sizeof(glm::vec3));
+            padTo(record.indexOffset);      writeBytes(model.getIndices(i).data(), record.indexCount * sizeof(uint32_t));
+            padTo(record.nameOffset);       writeBytes(model.getShapeName(i).data(), record.nameLength);
+            padTo(record.texturePathOffset); writeBytes(model.getTexturePath(i).data(), record.texturePathLength);
+            padTo(record.meshletOffset);    writeBytes(model.getMeshlets(i).data(), record.meshletCount * sizeof(Meshlet));
+            padTo(record.lodOffset);        writeBytes(lodRecords[i].data(), lodRecords[i].size() * sizeof(LODRecord));
+            for (size_t level = 0; level < lodRecords[i].size(); ++level) {
+                padTo(lodRecords[i][level].indexOffset);
+                writeBytes(model.getLODs(i)[level].indices.data(), lodRecords[i][level].indexCount * sizeof(uint32_t));
+            }
+        }
+        out.close();
+        if (!out) throw std::runtime_error("Failed to write " + tempPath.string());
+
+        // Readers only ever see complete entries
+        std::filesystem::rename(tempPath, path);
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to write mesh cache entry: " << path.string() << std::endl << e.what() << std::endl;
+        std::filesystem::remove(tempPath, error);
+        return;
+    }
+
+    evict();
+}
+
+void MeshCache::evict() {
+    std::error_code error;
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> entries;
+    uintmax_t totalBytes = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(mDirectory, error)) {
+        if (entry.path().extension() != ".mesh") continue;
+        totalBytes += entry.file_size(error);
+        entries.emplace_back(entry.last_write_time(error), entry.path());
+    }
+    if (totalBytes <= mMaxBytes) return;
+
+    // Oldest access first
+    std::sort(entries.begin(), entries.end());
+    for (const auto& [time, path] : entries) {
+        if (totalBytes <= mMaxBytes) break;
+        uintmax_t size = std::filesystem::file_size(path, error);
+        if (std::filesystem::remove(path, error)) totalBytes -= size;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include "viewer/scene.h"
+
+// Persistent cache of post-processed models (deduplicated, indexed, with generated normals).
+// Entries are keyed by the source path and validated against its size, mtime and a sampled content hash.
+// The versioned binary format keeps every array contiguous and aligned so an entry is memory-mapped
+// and copied into the shapes in bulk, with no per-vertex work.
+// The cache directory is capped in size; the least recently used entries are evicted first.
+class MeshCache {
+public:
+    MeshCache(std::filesystem::path directory, uintmax_t maxBytes);
+
+    // Shared cache used by Scene, in "cache/meshes" under the working directory
+    static MeshCache& instance();
+
+    // Fill `model` from the cache, returns false on a miss or a stale/corrupt entry
+    bool load(const std::string& sourcePath, Model& model);
+    // Write `model` to the cache, then evict old entries if the cache is over its size cap
+    void store(const std::string& sourcePath, const Model& model);
+
+private:
+    std::filesystem::path mDirectory;
+    uintmax_t mMaxBytes;
+    std::mutex mMutex;      // Serializes writes and eviction between concurrent loads
+
+    [[nodiscard]] std::filesystem::path entryPath(const std::string& sourcePath) const;
+    void evict();
+};
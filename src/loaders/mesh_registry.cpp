@@ -0,0 +1,166 @@
+#include "mesh_registry.h"
+#include "utils/file.h"
+#include "utils/hash.h"
+#include "utils/parallel.h"
+#include <cstring>
+#include <filesystem>
+
+namespace {
+
+template <typename T>
+uint64_t hashArray(const std::vector<T>& array, uint64_t hash) {
+    uint64_t count = array.size();
+    hash = fnv1a(&count, sizeof(count), hash);
+    return fnv1a(array.data(), array.size() * sizeof(T), hash);
+}
+
+template <typename T>
+bool sameArray(const std::vector<T>& a, const std::vector<T>& b) {
+    return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+// Shape names are left out, models keep their own
+uint64_t contentHash(const Shape& shape) {
+    uint64_t hash = hashArray(shape.vertices, fnv1a(&shape.primitive, sizeof(shape.primitive)));
+    hash = hashArray(shape.normals, hash);
+    hash = hashArray(shape.texCoords, hash);
+    hash = hashArray(shape.colors, hash);
+    hash = hashArray(shape.indices, hash);
+    for (const auto& lod : shape.lods) {
+        hash = hashArray(lod.indices, fnv1a(&lod.error, sizeof(lod.error), hash));
+    }
+    hash = hashArray(shape.meshlets, hash);
+    return fnv1a(shape.texturePath.data(), shape.texturePath.size(), hash);
+}
+
+bool sameContent(const Shape& a, const Shape& b) {
+    if (a.primitive != b.primitive || a.texturePath != b.texturePath || a.lods.size() != b.lods.size()) return false;
+    for (size_t level = 0; level < a.lods.size(); ++level) {
+        if (a.lods[level].error != b.lods[level].error || !sameArray(a.lods[level].indices, b.lods[level].indices)) return false;
+    }
+    return sameArray(a.vertices, b.vertices) && sameArray(a.normals, b.normals) && sameArray(a.texCoords, b.texCoords) &&
+           sameArray(a.colors, b.colors) && sameArray(a.indices, b.indices) && sameArray(a.meshlets, b.meshlets);
+}
+
+size_t shapeBytes(const Shape& shape) {
+    size_t bytes = shape.vertices.size() * sizeof(glm::vec3) + shape.normals.size() * sizeof(glm::vec3) +
+                   shape.texCoords.size() * sizeof(glm::vec2) + shape.colors.size() * sizeof(glm::vec3) +
+                   shape.indices.size() * sizeof(uint32_t) + shape.meshlets.size() * sizeof(Meshlet);
+    for (const auto& lod : shape.lods) bytes += lod.indices.size() * sizeof(uint32_t);
+    return bytes;
+}
+
+}
+
+MeshRegistry& MeshRegistry::instance() {
+    static MeshRegistry registry;
+    return registry;
+}
+
+bool MeshRegistry::load(const std::string& sourcePath, Model& model) {
+    std::error_code error;
+    std::string canonical = std::filesystem::weakly_canonical(sourcePath, error).string();
+    uintmax_t size = std::filesystem::file_size(sourcePath, error);
+    if (error) return false;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mFiles.find(canonical);
+    if (it == mFiles.end() || it->second.size != size || it->second.mtime != fileModificationTime(sourcePath)) return false;
+
+    std::vector<std::shared_ptr<Shape>> shapes;
+    shapes.reserve(it->second.shapes.size());
+    for (const auto& weak : it->second.shapes) {
+        std::shared_ptr<Shape> shape = weak.lock();
+        if (!shape) return false;
+        shapes.push_back(std::move(shape));
+    }
+
+    model.setName(it->second.name);
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        model.addShape(std::move(shapes[i]), it->second.shapeNames[i]);
+    }
+    return true;
+}
+
+void MeshRegistry::store(const std::string& sourcePath, Model& model) {
+    // Hash outside the lock, it reads every array once
+    size_t shapeCount = model.getShapeCount();
+    std::vector<uint64_t> hashes(shapeCount);
+    parallelTasks(shapeCount, [&](size_t i) {
+        hashes[i] = contentHash(*model.getShapePtr(i));
+    });
+
+    FileEntry file;
+    file.name = model.getName();
+    std::error_code error;
+    file.size = std::filesystem::file_size(sourcePath, error);
+    file.mtime = fileModificationTime(sourcePath);
+    std::string canonical = std::filesystem::weakly_canonical(sourcePath, error).string();
+
+    // Candidates are gathered under the lock but compared outside it, large shapes take a while to compare and
+    // the HUD reads the registry every frame
+    std::vector<std::vector<std::shared_ptr<Shape>>> candidates(shapeCount);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        prune();
+        for (size_t i = 0; i < shapeCount; ++i) {
+            auto range = mShapes.equal_range(hashes[i]);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (std::shared_ptr<Shape> candidate = it->second.lock()) candidates[i].push_back(std::move(candidate));
+            }
+        }
+    }
+    std::vector<std::shared_ptr<Shape>> matches(shapeCount);
+    parallelTasks(shapeCount, [&](size_t i) {
+        for (auto& candidate : candidates[i]) {
+            if (sameContent(*candidate, *model.getShapePtr(i))) {
+                matches[i] = std::move(candidate);
+                break;
+            }
+        }
+    });
+
+    // A concurrent load of the same geometry may register it meanwhile, it's then kept twice
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (size_t i = 0; i < shapeCount; ++i) {
+        std::shared_ptr<Shape>& match = matches[i];
+        if (match) {
+            model.shareShape(i, match);
+        } else {
+            // Nothing else holds the model's shapes yet, so the registry can hand this one out as is
+            match = std::const_pointer_cast<Shape>(model.getShapePtr(i));
+            mShapes.emplace(hashes[i], match);
+        }
+        file.shapes.push_back(match);
+        file.shapeNames.push_back(model.getShapeName(i));
+    }
+    if (!error) mFiles[canonical] = std::move(file);
+}
+
+size_t MeshRegistry::getShapeCount() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    prune();
+    return mShapes.size();
+}
+
+size_t MeshRegistry::getGeometryBytes() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    size_t bytes = 0;
+    for (const auto& [hash, weak] : mShapes) {
+        if (std::shared_ptr<Shape> shape = weak.lock()) bytes += shapeBytes(*shape);
+    }
+    return bytes;
+}
+
+void MeshRegistry::prune() {
+    for (auto it = mShapes.begin(); it != mShapes.end();) {
+        if (it->second.expired()) it = mShapes.erase(it);
+        else ++it;
+    }
+    for (auto it = mFiles.begin(); it != mFiles.end();) {
+        bool expired = false;
+        for (const auto& shape : it->second.shapes) expired = expired || shape.expired();
+        if (expired) it = mFiles.erase(it);
+        else ++it;
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "viewer/scene.h"
+
+// In-memory registry of loaded shapes, so importing the same geometry again shares it instead of copying it.
+// Shapes are deduplicated by a hash of their content (geometry, LODs, meshlets and texture path), checked
+// byte for byte on a match. Files are remembered too, so adding an unchanged file again skips loading it.
+// Only weak references are kept: geometry is freed with the last model using it.
+class MeshRegistry {
+public:
+    // Shared registry used by Scene
+    static MeshRegistry& instance();
+
+    // Fill `model` with the shapes of an earlier import of the unchanged file, false if they are gone
+    bool load(const std::string& sourcePath, Model& model);
+    // Swap the shapes of `model` for identical registered ones, register the others and remember the file
+    void store(const std::string& sourcePath, Model& model);
+
+    // Distinct shapes alive and the bytes of their CPU arrays
+    [[nodiscard]] size_t getShapeCount();
+    [[nodiscard]] size_t getGeometryBytes();
+
+private:
+    struct FileEntry {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        std::string name;
+        std::vector<std::weak_ptr<Shape>> shapes;
+        std::vector<std::string> shapeNames;    // As named in this file, shared shapes may come from another one
+    };
+
+    std::mutex mMutex;      // Loads store from background threads
+    std::unordered_multimap<uint64_t, std::weak_ptr<Shape>> mShapes;    // By content hash
+    std::unordered_map<std::string, FileEntry> mFiles;                  // By canonical path
+
+    void prune();
+};
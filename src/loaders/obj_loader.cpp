@@ -0,0 +1,445 @@
+#include "obj_loader.h"
+#include "geometry/normals.h"
+#include "utils/mapped_file.h"
+#include "utils/parallel.h"
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"    // Only used for MTL files
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+
+namespace {
+
+constexpr size_t kMinChunkSize = 1 << 20;   // Don't split files into chunks smaller than 1MB
+
+struct Corner {
+    int vertex = -1, normal = -1, texCoord = -1;     // Zero-based, negative means absent
+};
+
+// Corner attribute written with a relative (negative) OBJ index, still relative to the chunk start
+struct RelativeRef {
+    size_t corner;
+    int attribute;      // 0: vertex, 1: normal, 2: texcoord
+};
+
+struct Event {
+    enum Type { Group, Object, UseMtl, MtlLib } type;
+    size_t face;        // Number of faces in the chunk before this event
+    std::string name;
+};
+
+struct Chunk {
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> texCoords;
+    std::vector<Corner> corners;
+    std::vector<uint32_t> faceStarts;   // First corner of every face, plus one past the last corner
+    std::vector<RelativeRef> relativeRefs;
+    std::vector<Event> events;
+};
+
+struct FaceRange {
+    size_t chunk, begin, end;
+};
+
+struct ShapeDesc {
+    std::string name;
+    int material = -1;      // Material of the first face, like tinyobj's `material_ids[0]`
+    std::vector<FaceRange> ranges;
+};
+
+struct IndexTriple {
+    int vertex, normal, texCoord;
+    bool operator==(const IndexTriple& other) const {
+        return vertex == other.vertex && normal == other.normal && texCoord == other.texCoord;
+    }
+};
+
+struct IndexTripleHash {
+    size_t operator()(const IndexTriple& key) const {
+        size_t h = std::hash<int>()(key.vertex);
+        h ^= std::hash<int>()(key.normal) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        h ^= std::hash<int>()(key.texCoord) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        return h;
+    }
+};
+
+inline bool isSpace(char c) { return c == ' ' || c == '\t'; }
+inline bool isNewLine(char c) { return c == '\n' || c == '\r'; }
+
+inline void skipSpaces(const char*& p, const char* end) {
+    while (p < end && isSpace(*p)) ++p;
+}
+
+inline bool matchKeyword(const char* p, const char* end, const char* keyword) {
+    size_t length = std::strlen(keyword);
+    return static_cast<size_t>(end - p) > length && std::memcmp(p, keyword, length) == 0 && isSpace(p[length]);
+}
+
+float parseFloat(const char*& p, const char* end) {
+    skipSpaces(p, end);
+    if (p < end && *p == '+') ++p;      // from_chars doesn't accept a leading '+'
+    float value = 0.0f;
+    auto result = std::from_chars(p, end, value);
+    p = result.ptr;
+    return value;
+}
+
+bool parseInt(const char*& p, const char* end, int& value) {
+    if (p < end && *p == '+') ++p;
+    auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc()) return false;
+    p = result.ptr;
+    return true;
+}
+
+std::string parseRestOfLine(const char* p, const char* end) {
+    skipSpaces(p, end);
+    const char* last = end;
+    while (last > p && (isSpace(last[-1]) || isNewLine(last[-1]))) --last;
+    return {p, last};
+}
+
+// Convert a raw OBJ index (1-based, or negative relative to the current count) to a zero-based index.
+// Relative indices are resolved against the chunk's local count and recorded for the later fix-up.
+int resolveIndex(int raw, size_t localCount, Chunk& chunk, int attribute) {
+    if (raw > 0) return raw - 1;
+    if (raw < 0) {
+        chunk.relativeRefs.push_back({chunk.corners.size(), attribute});
+        return static_cast<int>(localCount) + raw;
+    }
+    return -1;
+}
+
+void parseFace(const char* p, const char* end, Chunk& chunk) {
+    size_t cornerCount = 0;
+    while (true) {
+        skipSpaces(p, end);
+        if (p >= end || isNewLine(*p)) break;
+
+        Corner corner;
+        int raw = 0;
+        if (!parseInt(p, end, raw)) break;
+        corner.vertex = resolveIndex(raw, chunk.positions.size() / 3, chunk, 0);
+        if (p < end && *p == '/') {
+            ++p;
+            if (p < end && *p != '/' && parseInt(p, end, raw)) {
+                corner.texCoord = resolveIndex(raw, chunk.texCoords.size() / 2, chunk, 2);
+            }
+            if (p < end && *p == '/') {
+                ++p;
+                if (parseInt(p, end, raw)) {
+                    corner.normal = resolveIndex(raw, chunk.normals.size() / 3, chunk, 1);
+                }
+            }
+        }
+        chunk.corners.push_back(corner);
+        ++cornerCount;
+
+        while (p < end && !isSpace(*p) && !isNewLine(*p)) ++p;     // Skip anything we don't understand
+    }
+
+    if (cornerCount > 0) {
+        chunk.faceStarts.push_back(static_cast<uint32_t>(chunk.corners.size()));
+    }
+}
+
+void parseChunk(const char* begin, const char* end, Chunk& chunk) {
+    chunk.faceStarts.push_back(0);
+
+    const char* line = begin;
+    while (line < end) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', end - line));
+        if (!lineEnd) lineEnd = end;
+
+        const char* p = line;
+        skipSpaces(p, lineEnd);
+        size_t faceCount = chunk.faceStarts.size() - 1;
+
+        if (matchKeyword(p, lineEnd, "v")) {
+            p += 2;
+            for (int i = 0; i < 3; ++i) chunk.positions.push_back(parseFloat(p, lineEnd));
+        } else if (matchKeyword(p, lineEnd, "vn")) {
+            p += 3;
+            for (int i = 0; i < 3; ++i) chunk.normals.push_back(parseFloat(p, lineEnd));
+        } else if (matchKeyword(p, lineEnd, "vt")) {
+            p += 3;
+            for (int i = 0; i < 2; ++i) chunk.texCoords.push_back(parseFloat(p, lineEnd));
+        } else if (matchKeyword(p, lineEnd, "f")) {
+            parseFace(p + 2, lineEnd, chunk);
+        } else if (matchKeyword(p, lineEnd, "g")) {
+            // Multiple group names are joined with a space, as tinyobj does
+            std::string name;
+            p += 2;
+            while (true) {
+                skipSpaces(p, lineEnd);
+                const char* tokenEnd = p;
+                while (tokenEnd < lineEnd && !isSpace(*tokenEnd) && !isNewLine(*tokenEnd)) ++tokenEnd;
+                if (tokenEnd == p) break;
+                if (!name.empty()) name += ' ';
+                name.append(p, tokenEnd);
+                p = tokenEnd;
+            }
+            chunk.events.push_back({Event::Group, faceCount, name});
+        } else if (matchKeyword(p, lineEnd, "o")) {
+            chunk.events.push_back({Event::Object, faceCount, parseRestOfLine(p + 2, lineEnd)});
+        } else if (matchKeyword(p, lineEnd, "usemtl")) {
+            chunk.events.push_back({Event::UseMtl, faceCount, parseRestOfLine(p + 7, lineEnd)});
+        } else if (matchKeyword(p, lineEnd, "mtllib")) {
+            chunk.events.push_back({Event::MtlLib, faceCount, parseRestOfLine(p + 7, lineEnd)});
+        }
+
+        line = lineEnd + 1;
+    }
+}
+
+void loadMaterials(const std::string& fileNames, const std::filesystem::path& baseDir,
+                   std::vector<tinyobj::material_t>& materials, std::map<std::string, int>& materialMap) {
+    // Use the first file that can be opened, as tinyobj does
+    const char* p = fileNames.data();
+    const char* end = p + fileNames.size();
+    while (p < end) {
+        skipSpaces(p, end);
+        const char* tokenEnd = p;
+        while (tokenEnd < end && !isSpace(*tokenEnd)) ++tokenEnd;
+        std::string fileName(p, tokenEnd);
+        p = tokenEnd;
+        if (fileName.empty()) continue;
+
+        std::ifstream mtlStream(baseDir / fileName);
+        if (!mtlStream) continue;
+        std::string warn, err;
+        tinyobj::LoadMtl(&materialMap, &materials, &mtlStream, &warn, &err);
+        if (!err.empty()) std::cerr << "Failed to load material: " << err << std::endl;
+        return;
+    }
+    std::cerr << "Failed to load material file(s): " << fileNames << std::endl;
+}
+
+// Split a face into triangles (local corner offsets), following tinyobj for triangles and quads
+void triangulateFace(const Corner* corners, size_t cornerCount, const std::vector<float>& positions,
+                     std::vector<uint32_t>& triangles) {
+    triangles.clear();
+    if (cornerCount < 3) return;
+    if (cornerCount == 4) {
+        // Split along the shorter diagonal
+        auto position = [&](size_t k) {
+            const float* v = &positions[3 * static_cast<size_t>(corners[k].vertex)];
+            return glm::vec3(v[0], v[1], v[2]);
+        };
+        glm::vec3 e02 = position(2) - position(0);
+        glm::vec3 e13 = position(3) - position(1);
+        if (glm::dot(e02, e02) < glm::dot(e13, e13)) {
+            triangles = {0, 1, 2, 0, 2, 3};
+        } else {
+            triangles = {0, 1, 3, 1, 2, 3};
+        }
+        return;
+    }
+    for (uint32_t k = 1; k + 1 < cornerCount; ++k) {
+        triangles.push_back(0);
+        triangles.push_back(k);
+        triangles.push_back(k + 1);
+    }
+}
+
+Shape buildShape(const ShapeDesc& desc, const std::vector<Chunk>& chunks,
+                 const std::vector<float>& positions, const std::vector<float>& normals,
+                 const std::vector<float>& texCoords) {
+    Shape shape;
+    shape.name = desc.name;
+
+    size_t vertexCount = positions.size() / 3;
+    size_t normalCount = normals.size() / 3;
+    size_t texCoordCount = texCoords.size() / 2;
+    bool hasNormals = normalCount > 0;
+    bool hasTexCoords = texCoordCount > 0;
+
+    size_t cornerCount = 0;
+    for (const auto& range : desc.ranges) {
+        const auto& faceStarts = chunks[range.chunk].faceStarts;
+        cornerCount += faceStarts[range.end] - faceStarts[range.begin];
+    }
+    shape.indices.reserve(cornerCount * 3 / 2);
+
+    std::unordered_map<IndexTriple, uint32_t, IndexTripleHash> uniqueVertices;
+    uniqueVertices.reserve(cornerCount / 2);
+    std::vector<uint32_t> triangles;
+    std::vector<uint32_t> missingNormals;   // Vertices of faces without normal indices, in a file that has normals
+
+    for (const auto& range : desc.ranges) {
+        const Chunk& chunk = chunks[range.chunk];
+        for (size_t face = range.begin; face < range.end; ++face) {
+            const Corner* corners = chunk.corners.data() + chunk.faceStarts[face];
+            size_t faceSize = chunk.faceStarts[face + 1] - chunk.faceStarts[face];
+
+            bool valid = true;
+            for (size_t k = 0; k < faceSize; ++k) {
+                if (corners[k].vertex < 0 || static_cast<size_t>(corners[k].vertex) >= vertexCount) valid = false;
+            }
+            if (!valid) continue;
+
+            triangulateFace(corners, faceSize, positions, triangles);
+            for (uint32_t k : triangles) {
+                const Corner& corner = corners[k];
+                int normal = (corner.normal >= 0 && static_cast<size_t>(corner.normal) < normalCount) ? corner.normal : -1;
+                int texCoord = (corner.texCoord >= 0 && static_cast<size_t>(corner.texCoord) < texCoordCount) ? corner.texCoord : -1;
+
+                IndexTriple key = {corner.vertex, normal, texCoord};
+                auto [it, inserted] = uniqueVertices.try_emplace(key, static_cast<uint32_t>(shape.vertices.size()));
+                shape.indices.push_back(it->second);
+                if (!inserted) continue;
+
+                const float* v = &positions[3 * static_cast<size_t>(corner.vertex)];
+                shape.vertices.emplace_back(v[0], v[1], v[2]);
+                if (hasNormals) {
+                    glm::vec3 n(0.0f);
+                    if (normal >= 0) n = {normals[3 * size_t(normal) + 0], normals[3 * size_t(normal) + 1], normals[3 * size_t(normal) + 2]};
+                    else missingNormals.push_back(it->second);
+                    shape.normals.push_back(n);
+                }
+                if (hasTexCoords) {
+                    glm::vec2 t(0.0f);
+                    if (texCoord >= 0) t = {texCoords[2 * size_t(texCoord) + 0], texCoords[2 * size_t(texCoord) + 1]};
+                    shape.texCoords.push_back(t);
+                }
+            }
+        }
+    }
+
+    // Calculate normals if not provided in the model file
+    if (!hasNormals) {
+        generateNormals(shape);
+    } else if (!missingNormals.empty()) {
+        // Only the vertices that lack one take a generated normal, the file's are kept
+        Shape generated;
+        generated.primitive = shape.primitive;
+        generated.vertices = shape.vertices;
+        generated.indices = shape.indices;
+        generateNormals(generated);
+        for (uint32_t vertex : missingNormals) shape.normals[vertex] = generated.normals[vertex];
+    }
+
+    return shape;
+}
+
+}
+
+std::vector<Shape> readOBJ(const std::string& path, LoadProgress& progress) {
+    MappedFile file(path);
+    std::filesystem::path baseDir = std::filesystem::path(path).parent_path();    // For MTL
+
+    // Split the file into chunks at line boundaries
+    size_t chunkCount = std::max<size_t>(1, std::min(file.size() / kMinChunkSize, getWorkerCount() * 4));
+    std::vector<size_t> boundaries(chunkCount + 1, file.size());
+    boundaries[0] = 0;
+    for (size_t i = 1; i < chunkCount; ++i) {
+        size_t pos = std::max(file.size() * i / chunkCount, boundaries[i - 1]);
+        const void* newLine = pos < file.size() ? std::memchr(file.data() + pos, '\n', file.size() - pos) : nullptr;
+        boundaries[i] = newLine ? static_cast<const char*>(newLine) - file.data() + 1 : file.size();
+    }
+
+    // Parse every chunk independently (the bulk of the work, first 70% of the progress)
+    std::vector<Chunk> chunks(chunkCount);
+    std::atomic<size_t> parsedChunks{0};
+    parallelTasks(chunkCount, [&](size_t i) {
+        progress.checkCancelled();
+        parseChunk(file.data() + boundaries[i], file.data() + boundaries[i + 1], chunks[i]);
+        progress.set(0.7f * static_cast<float>(++parsedChunks) / static_cast<float>(chunkCount));
+    });
+    progress.checkCancelled();
+
+    // Stitch the attribute arrays together, resolving relative indices against the global counts
+    std::vector<size_t> positionBase(chunkCount + 1, 0), normalBase(chunkCount + 1, 0), texCoordBase(chunkCount + 1, 0);
+    for (size_t i = 0; i < chunkCount; ++i) {
+        positionBase[i + 1] = positionBase[i] + chunks[i].positions.size();
+        normalBase[i + 1] = normalBase[i] + chunks[i].normals.size();
+        texCoordBase[i + 1] = texCoordBase[i] + chunks[i].texCoords.size();
+    }
+    std::vector<float> positions(positionBase[chunkCount]);
+    std::vector<float> normals(normalBase[chunkCount]);
+    std::vector<float> texCoords(texCoordBase[chunkCount]);
+    parallelTasks(chunkCount, [&](size_t i) {
+        Chunk& chunk = chunks[i];
+        std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + positionBase[i]);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + normalBase[i]);
+        std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), texCoords.begin() + texCoordBase[i]);
+        for (const auto& ref : chunk.relativeRefs) {
+            Corner& corner = chunk.corners[ref.corner];
+            if (ref.attribute == 0) corner.vertex += static_cast<int>(positionBase[i] / 3);
+            else if (ref.attribute == 1) corner.normal += static_cast<int>(normalBase[i] / 3);
+            else corner.texCoord += static_cast<int>(texCoordBase[i] / 2);
+        }
+        std::vector<float>().swap(chunk.positions);
+        std::vector<float>().swap(chunk.normals);
+        std::vector<float>().swap(chunk.texCoords);
+    });
+
+    // Walk groups/objects/materials in file order to find shape boundaries
+    std::vector<tinyobj::material_t> materials;
+    std::map<std::string, int> materialMap;
+    std::vector<ShapeDesc> shapeDescs;
+    ShapeDesc current;
+    int material = -1;
+
+    auto addFaces = [&](size_t chunk, size_t begin, size_t end) {
+        if (begin >= end) return;
+        if (current.ranges.empty()) current.material = material;
+        current.ranges.push_back({chunk, begin, end});
+    };
+
+    for (size_t i = 0; i < chunkCount; ++i) {
+        size_t cursor = 0;
+        for (const auto& event : chunks[i].events) {
+            addFaces(i, cursor, event.face);
+            cursor = event.face;
+            switch (event.type) {
+                case Event::Group:
+                case Event::Object:
+                    if (!current.ranges.empty()) shapeDescs.push_back(std::move(current));
+                    current = ShapeDesc();
+                    current.name = event.name;
+                    break;
+                case Event::UseMtl: {
+                    auto it = materialMap.find(event.name);
+                    material = it != materialMap.end() ? it->second : -1;
+                    break;
+                }
+                case Event::MtlLib:
+                    loadMaterials(event.name, baseDir, materials, materialMap);
+                    break;
+            }
+        }
+        addFaces(i, cursor, chunks[i].faceStarts.size() - 1);
+    }
+    if (!current.ranges.empty()) shapeDescs.push_back(std::move(current));
+
+    // Build the indexed shapes
+    progress.checkCancelled();
+    progress.set(0.75f);
+    std::vector<Shape> shapes(shapeDescs.size());
+    std::atomic<size_t> builtShapes{0};
+    parallelTasks(shapeDescs.size(), [&](size_t i) {
+        progress.checkCancelled();
+        shapes[i] = buildShape(shapeDescs[i], chunks, positions, normals, texCoords);
+        progress.set(0.75f + 0.25f * static_cast<float>(++builtShapes) / static_cast<float>(shapeDescs.size()));
+
+        int materialId = shapeDescs[i].material;
+        if (materialId >= 0 && static_cast<size_t>(materialId) < materials.size() && !materials[materialId].diffuse_texname.empty()) {
+            shapes[i].texturePath = (baseDir / materials[materialId].diffuse_texname).string();
+        }
+    });
+
+    // Shapes whose faces all referenced missing vertices end up empty, drop them like tinyobj does
+    shapes.erase(std::remove_if(shapes.begin(), shapes.end(), [](const Shape& shape) {
+        return shape.indices.empty();
+    }), shapes.end());
+
+    return shapes;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "viewer/scene.h"
+#include "utils/progress.hpp"
+
+// Parallel Wavefront OBJ reader.
+// The file is memory-mapped and split at line boundaries into chunks that are parsed on all cores,
+// then the chunks' index spaces and group/object boundaries are stitched together in file order.
+// Shapes are split on `g`/`o` like tinyobjloader, polygons are triangulated and every unique
+// (position, normal, texcoord) triple becomes one indexed vertex.
+// Reports progress to `progress` and throws LoadCancelledError once it is cancelled.
+std::vector<Shape> readOBJ(const std::string& path, LoadProgress& progress);
@@ -0,0 +1,402 @@
+#include "ply_loader.h"
+#include "utils/mapped_file.h"
+#include "utils/parallel.h"
+#include <atomic>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t kGrain = 1 << 16;      // Vertices/faces per parallel slice, at minimum
+
+enum class PLYType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid };
+
+struct PLYProperty {
+    std::string name;
+    PLYType type = PLYType::Invalid;
+    bool isList = false;
+    PLYType countType = PLYType::Invalid;   // List properties only
+    size_t offset = 0;                      // Byte offset in a row, valid while all previous properties are fixed-size
+};
+
+struct PLYElement {
+    std::string name;
+    size_t count = 0;
+    std::vector<PLYProperty> properties;
+    size_t rowSize = 0;                     // Byte size of a row if the element has no list properties
+    bool fixedSize = true;
+
+    [[nodiscard]] const PLYProperty* find(const std::string& propertyName) const {
+        for (const auto& property : properties)
+            if (property.name == propertyName) return &property;
+        return nullptr;
+    }
+};
+
+PLYType parseType(const std::string& name) {
+    if (name == "char" || name == "int8") return PLYType::Int8;
+    if (name == "uchar" || name == "uint8") return PLYType::UInt8;
+    if (name == "short" || name == "int16") return PLYType::Int16;
+    if (name == "ushort" || name == "uint16") return PLYType::UInt16;
+    if (name == "int" || name == "int32") return PLYType::Int32;
+    if (name == "uint" || name == "uint32") return PLYType::UInt32;
+    if (name == "float" || name == "float32") return PLYType::Float32;
+    if (name == "double" || name == "float64") return PLYType::Float64;
+    return PLYType::Invalid;
+}
+
+size_t typeSize(PLYType type) {
+    switch (type) {
+        case PLYType::Int8: case PLYType::UInt8: return 1;
+        case PLYType::Int16: case PLYType::UInt16: return 2;
+        case PLYType::Int32: case PLYType::UInt32: case PLYType::Float32: return 4;
+        case PLYType::Float64: return 8;
+        default: return 0;
+    }
+}
+
+bool isHostLittleEndian() {
+    const uint16_t probe = 1;
+    return *reinterpret_cast<const uint8_t*>(&probe) == 1;
+}
+
+template <typename T>
+T load(const char* p, bool swap) {
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, p, sizeof(T));
+    if (swap) {
+        for (size_t i = 0; i < sizeof(T) / 2; ++i) std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+    }
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+template <typename Out>
+Out readValue(const char* p, PLYType type, bool swap) {
+    switch (type) {
+        case PLYType::Int8: return static_cast<Out>(load<int8_t>(p, swap));
+        case PLYType::UInt8: return static_cast<Out>(load<uint8_t>(p, swap));
+        case PLYType::Int16: return static_cast<Out>(load<int16_t>(p, swap));
+        case PLYType::UInt16: return static_cast<Out>(load<uint16_t>(p, swap));
+        case PLYType::Int32: return static_cast<Out>(load<int32_t>(p, swap));
+        case PLYType::UInt32: return static_cast<Out>(load<uint32_t>(p, swap));
+        case PLYType::Float32: return static_cast<Out>(load<float>(p, swap));
+        case PLYType::Float64: return static_cast<Out>(load<double>(p, swap));
+        default: return Out(0);
+    }
+}
+
+// Color channels are stored as integers (usually uchar) or as floats already in [0, 1]
+float readColor(const char* p, PLYType type, bool swap) {
+    switch (type) {
+        case PLYType::UInt8: return static_cast<float>(load<uint8_t>(p, swap)) / 255.0f;
+        case PLYType::UInt16: return static_cast<float>(load<uint16_t>(p, swap)) / 65535.0f;
+        case PLYType::Float32: case PLYType::Float64: return readValue<float>(p, type, swap);
+        default: return readValue<float>(p, type, swap) / 255.0f;
+    }
+}
+
+struct PLYHeader {
+    bool binary = false;
+    bool bigEndian = false;
+    std::vector<PLYElement> elements;
+    size_t dataOffset = 0;      // First byte after `end_header`
+};
+
+PLYHeader parseHeader(const MappedFile& file, const std::string& path) {
+    PLYHeader header;
+    const char* data = file.data();
+    size_t size = file.size();
+    if (size < 4 || std::memcmp(data, "ply", 3) != 0) {
+        throw std::runtime_error("Not a PLY file: " + path);
+    }
+
+    size_t pos = 0;
+    while (pos < size) {
+        const void* newLine = std::memchr(data + pos, '\n', size - pos);
+        if (!newLine) break;
+        size_t lineEnd = static_cast<const char*>(newLine) - data;
+        std::string line(data + pos, lineEnd - pos);
+        pos = lineEnd + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+
+        std::istringstream tokens(line);
+        std::string keyword;
+        tokens >> keyword;
+        if (keyword == "format") {
+            std::string format;
+            tokens >> format;
+            header.binary = format != "ascii";
+            header.bigEndian = format == "binary_big_endian";
+        } else if (keyword == "element") {
+            PLYElement element;
+            tokens >> element.name >> element.count;
+            header.elements.push_back(element);
+        } else if (keyword == "property") {
+            if (header.elements.empty()) throw std::runtime_error("PLY property without element: " + path);
+            PLYElement& element = header.elements.back();
+            PLYProperty property;
+            std::string type;
+            tokens >> type;
+            if (type == "list") {
+                std::string countType, itemType;
+                tokens >> countType >> itemType >> property.name;
+                property.isList = true;
+                property.countType = parseType(countType);
+                property.type = parseType(itemType);
+                if (property.countType == PLYType::Invalid) throw std::runtime_error("Invalid PLY type: " + countType);
+            } else {
+                tokens >> property.name;
+                property.type = parseType(type);
+            }
+            if (property.type == PLYType::Invalid) throw std::runtime_error("Invalid PLY type in: " + line);
+
+            property.offset = element.rowSize;
+            if (property.isList) element.fixedSize = false;
+            else element.rowSize += typeSize(property.type);
+            element.properties.push_back(property);
+        } else if (keyword == "end_header") {
+            header.dataOffset = pos;
+            return header;
+        }
+    }
+    throw std::runtime_error("Invalid PLY header: " + path);
+}
+
+// Read the item count of the list property at `p` into `count`. False if the count is negative, or if it or
+// its items run past `end`.
+bool readListCount(const char* p, const char* end, const PLYProperty& property, bool swap, size_t& count) {
+    size_t countSize = typeSize(property.countType);
+    if (p > end || countSize > static_cast<size_t>(end - p)) return false;
+    auto value = readValue<int64_t>(p, property.countType, swap);
+    if (value < 0) return false;
+    count = static_cast<size_t>(value);
+    return count <= (static_cast<size_t>(end - p) - countSize) / typeSize(property.type);
+}
+
+// Byte size of one row of a variable-size element, throws if it runs past `end`
+size_t rowSize(const char* row, const char* end, const PLYElement& element, bool swap) {
+    size_t size = 0;
+    for (const auto& property : element.properties) {
+        if (property.isList) {
+            size_t count;
+            if (!readListCount(row + size, end, property, swap, count)) throw std::runtime_error("Unexpected end of PLY data");
+            size += typeSize(property.countType) + count * typeSize(property.type);
+        } else {
+            size += typeSize(property.type);
+        }
+    }
+    return size;
+}
+
+void readVertices(const char* data, const PLYElement& element, bool swap, Shape& shape) {
+    const PLYProperty* x = element.find("x");
+    const PLYProperty* y = element.find("y");
+    const PLYProperty* z = element.find("z");
+    if (!x || !y || !z) throw std::runtime_error("PLY vertices have no position");
+    const PLYProperty* nx = element.find("nx");
+    const PLYProperty* ny = element.find("ny");
+    const PLYProperty* nz = element.find("nz");
+    bool hasNormals = nx && ny && nz;
+    const PLYProperty* red = element.find("red");
+    const PLYProperty* green = element.find("green");
+    const PLYProperty* blue = element.find("blue");
+    bool hasColors = red && green && blue;
+
+    shape.vertices.resize(element.count);
+    if (hasNormals) shape.normals.resize(element.count);
+    if (hasColors) shape.colors.resize(element.count);
+
+    size_t stride = element.rowSize;
+    parallelFor(element.count, kGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const char* row = data + i * stride;
+            shape.vertices[i] = {
+                readValue<float>(row + x->offset, x->type, swap),
+                readValue<float>(row + y->offset, y->type, swap),
+                readValue<float>(row + z->offset, z->type, swap)
+            };
+            if (hasNormals) {
+                shape.normals[i] = {
+                    readValue<float>(row + nx->offset, nx->type, swap),
+                    readValue<float>(row + ny->offset, ny->type, swap),
+                    readValue<float>(row + nz->offset, nz->type, swap)
+                };
+            }
+            if (hasColors) {
+                shape.colors[i] = {
+                    readColor(row + red->offset, red->type, swap),
+                    readColor(row + green->offset, green->type, swap),
+                    readColor(row + blue->offset, blue->type, swap)
+                };
+            }
+        }
+    });
+}
+
+// Decode a face's polygon into a fan of triangles at `out`, replacing out-of-range indices by a degenerate triangle
+inline void writeFan(const char* items, size_t count, PLYType type, bool swap, size_t vertexCount, uint32_t* out) {
+    size_t itemSize = typeSize(type);
+    auto first = readValue<uint32_t>(items, type, swap);
+    for (size_t k = 1; k + 1 < count; ++k) {
+        uint32_t triangle[3] = {
+            first,
+            readValue<uint32_t>(items + k * itemSize, type, swap),
+            readValue<uint32_t>(items + (k + 1) * itemSize, type, swap)
+        };
+        bool valid = triangle[0] < vertexCount && triangle[1] < vertexCount && triangle[2] < vertexCount;
+        for (int j = 0; j < 3; ++j) *out++ = valid ? triangle[j] : 0;
+    }
+}
+
+// Returns the byte size of the face element
+size_t readFaces(const char* data, const char* dataEnd, const PLYElement& element, bool swap, Shape& shape) {
+    const PLYProperty* indices = element.find("vertex_indices");
+    if (!indices) indices = element.find("vertex_index");
+    if (!indices || !indices->isList) throw std::runtime_error("PLY faces have no vertex_indices");
+
+    size_t vertexCount = shape.vertices.size();
+    size_t countSize = typeSize(indices->countType);
+    size_t indexSize = typeSize(indices->type);
+
+    // Byte size of the row without the index list (other properties must be fixed-size for the fast paths)
+    size_t otherSize = 0;
+    bool onlyListIsIndices = true;
+    for (const auto& property : element.properties) {
+        if (&property == indices) continue;
+        if (property.isList) onlyListIsIndices = false;
+        else otherSize += typeSize(property.type);
+    }
+    // The index list must be at a fixed offset for the fast paths, i.e. preceded only by scalars
+    size_t listOffset = indices->offset;
+    for (const auto& property : element.properties) {
+        if (&property == indices) break;
+        if (property.isList) onlyListIsIndices = false;
+    }
+
+    if (onlyListIsIndices) {
+        // Fast path: a pure triangle mesh has a fixed row size, check that every row really is a triangle
+        size_t triangleRow = otherSize + countSize + 3 * indexSize;
+        if (element.count <= static_cast<size_t>(dataEnd - data) / triangleRow) {
+            std::atomic<bool> allTriangles{true};
+            parallelFor(element.count, kGrain, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end && allTriangles; ++i) {
+                    if (readValue<size_t>(data + i * triangleRow + listOffset, indices->countType, swap) != 3) {
+                        allTriangles = false;
+                    }
+                }
+            });
+
+            if (allTriangles) {
+                shape.indices.resize(element.count * 3);
+                parallelFor(element.count, kGrain, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; ++i) {
+                        const char* items = data + i * triangleRow + listOffset + countSize;
+                        writeFan(items, 3, indices->type, swap, vertexCount, &shape.indices[3 * i]);
+                    }
+                });
+                return element.count * triangleRow;
+            }
+        }
+    }
+
+    // General path: one sequential scan for row offsets and triangle counts, then decode in parallel
+    std::vector<size_t> rowOffsets(element.count + 1);
+    std::vector<size_t> triangleOffsets(element.count + 1);
+    const char* row = data;
+    size_t triangles = 0;
+    for (size_t i = 0; i < element.count; ++i) {
+        if (row >= dataEnd) throw std::runtime_error("Unexpected end of PLY face data");
+        rowOffsets[i] = row - data;
+        triangleOffsets[i] = triangles;
+        size_t count = 0;
+        size_t size = 0;
+        for (const auto& property : element.properties) {
+            if (property.isList) {
+                size_t itemCount;
+                if (!readListCount(row + size, dataEnd, property, swap, itemCount)) {
+                    throw std::runtime_error("Unexpected end of PLY face data");
+                }
+                if (&property == indices) count = itemCount;
+                size += typeSize(property.countType) + itemCount * typeSize(property.type);
+            } else {
+                size += typeSize(property.type);
+            }
+        }
+        if (count >= 3) triangles += count - 2;
+        row += size;
+    }
+    if (row > dataEnd) throw std::runtime_error("Unexpected end of PLY face data");
+    rowOffsets[element.count] = row - data;
+    triangleOffsets[element.count] = triangles;
+
+    shape.indices.resize(triangles * 3);
+    parallelFor(element.count, kGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            size_t faceTriangles = triangleOffsets[i + 1] - triangleOffsets[i];
+            if (faceTriangles == 0) continue;
+            // Find the index list inside the row, which the scan found to end at the next one
+            const char* faceRow = data + rowOffsets[i];
+            const char* faceEnd = data + rowOffsets[i + 1];
+            size_t size = 0;
+            for (const auto& property : element.properties) {
+                if (property.isList) {
+                    size_t itemCount;
+                    if (!readListCount(faceRow + size, faceEnd, property, swap, itemCount)) {
+                        throw std::runtime_error("Unexpected end of PLY face data");
+                    }
+                    if (&property == indices) {
+                        writeFan(faceRow + size + countSize, itemCount, indices->type, swap, vertexCount,
+                                 &shape.indices[3 * triangleOffsets[i]]);
+                        break;
+                    }
+                    size += typeSize(property.countType) + itemCount * typeSize(property.type);
+                } else {
+                    size += typeSize(property.type);
+                }
+            }
+        }
+    });
+    return rowOffsets[element.count];
+}
+
+}
+
+bool readBinaryPLY(const std::string& path, Shape& shape, LoadProgress& progress) {
+    MappedFile file(path);
+    PLYHeader header = parseHeader(file, path);
+    if (!header.binary) return false;
+
+    bool swap = header.bigEndian == isHostLittleEndian();
+    const char* data = file.data() + header.dataOffset;
+    const char* dataEnd = file.data() + file.size();
+
+    bool hasVertices = false;
+    for (const auto& element : header.elements) {
+        progress.checkCancelled();
+        size_t size = 0;
+        if (element.name == "vertex") {
+            if (!element.fixedSize) throw std::runtime_error("PLY vertices with list properties are not supported");
+            size = element.count * element.rowSize;
+            if (size > static_cast<size_t>(dataEnd - data)) throw std::runtime_error("Unexpected end of PLY vertex data");
+            readVertices(data, element, swap, shape);
+            hasVertices = true;
+            progress.set(0.4f);
+        } else if (element.name == "face" && hasVertices) {
+            size = readFaces(data, dataEnd, element, swap, shape);
+            progress.set(0.8f);
+        } else if (element.fixedSize) {
+            size = element.count * element.rowSize;
+        } else {
+            for (size_t i = 0; i < element.count && data + size < dataEnd; ++i) {
+                size += rowSize(data + size, dataEnd, element, swap);
+            }
+        }
+        if (size > static_cast<size_t>(dataEnd - data)) throw std::runtime_error("Unexpected end of PLY data: " + path);
+        data += size;
+    }
+
+    return true;
+}
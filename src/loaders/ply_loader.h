@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+#include "viewer/scene.h"
+#include "utils/progress.hpp"
+
+// Memory-mapped reader for `binary_little_endian` / `binary_big_endian` PLY files.
+// Vertex positions (and normals and colors, if present) and triangulated face indices are decoded straight
+// from the mapping into the shape's arrays in parallel slices, without intermediate per-element storage.
+// Returns false without touching `shape` if the file is ASCII PLY, which the caller should read with happly.
+// Reports progress to `progress` and throws LoadCancelledError once it is cancelled.
+bool readBinaryPLY(const std::string& path, Shape& shape, LoadProgress& progress);
@@ -0,0 +1,314 @@
+#include "texture_cache.h"
+#include "utils/block_compress.h"
+#include "utils/file.h"
+#include "utils/hash.h"
+#include "utils/parallel.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+constexpr char kMagic[8] = {'T', 'R', 'T', 'E', 'X', '\0', '\0', '\0'};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kEndianMarker = 0x01020304;
+constexpr size_t kAlignment = 16;
+constexpr uintmax_t kDefaultMaxBytes = uintmax_t(2) << 30;     // 2GB
+constexpr size_t kRowGrain = 32;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianMarker;
+    uint64_t sourceSize;
+    int64_t sourceMTime;
+    uint64_t contentHash;
+    uint32_t compression;
+    uint32_t format;
+    uint32_t levelCount;        // Table of TextureLevel follows the source path
+    uint32_t pathLength;        // Source path follows the header
+    uint64_t dataOffset;        // Level offsets are relative to this
+};
+
+size_t align(size_t offset) {
+    return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+const char* compressionName(TEXTURE_COMPRESSION compression) {
+    switch (compression) {
+        case TEXTURE_COMPRESSION::BC1_BC3: return "bc";
+        case TEXTURE_COMPRESSION::BC7: return "bc7";
+        default: return "rgba";
+    }
+}
+
+const std::array<float, 256>& srgbToLinearTable() {
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> values{};
+        for (size_t i = 0; i < values.size(); ++i) {
+            float c = static_cast<float>(i) / 255.0f;
+            values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return values;
+    }();
+    return table;
+}
+
+uint8_t linearToSRGB(float linear) {
+    // 4096 steps keep the darkest sRGB codes distinct
+    static const std::array<uint8_t, 4096> table = [] {
+        std::array<uint8_t, 4096> values{};
+        for (size_t i = 0; i < values.size(); ++i) {
+            float c = static_cast<float>(i) / 4095.0f;
+            float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+            values[i] = static_cast<uint8_t>(std::lround(std::clamp(s, 0.0f, 1.0f) * 255.0f));
+        }
+        return values;
+    }();
+    return table[static_cast<size_t>(std::lround(std::clamp(linear, 0.0f, 1.0f) * 4095.0f))];
+}
+
+// Box-filter a linear RGBA float image to half size. Odd sizes average 3 texels at the last position.
+std::vector<float> downsample(const std::vector<float>& source, uint32_t width, uint32_t height, uint32_t nextWidth, uint32_t nextHeight) {
+    std::vector<float> next(size_t(nextWidth) * nextHeight * 4);
+    parallelFor(nextHeight, kRowGrain, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            size_t y0 = y * height / nextHeight, y1 = ((y + 1) * height + nextHeight - 1) / nextHeight;
+            for (size_t x = 0; x < nextWidth; ++x) {
+                size_t x0 = x * width / nextWidth, x1 = ((x + 1) * width + nextWidth - 1) / nextWidth;
+                float weighted[3] = {}, plain[3] = {}, alpha = 0.0f;
+                for (size_t sy = y0; sy < y1; ++sy) {
+                    for (size_t sx = x0; sx < x1; ++sx) {
+                        const float* texel = &source[(sy * width + sx) * 4];
+                        for (int c = 0; c < 3; ++c) {
+                            weighted[c] += texel[c] * texel[3];
+                            plain[c] += texel[c];
+                        }
+                        alpha += texel[3];
+                    }
+                }
+                // Alpha-weighted so the color of fully transparent texels doesn't bleed into visible ones
+                auto texelCount = static_cast<float>((x1 - x0) * (y1 - y0));
+                float* out = &next[(y * nextWidth + x) * 4];
+                for (int c = 0; c < 3; ++c) out[c] = alpha > 0.0f ? weighted[c] / alpha : plain[c] / texelCount;
+                out[3] = alpha / texelCount;
+            }
+        }
+    });
+    return next;
+}
+
+}
+
+size_t BakedTexture::byteSize() const {
+    size_t bytes = 0;
+    for (const auto& level : levels) bytes += level.size;
+    return bytes;
+}
+
+BakedTexture bakeTexture(const uint8_t* rgba, uint32_t width, uint32_t height, TEXTURE_COMPRESSION compression) {
+    BakedTexture texture;
+    size_t texelCount = size_t(width) * height;
+    bool hasAlpha = false;
+    for (size_t i = 0; i < texelCount && !hasAlpha; ++i) hasAlpha = rgba[4 * i + 3] != 255;
+
+    size_t blockBytes = 0;
+    void (*encodeBlock)(const uint8_t*, uint8_t*) = nullptr;
+    if (compression == TEXTURE_COMPRESSION::BC7) {
+        texture.format = TEXTURE_FORMAT::BC7;
+        blockBytes = 16;
+        encodeBlock = encodeBC7Block;
+    } else if (compression == TEXTURE_COMPRESSION::BC1_BC3) {
+        texture.format = hasAlpha ? TEXTURE_FORMAT::BC3 : TEXTURE_FORMAT::BC1;
+        blockBytes = hasAlpha ? 16 : 8;
+        encodeBlock = hasAlpha ? encodeBC3Block : encodeBC1Block;
+    }
+
+    auto addLevel = [&](const uint8_t* levelPixels, uint32_t levelWidth, uint32_t levelHeight) {
+        TextureLevel level{levelWidth, levelHeight, align(texture.pixels.size()), 0};
+        if (encodeBlock) {
+            std::vector<uint8_t> blocks = compressImage(levelPixels, levelWidth, levelHeight, blockBytes, encodeBlock);
+            level.size = blocks.size();
+            texture.pixels.resize(level.offset + level.size);
+            std::memcpy(texture.pixels.data() + level.offset, blocks.data(), blocks.size());
+        } else {
+            level.size = size_t(levelWidth) * levelHeight * 4;
+            texture.pixels.resize(level.offset + level.size);
+            std::memcpy(texture.pixels.data() + level.offset, levelPixels, level.size);
+        }
+        texture.levels.push_back(level);
+    };
+    addLevel(rgba, width, height);
+
+    // Later levels are filtered from a linear-light copy, carried in float between levels
+    const std::array<float, 256>& toLinear = srgbToLinearTable();
+    std::vector<float> linear(texelCount * 4);
+    parallelFor(texelCount, kRowGrain * 1024, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            for (int c = 0; c < 3; ++c) linear[4 * i + c] = toLinear[rgba[4 * i + c]];
+            linear[4 * i + 3] = rgba[4 * i + 3] / 255.0f;
+        }
+    });
+
+    std::vector<uint8_t> levelPixels;
+    while (width > 1 || height > 1) {
+        uint32_t nextWidth = std::max(1u, width / 2), nextHeight = std::max(1u, height / 2);
+        linear = downsample(linear, width, height, nextWidth, nextHeight);
+        width = nextWidth;
+        height = nextHeight;
+
+        levelPixels.resize(size_t(width) * height * 4);
+        parallelFor(size_t(width) * height, kRowGrain * 1024, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                for (int c = 0; c < 3; ++c) levelPixels[4 * i + c] = linearToSRGB(linear[4 * i + c]);
+                levelPixels[4 * i + 3] = static_cast<uint8_t>(std::lround(std::clamp(linear[4 * i + 3], 0.0f, 1.0f) * 255.0f));
+            }
+        });
+        addLevel(levelPixels.data(), width, height);
+    }
+    return texture;
+}
+
+TextureCache::TextureCache(std::filesystem::path directory, uintmax_t maxBytes)
+    : mDirectory(std::move(directory)), mMaxBytes(maxBytes) {}
+
+TextureCache& TextureCache::instance() {
+    static TextureCache cache(std::filesystem::path("cache") / "textures", kDefaultMaxBytes);
+    return cache;
+}
+
+std::filesystem::path TextureCache::entryPath(const std::string& sourcePath, TEXTURE_COMPRESSION compression) const {
+    std::string canonical = std::filesystem::weakly_canonical(sourcePath).string();
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(fnv1a(canonical.data(), canonical.size())));
+    return mDirectory / (std::string(name) + "." + compressionName(compression) + ".tex");
+}
+
+bool TextureCache::load(const std::string& sourcePath, TEXTURE_COMPRESSION compression, BakedTexture& texture) {
+    std::error_code error;
+    std::filesystem::path path = entryPath(sourcePath, compression);
+    if (!std::filesystem::exists(path, error)) return false;
+
+    try {
+        auto file = std::make_shared<MappedFile>(path.string());
+        if (file->size() < sizeof(FileHeader)) return false;
+        FileHeader header{};
+        std::memcpy(&header, file->data(), sizeof(header));
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+            header.endianMarker != kEndianMarker || header.compression != static_cast<uint32_t>(compression)) {
+            return false;
+        }
+
+        // Validate against the source: same path, size and mtime, then the sampled content hash
+        std::string canonical = std::filesystem::weakly_canonical(sourcePath).string();
+        if (header.pathLength > file->size() - sizeof(FileHeader) ||
+            std::string(file->data() + sizeof(FileHeader), header.pathLength) != canonical) {
+            return false;
+        }
+        if (header.sourceSize != std::filesystem::file_size(sourcePath) ||
+            header.sourceMTime != fileModificationTime(sourcePath)) {
+            return false;
+        }
+        if (header.contentHash != sampledContentHash(sourcePath)) return false;
+
+        size_t tableOffset = align(sizeof(FileHeader) + header.pathLength);
+        if (header.dataOffset > file->size() || tableOffset + uint64_t(header.levelCount) * sizeof(TextureLevel) > header.dataOffset) return false;
+        texture.levels.resize(header.levelCount);
+        std::memcpy(texture.levels.data(), file->data() + tableOffset, header.levelCount * sizeof(TextureLevel));
+        for (const auto& level : texture.levels) {
+            if (level.offset > file->size() - header.dataOffset || level.size > file->size() - header.dataOffset - level.offset) return false;
+        }
+        texture.format = static_cast<TEXTURE_FORMAT>(header.format);
+        texture.pixels.clear();
+        texture.mappedPixels = reinterpret_cast<const uint8_t*>(file->data() + header.dataOffset);
+        texture.file = std::move(file);
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to read texture cache entry: " << path.string() << std::endl << e.what() << std::endl;
+        return false;
+    }
+
+    // Mark as recently used for LRU eviction
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    return true;
+}
+
+void TextureCache::store(const std::string& sourcePath, TEXTURE_COMPRESSION compression, const BakedTexture& texture) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::error_code error;
+    std::filesystem::create_directories(mDirectory, error);
+
+    std::filesystem::path path = entryPath(sourcePath, compression);
+    std::filesystem::path tempPath = path;
+    tempPath += ".tmp";
+
+    try {
+        std::string canonical = std::filesystem::weakly_canonical(sourcePath).string();
+        FileHeader header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.endianMarker = kEndianMarker;
+        header.sourceSize = std::filesystem::file_size(sourcePath);
+        header.sourceMTime = fileModificationTime(sourcePath);
+        header.contentHash = sampledContentHash(sourcePath);
+        header.compression = static_cast<uint32_t>(compression);
+        header.format = static_cast<uint32_t>(texture.format);
+        header.levelCount = static_cast<uint32_t>(texture.levels.size());
+        header.pathLength = static_cast<uint32_t>(canonical.size());
+        size_t tableOffset = align(sizeof(FileHeader) + header.pathLength);
+        header.dataOffset = align(tableOffset + texture.levels.size() * sizeof(TextureLevel));
+
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("Failed to create " + tempPath.string());
+        auto padTo = [&out](size_t target) {
+            static const char zeros[kAlignment] = {};
+            auto current = static_cast<size_t>(out.tellp());
+            if (target > current) out.write(zeros, static_cast<std::streamsize>(target - current));
+        };
+        auto writeBytes = [&out](const void* data, size_t size) {
+            out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        };
+
+        writeBytes(&header, sizeof(header));
+        writeBytes(canonical.data(), canonical.size());
+        padTo(tableOffset);
+        writeBytes(texture.levels.data(), texture.levels.size() * sizeof(TextureLevel));
+        for (const auto& level : texture.levels) {
+            padTo(header.dataOffset + level.offset);
+            writeBytes(texture.data() + level.offset, level.size);
+        }
+        out.close();
+        if (!out) throw std::runtime_error("Failed to write " + tempPath.string());
+
+        // Readers only ever see complete entries
+        std::filesystem::rename(tempPath, path);
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to write texture cache entry: " << path.string() << std::endl << e.what() << std::endl;
+        std::filesystem::remove(tempPath, error);
+        return;
+    }
+
+    evict();
+}
+
+void TextureCache::evict() {
+    std::error_code error;
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> entries;
+    uintmax_t totalBytes = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(mDirectory, error)) {
+        if (entry.path().extension() != ".tex") continue;
+        totalBytes += entry.file_size(error);
+        entries.emplace_back(entry.last_write_time(error), entry.path());
+    }
+    if (totalBytes <= mMaxBytes) return;
+
+    // Oldest access first
+    std::sort(entries.begin(), entries.end());
+    for (const auto& [time, path] : entries) {
+        if (totalBytes <= mMaxBytes) break;
+        uintmax_t size = std::filesystem::file_size(path, error);
+        if (std::filesystem::remove(path, error)) totalBytes -= size;
+    }
+}
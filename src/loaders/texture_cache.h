@@ -0,0 +1,57 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "utils/enum.h"
+#include "utils/mapped_file.h"
+
+struct TextureLevel {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint64_t offset = 0;        // From `BakedTexture::data()`
+    uint64_t size = 0;
+};
+
+// A texture ready for upload: the full mip chain in its GPU format.
+// Pixel data is either owned or points into a memory-mapped cache entry.
+struct BakedTexture {
+    TEXTURE_FORMAT format = TEXTURE_FORMAT::RGBA8;
+    std::vector<TextureLevel> levels;       // Level 0 is the full-resolution image
+    std::vector<uint8_t> pixels;
+    std::shared_ptr<MappedFile> file;
+    const uint8_t* mappedPixels = nullptr;
+
+    [[nodiscard]] const uint8_t* data() const { return mappedPixels ? mappedPixels : pixels.data(); }
+    [[nodiscard]] size_t byteSize() const;
+};
+
+// Build the mip chain of an sRGB RGBA8 image, filtered in linear space (alpha-weighted, so fully transparent
+// texels don't bleed), then block-compress every level for `compression`. Rows and levels run in parallel.
+BakedTexture bakeTexture(const uint8_t* rgba, uint32_t width, uint32_t height, TEXTURE_COMPRESSION compression);
+
+// Persistent cache of baked textures, keyed by the image's path and the compression.
+// Entries are validated like MeshCache entries (size, mtime and a sampled content hash), memory-mapped on load
+// and uploaded straight from the mapping. The cache directory is capped in size, least recently used entries go first.
+class TextureCache {
+public:
+    TextureCache(std::filesystem::path directory, uintmax_t maxBytes);
+
+    // Shared cache in "cache/textures" under the working directory
+    static TextureCache& instance();
+
+    // Map the baked texture for `sourcePath`, returns false on a miss or a stale/corrupt entry
+    bool load(const std::string& sourcePath, TEXTURE_COMPRESSION compression, BakedTexture& texture);
+    // Write a baked texture, then evict old entries if the cache is over its size cap
+    void store(const std::string& sourcePath, TEXTURE_COMPRESSION compression, const BakedTexture& texture);
+
+private:
+    std::filesystem::path mDirectory;
+    uintmax_t mMaxBytes;
+    std::mutex mMutex;      // Serializes writes and eviction between concurrent bakes
+
+    [[nodiscard]] std::filesystem::path entryPath(const std::string& sourcePath, TEXTURE_COMPRESSION compression) const;
+    void evict();
+};
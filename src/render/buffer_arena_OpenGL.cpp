@@ -0,0 +1,213 @@
+#include "buffer_arena_OpenGL.h"
+#include <algorithm>
+
+OpenGLBufferArena::OpenGLBufferArena(size_t blockSize, size_t alignment)
+    : mBlockSize(blockSize), mAlignment(std::max<size_t>(alignment, 1)) {}
+
+OpenGLBufferArena::~OpenGLBufferArena() {
+    clear();
+}
+
+void OpenGLBufferArena::limitBlockSize(size_t bytes) {
+    mBlockSize = std::max(std::min(mBlockSize, bytes / mAlignment * mAlignment), mAlignment);
+}
+
+uint32_t OpenGLBufferArena::allocate(size_t size) {
+    size = std::max<size_t>((size + mAlignment - 1) / mAlignment * mAlignment, mAlignment);
+
+    // Best fit over all blocks, so large ranges stay available for large shapes
+    uint32_t blockIndex = kInvalidHandle;
+    std::multimap<size_t, size_t>::iterator best;
+    for (uint32_t b = 0; b < mBlocks.size(); ++b) {
+        auto it = mBlocks[b].freeBySize.lower_bound(size);
+        if (it != mBlocks[b].freeBySize.end() && (blockIndex == kInvalidHandle || it->first < best->first)) {
+            blockIndex = b;
+            best = it;
+        }
+    }
+    if (blockIndex == kInvalidHandle) {
+        blockIndex = createBlock(std::max(mBlockSize, size));
+        best = mBlocks[blockIndex].freeBySize.begin();
+    }
+
+    Block& block = mBlocks[blockIndex];
+    size_t offset = best->second;
+    takeFree(block, best, size);
+    block.used += size;
+
+    uint32_t handle;
+    if (!mFreeHandles.empty()) {
+        handle = mFreeHandles.back();
+        mFreeHandles.pop_back();
+    } else {
+        handle = static_cast<uint32_t>(mAllocations.size());
+        mAllocations.emplace_back();
+    }
+    mAllocations[handle] = {blockIndex, offset, size, true};
+    return handle;
+}
+
+void OpenGLBufferArena::free(uint32_t handle) {
+    if (handle >= mAllocations.size() || !mAllocations[handle].live) return;
+    Allocation& allocation = mAllocations[handle];
+    Block& block = mBlocks[allocation.block];
+    addFree(block, allocation.offset, allocation.size);
+    block.used -= allocation.size;
+    allocation.live = false;
+    mFreeHandles.push_back(handle);
+}
+
+void OpenGLBufferArena::upload(uint32_t handle, size_t offset, const void* data, size_t size) const {
+    if (size == 0) return;
+    const Allocation& allocation = mAllocations.at(handle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mBlocks[allocation.block].buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(allocation.offset + offset), static_cast<GLsizeiptr>(size), data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+OpenGLBufferArena::Range OpenGLBufferArena::getRange(uint32_t handle) const {
+    if (handle >= mAllocations.size() || !mAllocations[handle].live) return {};
+    const Allocation& allocation = mAllocations[handle];
+    return {mBlocks[allocation.block].buffer, allocation.offset, allocation.size};
+}
+
+bool OpenGLBufferArena::defragment(float maxFragmentation) {
+    bool changed = false;
+    size_t movedBytes = 0;
+    for (uint32_t b = 0; b < mBlocks.size(); ++b) {
+        const Block& block = mBlocks[b];
+        if (block.used == 0) continue;
+        size_t holes = block.capacity - block.used - largestFree(block);
+        if (static_cast<float>(holes) > maxFragmentation * static_cast<float>(block.capacity)) {
+            movedBytes += block.used;
+            compact(b);
+            changed = true;
+        }
+    }
+
+    // Delete empty blocks, the allocations of later blocks shift down
+    std::vector<uint32_t> remap(mBlocks.size());
+    uint32_t kept = 0;
+    for (uint32_t b = 0; b < mBlocks.size(); ++b) {
+        if (mBlocks[b].used == 0) {
+            glDeleteBuffers(1, &mBlocks[b].buffer);
+            changed = true;
+            continue;
+        }
+        remap[b] = kept;
+        if (kept != b) mBlocks[kept] = std::move(mBlocks[b]);
+        kept++;
+    }
+    mBlocks.resize(kept);
+    for (Allocation& allocation : mAllocations) {
+        if (allocation.live) allocation.block = remap[allocation.block];
+    }
+    mMovedBytes += movedBytes;
+    return changed;
+}
+
+OpenGLBufferArena::Stats OpenGLBufferArena::getStats() const {
+    Stats stats;
+    stats.blocks = mBlocks.size();
+    for (const Block& block : mBlocks) {
+        stats.capacity += block.capacity;
+        stats.used += block.used;
+        stats.largestFree = std::max(stats.largestFree, largestFree(block));
+    }
+    stats.allocations = mAllocations.size() - mFreeHandles.size();
+    stats.moved = mMovedBytes;
+    return stats;
+}
+
+void OpenGLBufferArena::clear() {
+    for (Block& block : mBlocks) glDeleteBuffers(1, &block.buffer);
+    mBlocks.clear();
+    mAllocations.clear();
+    mFreeHandles.clear();
+}
+
+uint32_t OpenGLBufferArena::createBlock(size_t capacity) {
+    Block block;
+    block.capacity = capacity;
+    glGenBuffers(1, &block.buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, block.buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(capacity), nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    addFree(block, 0, capacity);
+    mBlocks.push_back(std::move(block));
+    return static_cast<uint32_t>(mBlocks.size() - 1);
+}
+
+void OpenGLBufferArena::addFree(Block& block, size_t offset, size_t size) {
+    auto eraseBySize = [&](size_t rangeOffset, size_t rangeSize) {
+        auto range = block.freeBySize.equal_range(rangeSize);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == rangeOffset) { block.freeBySize.erase(it); break; }
+        }
+    };
+
+    // Merge with the free ranges right after and right before
+    auto next = block.freeByOffset.lower_bound(offset);
+    if (next != block.freeByOffset.end() && offset + size == next->first) {
+        size += next->second;
+        eraseBySize(next->first, next->second);
+        next = block.freeByOffset.erase(next);
+    }
+    if (next != block.freeByOffset.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            offset = previous->first;
+            size += previous->second;
+            eraseBySize(previous->first, previous->second);
+            block.freeByOffset.erase(previous);
+        }
+    }
+    block.freeByOffset[offset] = size;
+    block.freeBySize.emplace(size, offset);
+}
+
+void OpenGLBufferArena::takeFree(Block& block, std::multimap<size_t, size_t>::iterator range, size_t size) {
+    size_t offset = range->second;
+    size_t remaining = range->first - size;
+    block.freeBySize.erase(range);
+    block.freeByOffset.erase(offset);
+    if (remaining > 0) {
+        block.freeByOffset[offset + size] = remaining;
+        block.freeBySize.emplace(remaining, offset + size);
+    }
+}
+
+size_t OpenGLBufferArena::largestFree(const Block& block) {
+    return block.freeBySize.empty() ? 0 : block.freeBySize.rbegin()->first;
+}
+
+void OpenGLBufferArena::compact(uint32_t blockIndex) {
+    Block& block = mBlocks[blockIndex];
+    std::vector<Allocation*> allocations;
+    for (Allocation& allocation : mAllocations) {
+        if (allocation.live && allocation.block == blockIndex) allocations.push_back(&allocation);
+    }
+    std::sort(allocations.begin(), allocations.end(), [](const Allocation* a, const Allocation* b) { return a->offset < b->offset; });
+
+    // Copy into a fresh buffer, ranges of one buffer may not overlap in glCopyBufferSubData
+    GLuint packed;
+    glGenBuffers(1, &packed);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, packed);
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(block.capacity), nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, block.buffer);
+    size_t offset = 0;
+    for (Allocation* allocation : allocations) {
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(allocation->offset),
+                            static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(allocation->size));
+        allocation->offset = offset;
+        offset += allocation->size;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &block.buffer);
+
+    block.buffer = packed;
+    block.freeByOffset.clear();
+    block.freeBySize.clear();
+    if (offset < block.capacity) addFree(block, offset, block.capacity - offset);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Suballocates ranges of a few large GL buffers, so shapes don't each need buffer objects of their own.
+//
+// Each block keeps its free ranges twice: by offset, to merge neighbours when a range is freed, and by size,
+// for a best-fit search. Requests larger than a block get a block of their own. Freed space is reused as is;
+// `defragment` packs blocks whose free space is mostly scattered in holes and deletes empty ones, which moves
+// ranges, so owners must look their ranges up again afterwards.
+// All methods must be called from the thread owning the GL context.
+class OpenGLBufferArena {
+public:
+    static constexpr uint32_t kInvalidHandle = ~uint32_t(0);
+
+    struct Range {
+        GLuint buffer = 0;
+        size_t offset = 0;      // In bytes, a multiple of the alignment
+        size_t size = 0;
+    };
+
+    struct Stats {
+        size_t blocks = 0;
+        size_t capacity = 0;    // Bytes of all blocks
+        size_t used = 0;        // Bytes allocated, alignment included
+        size_t allocations = 0;
+        size_t largestFree = 0;
+        size_t moved = 0;       // Bytes copied by `defragment` so far
+    };
+
+    explicit OpenGLBufferArena(size_t blockSize = size_t(64) << 20, size_t alignment = 16);
+    ~OpenGLBufferArena();
+    OpenGLBufferArena(const OpenGLBufferArena&) = delete;
+    OpenGLBufferArena& operator=(const OpenGLBufferArena&) = delete;
+
+    // Blocks created from now on hold at most `bytes`, requests above that still get a block of their own
+    void limitBlockSize(size_t bytes);
+    // Reserve `size` bytes, contents undefined until uploaded
+    uint32_t allocate(size_t size);
+    void free(uint32_t handle);
+    // Write `size` bytes at `offset` into an allocation
+    void upload(uint32_t handle, size_t offset, const void* data, size_t size) const;
+    [[nodiscard]] Range getRange(uint32_t handle) const;
+
+    // Pack blocks whose holes (free space apart from their largest free range) exceed `maxFragmentation` of
+    // their capacity, and delete empty blocks. True if any range moved or any block went away.
+    bool defragment(float maxFragmentation = 0.25f);
+    [[nodiscard]] Stats getStats() const;
+    // Delete every block, handles become invalid
+    void clear();
+
+private:
+    struct Block {
+        GLuint buffer = 0;
+        size_t capacity = 0;
+        size_t used = 0;
+        std::map<size_t, size_t> freeByOffset;          // Offset -> size
+        std::multimap<size_t, size_t> freeBySize;       // Size -> offset
+    };
+
+    struct Allocation {
+        uint32_t block = 0;
+        size_t offset = 0;
+        size_t size = 0;
+        bool live = false;
+    };
+
+    size_t mBlockSize;
+    size_t mAlignment;
+    size_t mMovedBytes = 0;
+    std::vector<Block> mBlocks;
+    std::vector<Allocation> mAllocations;   // By handle
+    std::vector<uint32_t> mFreeHandles;
+
+    uint32_t createBlock(size_t capacity);
+    static void addFree(Block& block, size_t offset, size_t size);
+    static void takeFree(Block& block, std::multimap<size_t, size_t>::iterator range, size_t size);
+    [[nodiscard]] static size_t largestFree(const Block& block);
+    void compact(uint32_t block);
+};
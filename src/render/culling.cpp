@@ -0,0 +1,106 @@
+#include "culling.h"
+#include "utils/parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULLING_SSE2
+#endif
+
+void CullBounds::resize(size_t size) {
+    count = size;
+    size_t padded = (size + 3) / 4 * 4;
+    for (auto* array : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ, &radius }) array->assign(padded, 0.0f);
+}
+
+void CullBounds::set(size_t i, const glm::vec3& center, const glm::vec3& extent, float sphereRadius) {
+    centerX[i] = center.x;
+    centerY[i] = center.y;
+    centerZ[i] = center.z;
+    extentX[i] = extent.x;
+    extentY[i] = extent.y;
+    extentZ[i] = extent.z;
+    radius[i] = sphereRadius;
+}
+
+std::array<glm::vec4, 6> extractFrustumPlanes(const glm::mat4& viewProjection) {
+    // Sums and differences of the w row with the x, y and z rows
+    std::array<glm::vec4, 6> planes;
+    glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+    for (int k = 0; k < 3; ++k) {
+        glm::vec4 row(viewProjection[0][k], viewProjection[1][k], viewProjection[2][k], viewProjection[3][k]);
+        planes[2 * k] = w + row;
+        planes[2 * k + 1] = w - row;
+    }
+    for (auto& plane : planes) plane /= glm::length(glm::vec3(plane));
+    return planes;
+}
+
+void transformBox(const glm::mat4& matrix, const glm::vec3& center, const glm::vec3& extent,
+                  glm::vec3& worldCenter, glm::vec3& worldExtent) {
+    worldCenter = glm::vec3(matrix * glm::vec4(center, 1.0f));
+    // Each world axis spans the absolute projections of the box axes
+    worldExtent = glm::abs(glm::vec3(matrix[0])) * extent.x + glm::abs(glm::vec3(matrix[1])) * extent.y +
+                  glm::abs(glm::vec3(matrix[2])) * extent.z;
+}
+
+namespace {
+
+// A shape is outside once its center lies farther behind one plane than the smaller of its two bounds reaches
+void cullRange(const CullBounds& bounds, const std::array<glm::vec4, 6>& planes, size_t begin, size_t end, uint8_t* visible) {
+#ifdef CULLING_SSE2
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    for (size_t i = begin; i < end; i += 4) {
+        __m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+        __m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+        __m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&bounds.extentX[i]);
+        __m128 ey = _mm_loadu_ps(&bounds.extentY[i]);
+        __m128 ez = _mm_loadu_ps(&bounds.extentZ[i]);
+        __m128 r = _mm_loadu_ps(&bounds.radius[i]);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const glm::vec4& plane : planes) {
+            __m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, nx), _mm_mul_ps(cy, ny)),
+                                         _mm_add_ps(_mm_mul_ps(cz, nz), _mm_set1_ps(plane.w)));
+            __m128 boxReach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_andnot_ps(signMask, nx)), _mm_mul_ps(ey, _mm_andnot_ps(signMask, ny))),
+                                         _mm_mul_ps(ez, _mm_andnot_ps(signMask, nz)));
+            __m128 reach = _mm_min_ps(boxReach, r);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+        }
+        int mask = _mm_movemask_ps(inside);
+        size_t lanes = std::min<size_t>(4, end - i);
+        for (size_t lane = 0; lane < lanes; ++lane) visible[i + lane] = (mask >> lane) & 1;
+    }
+#else
+    for (size_t i = begin; i < end; ++i) {
+        bool inside = true;
+        for (const glm::vec4& plane : planes) {
+            float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+            float boxReach = std::abs(plane.x) * bounds.extentX[i] + std::abs(plane.y) * bounds.extentY[i] + std::abs(plane.z) * bounds.extentZ[i];
+            inside = inside && distance + std::min(boxReach, bounds.radius[i]) >= 0.0f;
+        }
+        visible[i] = inside;
+    }
+#endif
+}
+
+}
+
+size_t cullFrustum(const CullBounds& bounds, const std::array<glm::vec4, 6>& planes, std::vector<uint8_t>& visible) {
+    // Ranges handed to threads start on a multiple of 4
+    constexpr size_t kGrain = 4096;
+    visible.resize(bounds.count);
+    size_t groups = (bounds.count + 3) / 4;
+    std::atomic<size_t> visibleCount{0};
+    parallelFor(groups, kGrain / 4, [&](size_t begin, size_t end) {
+        size_t first = begin * 4, last = std::min(end * 4, bounds.count);
+        cullRange(bounds, planes, first, last, visible.data());
+        size_t count = 0;
+        for (size_t i = first; i < last; ++i) count += visible[i];
+        visibleCount += count;
+    });
+    return visibleCount;
+}
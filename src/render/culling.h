@@ -0,0 +1,30 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// World-space bounds of many shapes as structure of arrays: an AABB (center and half extent) and the radius of a
+// sphere around the same center. Arrays are padded to a multiple of 4 so the kernel always reads whole lanes.
+struct CullBounds {
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+    std::vector<float> radius;
+    size_t count = 0;
+
+    void resize(size_t size);
+    void set(size_t i, const glm::vec3& center, const glm::vec3& extent, float sphereRadius);
+};
+
+// Planes of the frustum of `viewProjection` (left, right, bottom, top, near, far), normalized, pointing inwards
+std::array<glm::vec4, 6> extractFrustumPlanes(const glm::mat4& viewProjection);
+
+// Bounds of a model-space box (center and half extent) under `matrix`
+void transformBox(const glm::mat4& matrix, const glm::vec3& center, const glm::vec3& extent,
+                  glm::vec3& worldCenter, glm::vec3& worldExtent);
+
+// visible[i] = 1 if both the box and the sphere of shape i reach into the frustum. Four shapes per SIMD step,
+// large counts are split across threads. Returns the number of visible shapes.
+size_t cullFrustum(const CullBounds& bounds, const std::array<glm::vec4, 6>& planes, std::vector<uint8_t>& visible);
@@ -0,0 +1,298 @@
+#include "occlusion.h"
+#include "utils/parallel.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_SSE2
+#endif
+
+namespace {
+
+// Occluder vertices closer than this (clip w) are not clipped, their triangles are dropped, which only loses occlusion
+constexpr float kNearW = 1e-4f;
+constexpr int kBandRows = 16;
+
+// Edge function a * x + b * y + c, not negative inside
+struct Edge {
+    float a, b, c;
+};
+
+// Edge from vertex k to k + 1 of a counter-clockwise triangle. With `inset`, moved in by half a texel, so it
+// passes a texel center only when the whole texel is inside.
+Edge edgeFunction(const float* x, const float* y, int k, bool inset) {
+    int n = (k + 1) % 3;
+    Edge edge{y[k] - y[n], x[n] - x[k], x[k] * y[n] - y[k] * x[n]};
+    if (inset) edge.c -= 0.5f * (std::abs(edge.a) + std::abs(edge.b));
+    return edge;
+}
+
+}
+
+OcclusionBuffer::OcclusionBuffer(int width, int height)
+    : mWidth(std::max((width + 3) / 4 * 4, 4)), mHeight(std::max(height, 1)) {
+    glm::ivec2 size(mWidth, mHeight);
+    while (true) {
+        mLevelSizes.push_back(size);
+        mLevels.emplace_back(static_cast<size_t>(size.x) * size.y, 1.0f);
+        if (size.x == 1 && size.y == 1) break;
+        size = glm::ivec2((size.x + 1) / 2, (size.y + 1) / 2);
+    }
+}
+
+void OcclusionBuffer::begin(const glm::mat4& viewProjection) {
+    mViewProjection = viewProjection;
+    mTriangles.clear();
+    std::fill(mLevels[0].begin(), mLevels[0].end(), 1.0f);
+}
+
+void OcclusionBuffer::addOccluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, size_t first,
+                                  size_t count, const glm::mat4& modelMatrix) {
+    glm::mat4 mvp = mViewProjection * modelMatrix;
+    auto width = static_cast<float>(mWidth), height = static_cast<float>(mHeight);
+    // The occluder continues past an edge shared by exactly two triangles that run it in opposite directions,
+    // they lie on both sides of it on screen. Anything else is an outline. Edges meet in an open addressing table
+    // keyed by their vertex pair: the second edge of a pair links the two triangles, a third one unlinks them.
+    // Inner edges come twice, so the table stays at most half full.
+    size_t tableSize = 16;
+    while (tableSize < count) tableSize *= 2;
+    mEdgeTable.assign(tableSize, EdgeSlot{});
+    auto triangleOf = [](uint32_t edge) { return static_cast<int>((edge >> 1) / 3); };
+    auto link = [&](uint32_t edge, int neighbor) { mTriangles[(edge >> 1) / 3].neighbors[(edge >> 1) % 3] = neighbor; };
+
+    for (size_t t = first; t + 2 < first + count; t += 3) {
+        uint32_t vertices[3] = { indices[t], indices[t + 1], indices[t + 2] };
+        glm::vec3 screen[3];
+        bool clipped = false;
+        for (int k = 0; k < 3; ++k) {
+            glm::vec4 clip = mvp * glm::vec4(positions[vertices[k]], 1.0f);
+            if (clip.w < kNearW) { clipped = true; break; }
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            screen[k] = glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+        }
+        if (clipped) continue;
+
+        float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+        if (std::abs(area) < 1e-8f) continue;
+        if (area < 0.0f) {
+            std::swap(screen[1], screen[2]);
+            std::swap(vertices[1], vertices[2]);
+            area = -area;
+        }
+
+        Triangle triangle;
+        for (int k = 0; k < 3; ++k) {
+            triangle.x[k] = screen[k].x;
+            triangle.y[k] = screen[k].y;
+        }
+        float minX = std::min({screen[0].x, screen[1].x, screen[2].x}), maxX = std::max({screen[0].x, screen[1].x, screen[2].x});
+        float minY = std::min({screen[0].y, screen[1].y, screen[2].y}), maxY = std::max({screen[0].y, screen[1].y, screen[2].y});
+        triangle.minX = std::max(static_cast<int>(std::floor(minX)), 0);
+        triangle.maxX = std::min(static_cast<int>(std::ceil(maxX)), mWidth - 1);
+        triangle.minY = std::max(static_cast<int>(std::floor(minY)), 0);
+        triangle.maxY = std::min(static_cast<int>(std::ceil(maxY)), mHeight - 1);
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) continue;
+
+        // z / w is affine in screen space
+        glm::vec3 e1 = screen[1] - screen[0], e2 = screen[2] - screen[0];
+        triangle.dzdx = (e1.z * e2.y - e2.z * e1.y) / area;
+        triangle.dzdy = (e2.z * e1.x - e1.z * e2.x) / area;
+        triangle.z0 = screen[0].z - triangle.dzdx * screen[0].x - triangle.dzdy * screen[0].y;
+        for (int& neighbor : triangle.neighbors) neighbor = -1;
+        mTriangles.push_back(triangle);
+
+        for (int k = 0; k < 3; ++k) {
+            uint32_t a = vertices[k], b = vertices[(k + 1) % 3];
+            uint64_t key = static_cast<uint64_t>(std::min(a, b)) << 32 | std::max(a, b);
+            auto edge = static_cast<uint32_t>((mTriangles.size() - 1) * 3 + k) << 1 | (a < b ? 1u : 0u);
+            size_t slot = static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & (tableSize - 1);
+            while (mEdgeTable[slot].count > 0 && mEdgeTable[slot].key != key) slot = (slot + 1) & (tableSize - 1);
+            EdgeSlot& entry = mEdgeTable[slot];
+            bool linked = entry.count == 2 && (entry.first & 1) != (entry.second & 1);
+            if (entry.count == 0) {
+                entry.key = key;
+                entry.first = edge;
+            } else if (entry.count == 1) {
+                entry.second = edge;
+                if ((entry.first & 1) != (edge & 1)) {
+                    link(entry.first, triangleOf(edge));
+                    link(edge, triangleOf(entry.first));
+                }
+            } else if (linked) {
+                link(entry.first, -1);
+                link(entry.second, -1);
+            }
+            if (entry.count < 3) entry.count++;
+        }
+    }
+
+}
+
+void OcclusionBuffer::rasterize() {
+    // Each band of rows belongs to one thread, so no two threads write the same pixel
+    int bands = (mHeight + kBandRows - 1) / kBandRows;
+    parallelTasks(static_cast<size_t>(bands), [&](size_t band) {
+        int firstRow = static_cast<int>(band) * kBandRows, lastRow = std::min(firstRow + kBandRows, mHeight) - 1;
+        for (const Triangle& triangle : mTriangles) {
+            if (triangle.maxY < firstRow || triangle.minY > lastRow) continue;
+            rasterizeRows(triangle, std::max(firstRow, triangle.minY), std::min(lastRow, triangle.maxY));
+        }
+    });
+
+    for (size_t level = 1; level < mLevels.size(); ++level) {
+        const std::vector<float>& fine = mLevels[level - 1];
+        std::vector<float>& coarse = mLevels[level];
+        glm::ivec2 fineSize = mLevelSizes[level - 1], size = mLevelSizes[level];
+        for (int y = 0; y < size.y; ++y) {
+            int y0 = 2 * y, y1 = std::min(2 * y + 1, fineSize.y - 1);
+            for (int x = 0; x < size.x; ++x) {
+                int x0 = 2 * x, x1 = std::min(2 * x + 1, fineSize.x - 1);
+                coarse[y * size.x + x] = std::max({fine[y0 * fineSize.x + x0], fine[y0 * fineSize.x + x1],
+                                                   fine[y1 * fineSize.x + x0], fine[y1 * fineSize.x + x1]});
+            }
+        }
+    }
+}
+
+void OcclusionBuffer::rasterizeRows(const Triangle& triangle, int firstRow, int lastRow) {
+    // Edge k runs from vertex k to vertex k + 1. Outline edges are inset by half a texel. Inner edges are tested
+    // at the texel center, so the triangles on both sides leave no crack; a texel straddling one must also lie
+    // inside the other two edges of the triangle across it, and takes the farther depth of both. Texels straddling
+    // two inner edges are left out, the triangles around their vertex aren't known here.
+    auto self = static_cast<int>(&triangle - mTriangles.data());
+    Edge edges[3];
+    float straddle[3];                  // How far inside an inner edge a texel center must be to not straddle it
+    int inner[3], innerCount = 0;
+    Edge across[3][2];                  // Other edges of the triangle across each inner edge
+    float acrossZ0[3], acrossDzdx[3], acrossDzdy[3];
+    for (int k = 0; k < 3; ++k) {
+        edges[k] = edgeFunction(triangle.x, triangle.y, k, triangle.neighbors[k] < 0);
+        straddle[k] = 0.5f * (std::abs(edges[k].a) + std::abs(edges[k].b));
+        if (triangle.neighbors[k] < 0) continue;
+        const Triangle& neighbor = mTriangles[static_cast<size_t>(triangle.neighbors[k])];
+        int other = 0;
+        for (int j = 0; j < 3; ++j) {
+            if (neighbor.neighbors[j] == self || other == 2) continue;
+            across[innerCount][other++] = edgeFunction(neighbor.x, neighbor.y, j, true);
+        }
+        while (other < 2) across[innerCount][other++] = Edge{0.0f, 0.0f, 0.0f};
+        acrossZ0[innerCount] = neighbor.z0 + 0.5f * (std::abs(neighbor.dzdx) + std::abs(neighbor.dzdy));
+        acrossDzdx[innerCount] = neighbor.dzdx;
+        acrossDzdy[innerCount] = neighbor.dzdy;
+        inner[innerCount++] = k;
+    }
+    // Farthest depth of the plane within the texel around (px, py)
+    float farthest = triangle.z0 + 0.5f * (std::abs(triangle.dzdx) + std::abs(triangle.dzdy));
+    float* depth = mLevels[0].data();
+    int startX = triangle.minX & ~3;
+
+    for (int y = firstRow; y <= lastRow; ++y) {
+        float py = static_cast<float>(y) + 0.5f;
+        float* row = depth + static_cast<size_t>(y) * mWidth;
+#ifdef OCCLUSION_SSE2
+        const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 zero = _mm_setzero_ps();
+        __m128 a[3], rowValue[3], acrossA[3][2], acrossRow[3][2], acrossDepth[3], acrossSlope[3];
+        for (int k = 0; k < 3; ++k) {
+            a[k] = _mm_set1_ps(edges[k].a);
+            rowValue[k] = _mm_set1_ps(edges[k].b * py + edges[k].c);
+        }
+        for (int i = 0; i < innerCount; ++i) {
+            for (int j = 0; j < 2; ++j) {
+                acrossA[i][j] = _mm_set1_ps(across[i][j].a);
+                acrossRow[i][j] = _mm_set1_ps(across[i][j].b * py + across[i][j].c);
+            }
+            acrossDepth[i] = _mm_set1_ps(acrossZ0[i] + acrossDzdy[i] * py);
+            acrossSlope[i] = _mm_set1_ps(acrossDzdx[i]);
+        }
+        __m128 dzdx = _mm_set1_ps(triangle.dzdx), rowDepth = _mm_set1_ps(farthest + triangle.dzdy * py);
+        for (int x = startX; x <= triangle.maxX; x += 4) {
+            __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+            __m128 value[3];
+            for (int k = 0; k < 3; ++k) value[k] = _mm_add_ps(_mm_mul_ps(a[k], px), rowValue[k]);
+            __m128 inside = _mm_cmpge_ps(value[0], zero);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(value[1], zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(value[2], zero));
+            if (_mm_movemask_ps(inside) == 0) continue;
+            __m128 z = _mm_add_ps(rowDepth, _mm_mul_ps(dzdx, px));
+            __m128 straddling = zero;
+            for (int i = 0; i < innerCount; ++i) {
+                int k = inner[i];
+                __m128 crosses = _mm_cmplt_ps(value[k], _mm_set1_ps(straddle[k]));
+                if (_mm_movemask_ps(crosses) == 0) continue;
+                __m128 covered = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(acrossA[i][0], px), acrossRow[i][0]), zero);
+                covered = _mm_and_ps(covered, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(acrossA[i][1], px), acrossRow[i][1]), zero));
+                inside = _mm_andnot_ps(_mm_or_ps(_mm_andnot_ps(covered, crosses), _mm_and_ps(crosses, straddling)), inside);
+                straddling = _mm_or_ps(straddling, crosses);
+                __m128 acrossZ = _mm_add_ps(acrossDepth[i], _mm_mul_ps(acrossSlope[i], px));
+                z = _mm_or_ps(_mm_and_ps(crosses, _mm_max_ps(z, acrossZ)), _mm_andnot_ps(crosses, z));
+            }
+            __m128 old = _mm_loadu_ps(row + x);
+            __m128 nearest = _mm_min_ps(old, z);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+        }
+#else
+        for (int x = triangle.minX; x <= triangle.maxX; ++x) {
+            float px = static_cast<float>(x) + 0.5f;
+            float value[3];
+            bool inside = true;
+            for (int k = 0; k < 3; ++k) {
+                value[k] = edges[k].a * px + edges[k].b * py + edges[k].c;
+                inside = inside && value[k] >= 0.0f;
+            }
+            if (!inside) continue;
+            float z = farthest + triangle.dzdx * px + triangle.dzdy * py;
+            bool straddling = false;
+            for (int i = 0; i < innerCount && inside; ++i) {
+                int k = inner[i];
+                if (value[k] >= straddle[k]) continue;
+                for (const Edge& edge : across[i]) inside = inside && edge.a * px + edge.b * py + edge.c >= 0.0f;
+                inside = inside && !straddling;
+                straddling = true;
+                z = std::max(z, acrossZ0[i] + acrossDzdx[i] * px + acrossDzdy[i] * py);
+            }
+            if (inside) row[x] = std::min(row[x], z);
+        }
+#endif
+    }
+}
+
+bool OcclusionBuffer::isVisible(const glm::vec3& center, const glm::vec3& extent) const {
+    // Screen rectangle and nearest depth of the 8 corners
+    float minX = 1e30f, maxX = -1e30f, minY = 1e30f, maxY = -1e30f, minZ = 1e30f;
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec3 sign((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f);
+        glm::vec4 clip = mViewProjection * glm::vec4(center + sign * extent, 1.0f);
+        if (clip.w < kNearW) return true;       // Crosses the camera plane
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        minX = std::min(minX, ndc.x);
+        maxX = std::max(maxX, ndc.x);
+        minY = std::min(minY, ndc.y);
+        maxY = std::max(maxY, ndc.y);
+        minZ = std::min(minZ, ndc.z);
+    }
+    minZ = minZ * 0.5f + 0.5f;
+    if (minZ <= 0.0f) return true;
+
+    int x0 = std::max(static_cast<int>(std::floor((minX * 0.5f + 0.5f) * mWidth)), 0);
+    int x1 = std::min(static_cast<int>(std::floor((maxX * 0.5f + 0.5f) * mWidth)), mWidth - 1);
+    int y0 = std::max(static_cast<int>(std::floor((minY * 0.5f + 0.5f) * mHeight)), 0);
+    int y1 = std::min(static_cast<int>(std::floor((maxY * 0.5f + 0.5f) * mHeight)), mHeight - 1);
+    if (x0 > x1 || y0 > y1) return true;        // Off screen, frustum culling decides
+
+    // Coarsest level first where the rectangle spans at most 4x4 texels
+    size_t level = 0;
+    while (level + 1 < mLevels.size() && (x1 - x0 >= 4 || y1 - y0 >= 4)) {
+        x0 >>= 1; x1 >>= 1; y0 >>= 1; y1 >>= 1;
+        level++;
+    }
+    const std::vector<float>& depth = mLevels[level];
+    int width = mLevelSizes[level].x;
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            if (minZ <= depth[y * width + x]) return true;
+        }
+    }
+    return false;
+}
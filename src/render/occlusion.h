@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Low-resolution CPU depth buffer for occlusion culling.
+//
+// A few large occluders are rasterized each frame (nearest depth wins, depth in [0, 1] like the default
+// glDepthRange), then reduced into a pyramid holding the farthest depth of every 2x2 block. Rasterization is
+// conservative: a texel only takes an occluder's depth when the occluder covers all of it, and then its farthest
+// depth in the texel. A box is hidden when its nearest point lies behind the farthest occluder depth everywhere
+// it covers; the test reads the pyramid level where the box spans a handful of texels. Everything runs on the
+// CPU, rows of the buffer are rasterized in bands across threads, four pixels per SIMD step.
+class OcclusionBuffer {
+public:
+    explicit OcclusionBuffer(int width = 256, int height = 128);
+
+    // Clear to the far plane and drop last frame's occluders
+    void begin(const glm::mat4& viewProjection);
+    // Queue triangles of a model-space mesh, `indices[first, first + count)`. Triangles sharing an edge by vertex
+    // indices are rasterized as one surface, edges on split vertices count as outlines.
+    void addOccluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, size_t first, size_t count,
+                     const glm::mat4& modelMatrix);
+    // Rasterize the queued triangles and build the pyramid
+    void rasterize();
+    // False only if the world-space box (center and half extent) is certainly hidden behind the occluders
+    [[nodiscard]] bool isVisible(const glm::vec3& center, const glm::vec3& extent) const;
+
+    [[nodiscard]] int getWidth() const { return mWidth; }
+    [[nodiscard]] int getHeight() const { return mHeight; }
+    [[nodiscard]] size_t getTriangleCount() const { return mTriangles.size(); }
+
+private:
+    // Screen-space triangle, counter-clockwise, with its depth plane
+    struct Triangle {
+        float x[3], y[3];
+        float z0, dzdx, dzdy;       // Depth at (0, 0) and its gradients
+        int minX, maxX, minY, maxY; // Pixel bounds, clamped to the buffer
+        int neighbors[3];           // Triangle across edge k when the occluder continues past it, else -1
+    };
+
+    int mWidth, mHeight;            // Width is a multiple of 4
+    glm::mat4 mViewProjection = glm::mat4(1.0f);
+    std::vector<Triangle> mTriangles;
+    std::vector<std::vector<float>> mLevels;    // Level 0 is the depth buffer
+    std::vector<glm::ivec2> mLevelSizes;
+    // Scratch of addOccluder to find the triangles across edges
+    struct EdgeSlot {
+        uint64_t key = 0;           // Vertex indices, lower one in the high half
+        uint32_t first = 0, second = 0;    // (Triangle * 3 + edge) << 1 | direction
+        uint32_t count = 0;         // Edges with this key, up to 3
+    };
+    std::vector<EdgeSlot> mEdgeTable;
+
+    void rasterizeRows(const Triangle& triangle, int firstRow, int lastRow);
+};
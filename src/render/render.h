@@ -12,9 +12,9 @@ public:
     // Initialize when the renderer is created
     virtual void init() = 0;
 
-    // Setup resources (VAOs, VBOs and textures) for all models in the input scene
+    // Setup resources (vertex arrays, geometry buffer ranges and textures) for all models in the input scene
     virtual void setup(const std::shared_ptr<Scene>& scene) = 0;
-    // Setup and clean resources (VAOs, VBOs and textures) bind with one input model
+    // Setup and clean resources (vertex arrays, geometry buffer ranges and textures) bind with one input model
     // When add/remove model one by one, call `setupModel/cleanModel` is faster than `setup`
     virtual void setupModel(const ModelPtr& model) = 0;
     virtual void cleanModel(const ModelPtr& model) = 0;
@@ -45,7 +45,84 @@ public:
         }
     }
 
+    // Vertex buffer format of models set up from now on, call `setup` to re-encode loaded models
+    [[nodiscard]] VERTEX_ENCODING getVertexEncoding() const { return mVertexEncoding; }
+    void setVertexEncoding(VERTEX_ENCODING encoding) { mVertexEncoding = encoding; }
+
+    // GPU format of textures loaded from now on, call `setup` to reload the textures of loaded models
+    [[nodiscard]] TEXTURE_COMPRESSION getTextureCompression() const { return mTextureCompression; }
+    void setTextureCompression(TEXTURE_COMPRESSION compression) { mTextureCompression = compression; }
+
+    // Texture streaming: bytes uploaded per frame (at least one level always goes) and VRAM for all textures
+    [[nodiscard]] size_t getTextureUploadBudget() const { return mTextureUploadBudget; }
+    void setTextureUploadBudget(size_t bytes) { mTextureUploadBudget = bytes; }
+    [[nodiscard]] size_t getTextureMemoryBudget() const { return mTextureMemoryBudget; }
+    void setTextureMemoryBudget(size_t bytes) { mTextureMemoryBudget = bytes; }
+
+    // Largest screen-space error of the LOD drawn for a shape, in pixels (0 always draws full detail)
+    [[nodiscard]] float getLODErrorThreshold() const { return mLODErrorThreshold; }
+    void setLODErrorThreshold(float pixels) { mLODErrorThreshold = pixels; }
+    // Reject meshlets facing away from the camera (frustum culling of meshlets is always on)
+    [[nodiscard]] bool getConeCulling() const { return mConeCulling; }
+    void setConeCulling(bool enabled) { mConeCulling = enabled; }
+    // Skip shapes hidden behind the largest ones, tested against a small depth buffer rasterized on the CPU
+    [[nodiscard]] bool getOcclusionCulling() const { return mOcclusionCulling; }
+    void setOcclusionCulling(bool enabled) { mOcclusionCulling = enabled; }
+    // Submit each pass with a few multi-draw-indirect calls, pulling vertices from shared buffers, where supported
+    [[nodiscard]] bool getIndirectDraws() const { return mIndirectDraws; }
+    void setIndirectDraws(bool enabled) { mIndirectDraws = enabled; }
+    // With indirect draws, cull every instance in a compute pass against the frustum and the previous frame's depth
+    [[nodiscard]] bool getGPUCulling() const { return mGPUCulling; }
+    void setGPUCulling(bool enabled) { mGPUCulling = enabled; }
+    // Shapes of the last frame outside the view frustum or occluded, skipped by every pass, and how many were occluded
+    [[nodiscard]] size_t getCulledShapes() const { return mCulledShapes; }
+    [[nodiscard]] size_t getOccludedShapes() const { return mOccludedShapes; }
+    // Triangles drawn in the shading pass of the last frame
+    [[nodiscard]] size_t getRenderedTriangles() const { return mRenderedTriangles; }
+    // Draw calls of the last frame, all passes
+    [[nodiscard]] size_t getDrawCalls() const { return mDrawCalls; }
+    // Program, vertex array, texture and buffer binds of the last frame, and how many fewer than in model order
+    [[nodiscard]] size_t getStateChanges() const { return mStateChanges; }
+    [[nodiscard]] size_t getStateChangesSaved() const { return mStateChangesSaved; }
+    // VRAM of the texture levels resident after the last frame
+    [[nodiscard]] size_t getTextureBytes() const { return mTextureBytes; }
+    // Buffers holding shape geometry, their bytes and the bytes in use, after the last frame
+    [[nodiscard]] size_t getGeometryBufferCount() const { return mGeometryBufferCount; }
+    [[nodiscard]] size_t getGeometryBufferBytes() const { return mGeometryBufferBytes; }
+    [[nodiscard]] size_t getGeometryBytesUsed() const { return mGeometryBytesUsed; }
+    // Bytes repacking the geometry buffers has copied so far
+    [[nodiscard]] size_t getGeometryBytesMoved() const { return mGeometryBytesMoved; }
+
+    // Size of point cloud points, in pixels
+    [[nodiscard]] float getPointSize() const { return mPointSize; }
+    void setPointSize(float size) { mPointSize = size; }
+    // Width of the outline around the selection, in pixels
+    [[nodiscard]] float getOutlineWidth() const { return mOutlineWidth; }
+    void setOutlineWidth(float pixels) { mOutlineWidth = pixels; }
+
 protected:
     std::unordered_map<SHADER_TYPE, std::shared_ptr<ShaderProgram>> mShaders;
     std::pair<SHADER_TYPE, std::shared_ptr<ShaderProgram>> mCurrentShader;
+    float mPointSize = 2.0f;
+    float mOutlineWidth = 2.0f;
+    VERTEX_ENCODING mVertexEncoding = VERTEX_ENCODING::Octahedral16;
+    TEXTURE_COMPRESSION mTextureCompression = TEXTURE_COMPRESSION::BC1_BC3;
+    size_t mTextureUploadBudget = size_t(16) << 20;     // 16MB
+    size_t mTextureMemoryBudget = size_t(1) << 30;      // 1GB
+    float mLODErrorThreshold = 1.0f;
+    bool mConeCulling = true;
+    bool mOcclusionCulling = true;
+    bool mIndirectDraws = true;
+    bool mGPUCulling = true;
+    size_t mRenderedTriangles = 0;
+    size_t mCulledShapes = 0;
+    size_t mOccludedShapes = 0;
+    size_t mDrawCalls = 0;
+    size_t mStateChanges = 0;
+    size_t mStateChangesSaved = 0;
+    size_t mTextureBytes = 0;
+    size_t mGeometryBufferCount = 0;
+    size_t mGeometryBufferBytes = 0;
+    size_t mGeometryBytesUsed = 0;
+    size_t mGeometryBytesMoved = 0;
 };
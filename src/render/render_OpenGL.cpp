@@ -1,18 +1,101 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include "render_OpenGL.h"
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
 #include "utils/file.h"
+#include "utils/parallel.h"
+#include "utils/quantize.hpp"
+#include "utils/radix_sort.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
+#include <limits>
+
+namespace {
+
+// Inverse transpose of the upper 3x3, in a mat4 as std140 and the instance attributes lay it out
+glm::mat4 normalMatrix(const glm::mat4& matrix) {
+    return glm::mat4(glm::transpose(glm::inverse(glm::mat3(matrix))));
+}
+
+// Most significant first: pass, program, texture, buffer, then view depth, so packets sharing state draw together
+// and front to back within it. Positive floats order like their bits, the top 24 bits are plenty for depth.
+uint64_t drawKey(uint32_t pass, uint32_t program, GLuint texture, GLuint buffer, float depth) {
+    uint32_t depthBits = 0;
+    if (depth > 0.0f) std::memcpy(&depthBits, &depth, sizeof(depth));
+    return (static_cast<uint64_t>(pass & 0x3) << 62) | (static_cast<uint64_t>(program & 0x7) << 59) |
+           (static_cast<uint64_t>(texture & 0x7FFFF) << 40) | (static_cast<uint64_t>(buffer & 0xFFFF) << 24) | (depthBits >> 8);
+}
+
+// Largest scale of the matrix's axes, radii grow by it
+float maxScale(const glm::mat4& matrix) {
+    return std::max({glm::length(glm::vec3(matrix[0])), glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))});
+}
+
+bool hasExtension(const char* extension) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const auto* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+        if (name && std::strcmp(name, extension) == 0) return true;
+    }
+    return false;
+}
+
+}
 
 OpenGLRender::~OpenGLRender() {
     OpenGLRender::cleanup();
+    glDeleteBuffers(1, &mCameraUBO);
+    glDeleteBuffers(1, &mObjectUBO);
+    GLuint indirectBuffers[] = { mDrawRecordBuffer, mCommandRecordBuffer, mObjectBuffer, mInstanceBuffer, mInstanceIndexBuffer, mCommandBuffer };
+    glDeleteBuffers(6, indirectBuffers);
+    glDeleteVertexArrays(1, &mIndirectVAO);
+    GLuint cullBuffers[] = { mCullCommandBuffer, mCulledCommandBuffer, mCulledInstanceBuffer };
+    glDeleteBuffers(3, cullBuffers);
+    GLuint hiZTextures[] = { mDepthCopy, mHiZTexture };
+    glDeleteTextures(2, hiZTextures);
+    if (mCullShader) mCullShader->cleanup();
+    if (mHiZShader) mHiZShader->cleanup();
+    glDeleteVertexArrays(1, &mScreenVAO);
+    glDeleteFramebuffers(3, mOutlineFramebuffers);
+    GLuint outlineTextures[] = { mOutlineMask, mOutlineSeeds[0], mOutlineSeeds[1] };
+    glDeleteTextures(3, outlineTextures);
+    if (mFloodShader) mFloodShader->cleanup();
+    if (mCompositeShader) mCompositeShader->cleanup();
     for (auto& shader : mShaders) {
         shader.second->cleanup();
     }
+    for (auto& shader : mIndirectShaders) {
+        shader.second->cleanup();
+    }
 }
 
+OpenGLShaderUniforms::OpenGLShaderUniforms(const ShaderProgram& shader)
+    : positionOffset(shader.getUniform<glm::vec3>("positionOffset")),
+      positionScale(shader.getUniform<glm::vec3>("positionScale")),
+      octNormals(shader.getUniform<bool>("octNormals")),
+      hasTexture(shader.getUniform<bool>("hasTexture")),
+      hasNormal(shader.getUniform<bool>("hasNormal")),
+      hasColor(shader.getUniform<bool>("hasColor")),
+      isPoint(shader.getUniform<bool>("isPoint")),
+      textureDiffuse(shader.getUniform<int>("texture_diffuse")),
+      modelIdx(shader.getUniform<int>("modelIdx")),
+      offset(shader.getUniform<float>("offset")),
+      firstCommand(shader.getUniform<unsigned int>("firstCommand")),
+      sourceLevel(shader.getUniform<int>("sourceLevel")),
+      commandCount(shader.getUniform<unsigned int>("commandCount")),
+      threadCount(shader.getUniform<unsigned int>("threadCount")),
+      viewProjection(shader.getUniform<glm::mat4>("viewProjection")),
+      hiZViewProjection(shader.getUniform<glm::mat4>("hiZViewProjection")),
+      hiZViewport(shader.getUniform<glm::vec2>("hiZViewport")),
+      occlusion(shader.getUniform<bool>("occlusion")),
+      jump(shader.getUniform<int>("jump")),
+      fromMask(shader.getUniform<bool>("fromMask")),
+      width(shader.getUniform<float>("width")),
+      viewportOrigin(shader.getUniform<glm::vec2>("viewportOrigin")) {}
+
 RENDERER_TYPE OpenGLRender::getType() const {
     return RENDERER_TYPE::OpenGL;
 }
@@ -23,27 +106,61 @@ void OpenGLRender::init() {
         throw std::runtime_error("Failed to initialize GLAD");
     }
 
-    mShaders[SHADER_TYPE::Solid] = std::make_shared<ShaderProgram>(
-        findFile("assets/shaders/glsl/solid.vert"),
-        findFile("assets/shaders/glsl/solid.frag")
-    );
-    mShaders[SHADER_TYPE::MaterialPreview] = std::make_shared<ShaderProgram>(
-        findFile("assets/shaders/glsl/material-preview.vert"),
-        findFile("assets/shaders/glsl/material-preview.frag")
-    );
-    mShaders[SHADER_TYPE::Wireframe] = std::make_shared<ShaderProgram>(
-        findFile("assets/shaders/glsl/wireframe.vert"),
-        findFile("assets/shaders/glsl/wireframe.frag")
-    );
-    mShaders[SHADER_TYPE::Outline] = std::make_shared<ShaderProgram>(
-        findFile("assets/shaders/glsl/outline.vert"),
-        findFile("assets/shaders/glsl/outline.frag")
-    );
-    mShaders[SHADER_TYPE::Index] = std::make_shared<ShaderProgram>(
-        findFile("assets/shaders/glsl/model-index.vert"),
-        findFile("assets/shaders/glsl/model-index.frag")
-    );
-    
+    // The indirect path pulls vertices in the shaders, it needs gl_DrawIDARB and gl_BaseInstanceARB
+    mIndirectSupported = hasExtension("GL_ARB_shader_draw_parameters");
+
+    const std::pair<SHADER_TYPE, const char*> programs[] = {
+        { SHADER_TYPE::Solid, "solid" },
+        { SHADER_TYPE::MaterialPreview, "material-preview" },
+        { SHADER_TYPE::Wireframe, "wireframe" },
+        { SHADER_TYPE::Outline, "outline" },
+        { SHADER_TYPE::Index, "model-index" },
+    };
+    for (const auto& [type, name] : programs) {
+        std::string vertexPath = findFile(std::string("assets/shaders/glsl/") + name + ".vert");
+        std::string fragmentPath = findFile(std::string("assets/shaders/glsl/") + name + ".frag");
+        mShaders[type] = std::make_shared<ShaderProgram>(vertexPath, fragmentPath);
+        if (mIndirectSupported) {
+            mIndirectShaders[type] = std::make_shared<ShaderProgram>(vertexPath, fragmentPath, "", "#define VERTEX_PULLING\n");
+            mIndirectSupported = mIndirectShaders[type]->isLinked();
+        }
+    }
+    for (const auto& [type, shader] : mIndirectShaders) mIndirectUniforms[type] = OpenGLShaderUniforms(*shader);
+    if (!mIndirectSupported) std::cout << "Indirect draws are not supported, drawing shapes one by one" << std::endl;
+
+    for (const auto& [type, shader] : mShaders) {
+        mUniforms[type] = OpenGLShaderUniforms(*shader);
+        GLint cameraSize = shader->getUniformBlockSize("Camera");
+        GLint objectSize = shader->getUniformBlockSize("Object");
+        if ((cameraSize && cameraSize != sizeof(OpenGLCameraBlock)) || (objectSize && objectSize != sizeof(OpenGLObjectBlock))) {
+            std::cerr << "Shader uniform blocks don't match the renderer's layout" << std::endl;
+            throw std::runtime_error("Shader uniform blocks don't match the renderer's layout");
+        }
+    }
+
+    glGenBuffers(1, &mCameraUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, mCameraUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(OpenGLCameraBlock), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, kCameraBlockBinding, mCameraUBO);
+    glGenBuffers(1, &mObjectUBO);
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    alignment = std::max(alignment, 1);
+    mObjectStride = (sizeof(OpenGLObjectBlock) + alignment - 1) / alignment * alignment;
+    if (mIndirectSupported) {
+        // Vertex pulling binds whole arena blocks, so no block may outgrow a storage block
+        GLint64 maxStorageBlock = 0;
+        glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxStorageBlock);
+        if (maxStorageBlock > 0) {
+            mMaxStorageBlockBytes = static_cast<size_t>(maxStorageBlock);
+            mGeometryArena.limitBlockSize(mMaxStorageBlockBytes);
+        }
+        initIndirect();
+        initGPUCulling();
+    }
+    initOutline();
+
     setCurrentShader(SHADER_TYPE::MaterialPreview);
 
     glEnable(GL_DEPTH_TEST);
@@ -56,75 +173,272 @@ void OpenGLRender::setup(const std::shared_ptr<Scene>& scene) {
     }
 }
 
-void OpenGLRender::setupModel(const ModelPtr& model) {
-    size_t shapeCount = model->getShapeCount();
-    OpenGLModelResources resources;
-    resources.VAOs.resize(shapeCount);
-    resources.VBOs.resize(shapeCount);
-    resources.textures.resize(shapeCount);
-    resources.vertexCounts.resize(shapeCount);
+const OpenGLShapeBuffers& OpenGLRender::acquireShapeBuffers(const ShapePtr& shape) {
+    auto it = mShapeBuffers.find(shape.get());
+    if (it != mShapeBuffers.end()) {
+        it->second.users++;
+        return it->second;
+    }
 
-    glGenVertexArrays(shapeCount, resources.VAOs.data());
-    glGenBuffers(shapeCount, resources.VBOs.data());
+    OpenGLShapeBuffers buffers;
+    buffers.shape = shape;
+    buffers.users = 1;
+    const std::vector<glm::vec3>& vertices = shape->vertices;
+    const std::vector<glm::vec3>& normals = shape->normals;
+    const std::vector<glm::vec2>& texCoords = shape->texCoords;
+    const std::vector<glm::vec3>& colors = shape->colors;
+    const std::vector<uint32_t>& indices = shape->indices;
 
-    for (size_t i = 0; i < shapeCount; ++i) {
-        const std::vector<glm::vec3>& vertices = model->getVertices(i);
-        const std::vector<glm::vec3>& normals = model->getNormals(i);
-        const std::vector<glm::vec2>& texCoords = model->getTexCoords(i);
-        const std::string& texturePath = model->getTexturePath(i);
+    // Vertex layout for the current encoding
+    bool quantized = mVertexEncoding != VERTEX_ENCODING::Float;
+    size_t positionSize = quantized ? 4 * sizeof(uint16_t) : sizeof(glm::vec3);    // 4th uint16 keeps 4-byte alignment
+    size_t normalSize = normals.empty() ? 0 : (quantized ? sizeof(uint32_t) : sizeof(glm::vec3));
+    size_t texCoordSize = texCoords.empty() ? 0 : (quantized ? 2 * sizeof(uint16_t) : sizeof(glm::vec2));
+    size_t colorSize = colors.empty() ? 0 : (quantized ? 4 * sizeof(uint8_t) : sizeof(glm::vec3));
+    size_t normalOffset = positionSize;
+    size_t texCoordOffset = normalOffset + normalSize;
+    size_t colorOffset = texCoordOffset + texCoordSize;
+    size_t stride = colorOffset + colorSize;
+    buffers.stride = stride;
+    buffers.normalOffset = normals.empty() ? 0 : normalOffset;
+    buffers.texCoordOffset = texCoords.empty() ? 0 : texCoordOffset;
+    buffers.colorOffset = colors.empty() ? 0 : colorOffset;
 
-        std::vector<float> bufferData;
-        for (size_t j = 0; j < vertices.size(); ++j) {
-            bufferData.push_back(vertices[j].x);
-            bufferData.push_back(vertices[j].y);
-            bufferData.push_back(vertices[j].z);
+    glm::vec3 minBound(0.0f), maxBound(0.0f);
+    if (!vertices.empty()) {
+        minBound = maxBound = vertices[0];
+        for (const auto& v : vertices) {
+            minBound = glm::min(minBound, v);
+            maxBound = glm::max(maxBound, v);
+        }
+    }
+    glm::vec3 center = (minBound + maxBound) * 0.5f;
+    float radius = 0.0f;
+    for (const auto& v : vertices) radius = std::max(radius, glm::length(v - center));
+    buffers.boundingSphere = glm::vec4(center, radius);
+    buffers.boxExtent = (maxBound - minBound) * 0.5f;
+
+    // Quantized positions are relative to the shape bounds
+    OpenGLVertexDecode decode;
+    if (quantized && !vertices.empty()) {
+        glm::vec3 extent = maxBound - minBound;
+        decode.positionOffset = minBound;
+        decode.positionScale = glm::vec3(
+            extent.x > 0.0f ? extent.x : 1.0f,
+            extent.y > 0.0f ? extent.y : 1.0f,
+            extent.z > 0.0f ? extent.z : 1.0f
+        );
+    }
+    decode.octNormals = mVertexEncoding == VERTEX_ENCODING::Octahedral16;
+    buffers.decode = decode;
+
+    std::vector<unsigned char> bufferData(vertices.size() * stride);
+    parallelFor(vertices.size(), 1 << 16, [&](size_t begin, size_t end) {
+        for (size_t j = begin; j < end; ++j) {
+            unsigned char* vertex = bufferData.data() + j * stride;
+            if (!quantized) {
+                std::memcpy(vertex, &vertices[j], sizeof(glm::vec3));
+                if (!normals.empty()) std::memcpy(vertex + normalOffset, &normals[j], sizeof(glm::vec3));
+                if (!texCoords.empty()) std::memcpy(vertex + texCoordOffset, &texCoords[j], sizeof(glm::vec2));
+                if (!colors.empty()) std::memcpy(vertex + colorOffset, &colors[j], sizeof(glm::vec3));
+                continue;
+            }
+
+            glm::vec3 p = (vertices[j] - decode.positionOffset) / decode.positionScale;
+            uint16_t position[4] = { quantizeUnorm16(p.x), quantizeUnorm16(p.y), quantizeUnorm16(p.z), 0 };
+            std::memcpy(vertex, position, sizeof(position));
 
             if (!normals.empty()) {
-                bufferData.push_back(normals[j].x);
-                bufferData.push_back(normals[j].y);
-                bufferData.push_back(normals[j].z);
+                if (mVertexEncoding == VERTEX_ENCODING::Octahedral16) {
+                    glm::vec2 oct = octEncode(normals[j]);
+                    int16_t normal[2] = { quantizeSnorm16(oct.x), quantizeSnorm16(oct.y) };
+                    std::memcpy(vertex + normalOffset, normal, sizeof(normal));
+                } else {
+                    uint32_t normal = packSnorm1010102(normals[j]);
+                    std::memcpy(vertex + normalOffset, &normal, sizeof(normal));
+                }
             }
 
             if (!texCoords.empty()) {
-                bufferData.push_back(texCoords[j].x);
-                bufferData.push_back(texCoords[j].y);
+                uint16_t texCoord[2] = { floatToHalf(texCoords[j].x), floatToHalf(texCoords[j].y) };
+                std::memcpy(vertex + texCoordOffset, texCoord, sizeof(texCoord));
+            }
+
+            if (!colors.empty()) {
+                auto channel = [](float c) { return static_cast<uint8_t>(std::lround(std::clamp(c, 0.0f, 1.0f) * 255.0f)); };
+                uint8_t color[4] = { channel(colors[j].x), channel(colors[j].y), channel(colors[j].z), 255 };
+                std::memcpy(vertex + colorOffset, color, sizeof(color));
             }
         }
+    });
 
-        glBindVertexArray(resources.VAOs[i]);
+    // All LODs share the vertices, their index lists follow the full-detail one
+    const std::vector<ShapeLOD>& shapeLODs = shape->lods;
+    size_t indexCount = indices.size();
+    buffers.lods.push_back({0, indices.size(), 0.0f});
+    for (const auto& lod : shapeLODs) {
+        buffers.lods.push_back({indexCount, lod.indices.size(), lod.error});
+        indexCount += lod.indices.size();
+    }
+
+    // One range of a shared arena block, vertex sizes are whole words so the indices stay aligned
+    buffers.vertexBytes = bufferData.size();
+    buffers.allocation = mGeometryArena.allocate(buffers.vertexBytes + indexCount * sizeof(uint32_t));
+    mGeometryArena.upload(buffers.allocation, 0, bufferData.data(), bufferData.size());
+    mGeometryArena.upload(buffers.allocation, buffers.vertexBytes, indices.data(), indices.size() * sizeof(uint32_t));
+    for (size_t level = 0; level < shapeLODs.size(); ++level) {
+        const OpenGLLOD& range = buffers.lods[level + 1];
+        mGeometryArena.upload(buffers.allocation, buffers.vertexBytes + range.indexOffset * sizeof(uint32_t),
+                              shapeLODs[level].indices.data(), range.indexCount * sizeof(uint32_t));
+    }
+    OpenGLBufferArena::Range range = mGeometryArena.getRange(buffers.allocation);
+    buffers.buffer = range.buffer;
+    buffers.vertexOffset = range.offset;
+    buffers.firstIndex = (range.offset + buffers.vertexBytes) / sizeof(uint32_t);
+    // Only a shape larger than a whole block got a block too large to bind
+    buffers.pullable = range.size <= mMaxStorageBlockBytes;
+    if (!buffers.pullable) mUnpulledShapes++;
+    bool isPoints = shape->primitive == PRIMITIVE_TYPE::Points;
+    buffers.primitive = isPoints ? GL_POINTS : GL_TRIANGLES;
+    buffers.drawCount = isPoints ? vertices.size() : indices.size();
 
-        glBindBuffer(GL_ARRAY_BUFFER, resources.VBOs[i]);
-        glBufferData(GL_ARRAY_BUFFER, bufferData.size() * sizeof(float), bufferData.data(), GL_STATIC_DRAW);
+    return mShapeBuffers[shape.get()] = std::move(buffers);
+}
 
-        size_t stride = 3;
-        if (!normals.empty()) stride += 3;
-        if (!texCoords.empty()) stride += 2;
+void OpenGLRender::releaseShapeBuffers(const ShapePtr& shape) {
+    auto it = mShapeBuffers.find(shape.get());
+    if (it == mShapeBuffers.end() || --it->second.users > 0) return;
+    mGeometryArena.free(it->second.allocation);
+    if (!it->second.pullable) mUnpulledShapes--;
+    mShapeBuffers.erase(it);
+    mDefragmentPending = true;
+}
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride * sizeof(float), (void*)nullptr);
-        glEnableVertexAttribArray(0);
-        size_t offset = 3 * sizeof(float);
-        resources.vertexCounts[i] = vertices.size();
+void OpenGLRender::bindShapeVertices(OpenGLModelResources& resources, size_t shapeIndex) const {
+    const OpenGLShapeBuffers& buffers = mShapeBuffers.at(resources.shapes[shapeIndex].get());
+    resources.firstIndices[shapeIndex] = buffers.firstIndex;
 
-        if (!normals.empty()) {
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride * sizeof(float), (void*)offset);
-            glEnableVertexAttribArray(1);
-            offset += 3 * sizeof(float);
-        }
+    glBindVertexArray(resources.VAOs[shapeIndex]);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.buffer);
+    // The element buffer binding is recorded in the VAO, so it must stay bound until the VAO is unbound
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.buffer);
 
-        if (!texCoords.empty()) {
-            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride * sizeof(float), (void*)offset);
-            glEnableVertexAttribArray(2);
-        }
+    bool quantized = mVertexEncoding != VERTEX_ENCODING::Float;
+    auto glStride = static_cast<GLsizei>(buffers.stride);
+    auto attribute = [&](size_t offset) { return (void*)(buffers.vertexOffset + offset); };
+    if (quantized) glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, glStride, attribute(0));
+    else glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, glStride, attribute(0));
+    glEnableVertexAttribArray(0);
 
-        // Load texture
-        if (!texturePath.empty()) {
-            loadTexture(texturePath, resources.textures[i]);
+    if (buffers.normalOffset) {
+        if (mVertexEncoding == VERTEX_ENCODING::Octahedral16) glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, glStride, attribute(buffers.normalOffset));
+        else if (mVertexEncoding == VERTEX_ENCODING::Packed1010102) glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, glStride, attribute(buffers.normalOffset));
+        else glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, glStride, attribute(buffers.normalOffset));
+        glEnableVertexAttribArray(1);
+    }
+
+    if (buffers.texCoordOffset) {
+        if (quantized) glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, glStride, attribute(buffers.texCoordOffset));
+        else glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, glStride, attribute(buffers.texCoordOffset));
+        glEnableVertexAttribArray(2);
+    }
+
+    if (buffers.colorOffset) {
+        if (quantized) glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, glStride, attribute(buffers.colorOffset));
+        else glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, glStride, attribute(buffers.colorOffset));
+        glEnableVertexAttribArray(3);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void OpenGLRender::locateShapeBuffers() {
+    for (auto& [shape, buffers] : mShapeBuffers) {
+        OpenGLBufferArena::Range range = mGeometryArena.getRange(buffers.allocation);
+        buffers.buffer = range.buffer;
+        buffers.vertexOffset = range.offset;
+        buffers.firstIndex = (range.offset + buffers.vertexBytes) / sizeof(uint32_t);
+    }
+    for (auto& [model, resources] : mModelResources) {
+        for (size_t i = 0; i < resources.shapes.size(); ++i) bindShapeVertices(resources, i);
+    }
+}
+
+void OpenGLRender::setupModel(const ModelPtr& model) {
+    size_t shapeCount = model->getShapeCount();
+    OpenGLModelResources resources;
+    resources.VAOs.resize(shapeCount);
+    resources.shapes.resize(shapeCount);
+    resources.drawCounts.resize(shapeCount);
+    resources.primitives.resize(shapeCount);
+    resources.decodes.resize(shapeCount);
+    resources.lods.resize(shapeCount);
+    resources.currentLODs.assign(shapeCount, 0);
+    resources.boundingSpheres.resize(shapeCount);
+    resources.boxExtents.resize(shapeCount);
+    resources.inView.assign(shapeCount, 1);
+    resources.inFrustum.assign(shapeCount, 1);
+    resources.meshletDraws.assign(shapeCount, false);
+    resources.visibleCounts.resize(shapeCount);
+    resources.visibleOffsets.resize(shapeCount);
+    resources.firstIndices.resize(shapeCount);
+
+    std::vector<std::string> texturePaths(shapeCount);
+    for (size_t i = 0; i < shapeCount; ++i) texturePaths[i] = model->getTexturePath(i);
+    resources.textures = mTextures.acquire(texturePaths, mTextureCompression);
+
+    glGenVertexArrays(shapeCount, resources.VAOs.data());
+    glGenBuffers(1, &resources.instanceVBO);
+
+    for (size_t i = 0; i < shapeCount; ++i) {
+        // Vertex and element buffers are shared with every model using the same shape, only the VAO is the model's
+        resources.shapes[i] = model->getShapePtr(i);
+        const OpenGLShapeBuffers& buffers = acquireShapeBuffers(resources.shapes[i]);
+        resources.drawCounts[i] = buffers.drawCount;
+        resources.primitives[i] = buffers.primitive;
+        resources.decodes[i] = buffers.decode;
+        resources.lods[i] = buffers.lods;
+        resources.boundingSpheres[i] = buffers.boundingSphere;
+        resources.boxExtents[i] = buffers.boxExtent;
+
+        bindShapeVertices(resources, i);
+
+        // Instance attributes, enabled once the model has instances (see updateInstances)
+        glBindVertexArray(resources.VAOs[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, resources.instanceVBO);
+        for (GLuint column = 0; column < 4; ++column) {
+            glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(OpenGLInstance), (void*)(column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(4 + column, 1);
+        }
+        glVertexAttribIPointer(8, 1, GL_UNSIGNED_INT, sizeof(OpenGLInstance), (void*)offsetof(OpenGLInstance, index));
+        glVertexAttribDivisor(8, 1);
+        for (GLuint column = 0; column < 3; ++column) {
+            glVertexAttribPointer(9 + column, 3, GL_FLOAT, GL_FALSE, sizeof(OpenGLInstance),
+                                  (void*)(offsetof(OpenGLInstance, normalMatrix) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(9 + column, 1);
         }
 
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindVertexArray(0);
     }
 
+    // Sphere around all shapes, to find the nearest instance
+    if (shapeCount > 0) {
+        glm::vec3 minBound = glm::vec3(resources.boundingSpheres[0]) - resources.boundingSpheres[0].w;
+        glm::vec3 maxBound = glm::vec3(resources.boundingSpheres[0]) + resources.boundingSpheres[0].w;
+        for (const auto& sphere : resources.boundingSpheres) {
+            minBound = glm::min(minBound, glm::vec3(sphere) - sphere.w);
+            maxBound = glm::max(maxBound, glm::vec3(sphere) + sphere.w);
+        }
+        glm::vec3 center = (minBound + maxBound) * 0.5f;
+        float radius = 0.0f;
+        for (const auto& sphere : resources.boundingSpheres) radius = std::max(radius, glm::length(glm::vec3(sphere) - center) + sphere.w);
+        resources.modelSphere = glm::vec4(center, radius);
+    }
+    resources.cullSpheres = resources.boundingSpheres;
+    resources.cullExtents = resources.boxExtents;
+
     mModelResources[model] = std::move(resources);
 }
 
@@ -132,8 +446,9 @@ void OpenGLRender::cleanModel(const ModelPtr& model) {
     auto it = mModelResources.find(model);
     if (it != mModelResources.end()) {
         glDeleteVertexArrays(it->second.VAOs.size(), it->second.VAOs.data());
-        glDeleteBuffers(it->second.VBOs.size(), it->second.VBOs.data());
-        glDeleteTextures(it->second.textures.size(), it->second.textures.data());
+        for (const auto& shape : it->second.shapes) releaseShapeBuffers(shape);
+        glDeleteBuffers(1, &it->second.instanceVBO);
+        for (GLuint texture : it->second.textures) mTextures.release(texture);
         mModelResources.erase(it);
     }
 }
@@ -143,133 +458,623 @@ void OpenGLRender::render(const std::shared_ptr<Scene>& scene, const glm::mat4&
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glPolygonMode(GL_FRONT_AND_BACK, mCurrentShader.first == SHADER_TYPE::Wireframe ? GL_LINE : GL_FILL);
     glLineWidth(1.0f);
+    glPointSize(mPointSize);
 
-    // First pass: shapes
-    auto shader = mCurrentShader.second;
-    shader->use();
-
-    shader->setMat4("view", viewMatrix);
-    shader->setMat4("projection", projectionMatrix);
+    // Pack the geometry buffers once models went away, before anything reads their ranges this frame
+    if (mDefragmentPending) {
+        mDefragmentPending = false;
+        if (mGeometryArena.defragment()) locateShapeBuffers();
+    }
+    OpenGLBufferArena::Stats arenaStats = mGeometryArena.getStats();
+    mGeometryBufferCount = arenaStats.blocks;
+    mGeometryBufferBytes = arenaStats.capacity;
+    mGeometryBytesUsed = arenaStats.used;
+    mGeometryBytesMoved = arenaStats.moved;
 
+    // Pick the LOD and cull the meshlets of every shape once, all passes draw the same triangles
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
     auto models = scene->getModels();
+    for (const auto& model : models) updateInstances(model, mModelResources.at(model), viewMatrix);
+    cullShapes(models, viewMatrix, projectionMatrix);
     for (const auto& model : models) {
-        // Skip selected shapes in wireframe mode, avoid overlapping of wireframe and outline
-        if (mCurrentShader.first == SHADER_TYPE::Wireframe && model->isSelected()) continue;
-        shader->setMat4("model", model->getModelMatrix());
-        const OpenGLModelResources& resources = mModelResources.at(model);
-        size_t shapeCount = model->getShapeCount();
-        for (size_t i = 0; i < shapeCount; ++i) {
-            if (!model->isShapeVisible(i)) continue;
-    
-            glBindVertexArray(resources.VAOs[i]);
-            shader->setBool("hasTexture", resources.textures[i] != 0);
-            if (resources.textures[i]) {
-                // Use GL_TETURE0 all the time
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, resources.textures[i]);
-                shader->setInt("textureDiffuse", 0);  
-            }
+        OpenGLModelResources& resources = mModelResources.at(model);
+        selectLODs(resources, viewMatrix, projectionMatrix, static_cast<float>(viewport[3]));
+        cullMeshlets(model, resources, viewMatrix, projectionMatrix);
+        requestTextures(model, resources, viewMatrix, projectionMatrix, static_cast<float>(viewport[3]));
+    }
+    mTextures.update(mTextureUploadBudget, mTextureMemoryBudget);
+    mTextureBytes = mTextures.getTextureBytes();
+    updateFrameBlocks(models, viewMatrix, projectionMatrix);
+    mRenderedTriangles = 0;
+    mDrawCalls = 0;
+    mStateChangesSaved = 0;
+    // The pyramid is stale once a frame goes by without it
+    if (!useGPUCulling()) mHiZValid = false;
 
-            glDrawArrays(GL_TRIANGLES, 0, resources.vertexCounts[i]);
-            glBindVertexArray(0);
+    if (useIndirectDraws()) {
+        // Both passes' commands go up together, each pass is a few multi-draws
+        beginIndirectFrame(scene, models);
+        std::vector<OpenGLDrawBatch> shadingBatches = queueRenderPass(models, RenderPass::Shading);
+        std::vector<OpenGLDrawBatch> outlineBatches = queueRenderPass(models, RenderPass::Outline);
+        uploadIndirectCommands();
+        GLuint commandBuffer = mCommandBuffer;
+        if (useGPUCulling()) {
+            cullIndirectCommands({&shadingBatches}, projectionMatrix * viewMatrix);
+            commandBuffer = mCulledCommandBuffer;
         }
-    }
 
-    // Second pass: outline
-    auto outlineShader = mShaders[SHADER_TYPE::Outline];
-    outlineShader->use();
-    outlineShader->setMat4("view", viewMatrix);
-    outlineShader->setMat4("projection", projectionMatrix);
-    if (mCurrentShader.first == SHADER_TYPE::Wireframe) outlineShader->setFloat("offset", 0.0f);
-    else outlineShader->setFloat("offset", 0.0f);   // TODO: Offset can be set by user.
-    
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    glLineWidth(1.6f);
+        const ShaderProgram& shader = *mIndirectShaders.at(mCurrentShader.first);
+        const OpenGLShaderUniforms& uniforms = mIndirectUniforms.at(mCurrentShader.first);
+        shader.use();
+        shader.set(uniforms.textureDiffuse, 0);
+        glActiveTexture(GL_TEXTURE0);
+        mStateChanges = 1 + drawIndirectBatches(shader, uniforms, shadingBatches, commandBuffer);
+        // Shapes too large to bind for pulling go through their VAOs, within the same passes
+        mDrawPackets.clear();
+        if (mUnpulledShapes > 0) queueDrawPackets(models, viewMatrix, true);
+        mStateChanges += submitDrawPackets(models, RenderPass::Shading);
+        // Only the shading pass goes into the next frame's occlusion test
+        if (useGPUCulling()) updateHiZ(projectionMatrix * viewMatrix);
 
-    for (const auto& model : models) {
-        if (!model->isSelected()) continue;
-        outlineShader->setMat4("model", model->getModelMatrix());
-        const OpenGLModelResources& resources = mModelResources.at(model);
-        size_t shapeCount = model->getShapeCount();
-        for (size_t i = 0; i < shapeCount; ++i) {
-            if (!model->isShapeVisible(i)) {
-                continue;
-            }
-            glBindVertexArray(resources.VAOs[i]);
-            glDrawArrays(GL_TRIANGLES, 0, resources.vertexCounts[i]);
-            glBindVertexArray(0);
+        if (!outlineBatches.empty() || hasOutlinePackets()) {
+            const ShaderProgram& outlineShader = *mIndirectShaders.at(SHADER_TYPE::Outline);
+            const OpenGLShaderUniforms& outlineUniforms = mIndirectUniforms.at(SHADER_TYPE::Outline);
+            beginOutline();
+            outlineShader.use();
+            outlineShader.set(outlineUniforms.offset, 0.0f);
+            // Not culled on the GPU, its instances are read as queued
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kInstanceIndicesBinding, mInstanceIndexBuffer);
+            mStateChanges += 1 + drawIndirectBatches(outlineShader, outlineUniforms, outlineBatches, mCommandBuffer);
+            mStateChanges += submitDrawPackets(models, RenderPass::Outline);
+            endOutline();
         }
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        mDrawCalls += shadingBatches.size() + outlineBatches.size();
+        return;
     }
 
+    // Both passes go through one sorted queue, binds that wouldn't change anything are skipped
+    queueDrawPackets(models, viewMatrix);
+    size_t stateChanges = submitDrawPackets(models, RenderPass::Shading);
+    if (hasOutlinePackets()) {
+        beginOutline();
+        stateChanges += submitDrawPackets(models, RenderPass::Outline);
+        endOutline();
+    }
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    mStateChanges = stateChanges;
+    mStateChangesSaved = mUnsortedStateChanges > stateChanges ? mUnsortedStateChanges - stateChanges : 0;
 }
 
 void OpenGLRender::renderIdx(const std::shared_ptr<Scene>& scene, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix){
     glClearColor(0.00f, 0.00f, 0.00f, 1.00f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glPointSize(mPointSize);
+
+    auto models = scene->getModels();
+    updateFrameBlocks(models, viewMatrix, projectionMatrix);
+    cullShapes(models, viewMatrix, projectionMatrix);
+    bool indirect = useIndirectDraws();
+    if (indirect) {
+        // Pick ids come from the draw records
+        beginIndirectFrame(scene, models);
+        std::vector<OpenGLDrawBatch> batches = queueRenderPass(models, RenderPass::Index);
+        uploadIndirectCommands();
+        const ShaderProgram& idxShader = *mIndirectShaders.at(SHADER_TYPE::Index);
+        idxShader.use();
+        drawIndirectBatches(idxShader, mIndirectUniforms.at(SHADER_TYPE::Index), batches, mCommandBuffer);
+        // The rest are shapes too large to pull
+        if (mUnpulledShapes == 0) return;
+    }
 
     auto idxShader = mShaders[SHADER_TYPE::Index];
+    const OpenGLShaderUniforms& idxUniforms = mUniforms.at(SHADER_TYPE::Index);
     idxShader->use();
-    idxShader->setMat4("view", viewMatrix);
-    idxShader->setMat4("projection", projectionMatrix);
 
-    auto models = scene->getModels();
-    for (size_t modelIndex = 0; modelIndex < models.size(); modelIndex++) {
-        const auto& model = models[modelIndex];
-        idxShader->setInt("modelIdx", modelIndex + 1);
-        // +1, because index 0->(0,0,0,1) is reserved for background (glClearColor)
-        idxShader->setMat4("model", model->getModelMatrix());
+    resetInstanceAttributes();
+    uint32_t pickId = 1;    // Index 0->(0,0,0,1) is reserved for background (glClearColor)
+    for (const auto& model : models) {
+        // Instances add their index to the model's first id in the shader
+        idxShader->set(idxUniforms.modelIdx, static_cast<int>(pickId));
+        pickId += scene->getPickIdCount(model);
         const OpenGLModelResources& resources = mModelResources.at(model);
+        if (resources.instanced && resources.visibleInstances <= 0) continue;
+        bindObjectBlock(resources);
         size_t shapeCount = model->getShapeCount();
         for (size_t i = 0; i < shapeCount; ++i) {
-            if (!model->isShapeVisible(i)) {
+            if (!model->isShapeVisible(i) || !resources.inView[i]) {
                 continue;
             }
+            if (indirect && mShapeBuffers.at(resources.shapes[i].get()).pullable) continue;
             glBindVertexArray(resources.VAOs[i]);
-            glDrawArrays(GL_TRIANGLES, 0, resources.vertexCounts[i]);
-            glBindVertexArray(0);
+            drawShape(*idxShader, idxUniforms, resources, i, 0, resources.instanced ? resources.visibleInstances : 0);
         }
     }
+    glBindVertexArray(0);
+}
+
+bool OpenGLRender::passInstances(const ModelPtr& model, const OpenGLModelResources& resources, RenderPass pass,
+                                 GLsizei& firstInstance, GLsizei& instanceCount) const {
+    firstInstance = 0;
+    instanceCount = 1;
+    if (pass == RenderPass::Shading) {
+        if (resources.instanced) instanceCount = resources.visibleInstances;
+    } else if (pass == RenderPass::Outline) {
+        // A selected instanced model outlines all its instances, otherwise only the selected instance (first in the buffer)
+        if (resources.instanced) instanceCount = model->isSelected() ? resources.visibleInstances : resources.selectedInstances;
+        else if (!model->isSelected()) return false;
+    } else if (resources.instanced) {
+        instanceCount = resources.visibleInstances;
+    }
+    return instanceCount > 0;
+}
+
+void OpenGLRender::queueDrawPackets(const std::vector<ModelPtr>& models, const glm::mat4& viewMatrix, bool unpulledOnly) {
+    bool wireframe = mCurrentShader.first == SHADER_TYPE::Wireframe;
+    mDrawPackets.clear();
+    mUnsortedStateChanges = 2;      // Both programs
+    for (size_t m = 0; m < models.size(); ++m) {
+        const ModelPtr& model = models[m];
+        const OpenGLModelResources& resources = mModelResources.at(model);
+        glm::mat4 modelView = viewMatrix * resources.referenceMatrix;
+        for (RenderPass pass : { RenderPass::Shading, RenderPass::Outline }) {
+            GLsizei firstInstance, instanceCount;
+            if (!passInstances(model, resources, pass, firstInstance, instanceCount)) continue;
+            SHADER_TYPE program = pass == RenderPass::Shading ? mCurrentShader.first : SHADER_TYPE::Outline;
+            mUnsortedStateChanges++;    // Object block
+            // Occluded shapes stay in the outline, it has no depth test
+            const std::vector<uint8_t>& visible = pass == RenderPass::Outline ? resources.inFrustum : resources.inView;
+            for (size_t i = 0; i < resources.shapes.size(); ++i) {
+                if (!model->isShapeVisible(i) || !visible[i]) continue;
+                const OpenGLShapeBuffers& buffers = mShapeBuffers.at(resources.shapes[i].get());
+                if (unpulledOnly && buffers.pullable) continue;
+                GLuint texture = 0;
+                if (pass == RenderPass::Shading && !wireframe && mTextures.isResident(resources.textures[i])) texture = resources.textures[i];
+                GLuint buffer = buffers.buffer;
+                float depth = -(modelView * glm::vec4(glm::vec3(resources.boundingSpheres[i]), 1.0f)).z;
+                uint64_t key = drawKey(static_cast<uint32_t>(pass), static_cast<uint32_t>(program), texture, buffer, depth);
+                mDrawPackets.push_back({key, static_cast<uint32_t>(m), static_cast<uint32_t>(i), firstInstance,
+                                        resources.instanced ? instanceCount : 0});
+                mUnsortedStateChanges += texture ? 2 : 1;   // Vertex array and texture
+            }
+        }
+    }
+    radixSort(mDrawPackets, mPacketScratch, [](const OpenGLDrawPacket& packet) { return packet.key; });
+}
+
+bool OpenGLRender::hasOutlinePackets() const {
+    // Outline packets sort last
+    return !mDrawPackets.empty() && static_cast<RenderPass>(mDrawPackets.back().key >> 62) == RenderPass::Outline;
+}
+
+size_t OpenGLRender::submitDrawPackets(const std::vector<ModelPtr>& models, RenderPass pass) {
+    // Packets sort by pass first
+    auto passOf = [](const OpenGLDrawPacket& packet) { return static_cast<RenderPass>(packet.key >> 62); };
+    auto first = std::find_if(mDrawPackets.begin(), mDrawPackets.end(), [&](const OpenGLDrawPacket& packet) { return passOf(packet) == pass; });
+    auto last = std::find_if(first, mDrawPackets.end(), [&](const OpenGLDrawPacket& packet) { return passOf(packet) != pass; });
+    if (first == last) return 0;
+
+    const ShaderProgram* shader = nullptr;
+    const OpenGLShaderUniforms* uniforms = nullptr;
+    if (pass == RenderPass::Shading) {
+        shader = mCurrentShader.second.get();
+        uniforms = &mUniforms.at(mCurrentShader.first);
+        shader->use();
+        // Textures always go to unit 0
+        shader->set(uniforms->textureDiffuse, 0);
+        glActiveTexture(GL_TEXTURE0);
+    } else {
+        shader = mShaders.at(SHADER_TYPE::Outline).get();
+        uniforms = &mUniforms.at(SHADER_TYPE::Outline);
+        shader->use();
+        shader->set(uniforms->offset, 0.0f);   // TODO: Offset can be set by user.
+    }
+    auto object = static_cast<uint32_t>(-1);
+    GLuint texture = 0;
+    size_t stateChanges = 1;
+
+    resetInstanceAttributes();
+    for (auto it = first; it != last; ++it) {
+        const OpenGLDrawPacket& packet = *it;
+        const ModelPtr& model = models[packet.model];
+        const OpenGLModelResources& resources = mModelResources.at(model);
+        size_t i = packet.shape;
+        if (packet.model != object) {
+            object = packet.model;
+            bindObjectBlock(resources);
+            stateChanges++;
+        }
+        glBindVertexArray(resources.VAOs[i]);
+        stateChanges++;
+
+        if (pass == RenderPass::Shading) {
+            bool hasTexture = mTextures.isResident(resources.textures[i]);
+            shader->set(uniforms->hasTexture, hasTexture);
+            shader->set(uniforms->hasNormal, !model->getNormals(i).empty());
+            shader->set(uniforms->hasColor, !model->getColors(i).empty());
+            shader->set(uniforms->isPoint, resources.primitives[i] == GL_POINTS);
+            if (hasTexture && mCurrentShader.first != SHADER_TYPE::Wireframe && resources.textures[i] != texture) {
+                texture = resources.textures[i];
+                glBindTexture(GL_TEXTURE_2D, texture);
+                stateChanges++;
+            }
+        }
+
+        drawShape(*shader, *uniforms, resources, i, packet.firstInstance, packet.instanceCount);
+        mDrawCalls++;
+        if (pass != RenderPass::Shading) continue;
+        if (resources.meshletDraws[i]) {
+            for (GLsizei count : resources.visibleCounts[i]) mRenderedTriangles += static_cast<size_t>(count) / 3;
+        } else if (resources.primitives[i] == GL_TRIANGLES) {
+            size_t copies = packet.instanceCount > 0 ? static_cast<size_t>(packet.instanceCount) : 1;
+            mRenderedTriangles += resources.lods[i][resources.currentLODs[i]].indexCount / 3 * copies;
+        }
+    }
+    glBindVertexArray(0);
+    return stateChanges;
 }
 
 void OpenGLRender::cleanup() {
     for (auto& [model, resources] : mModelResources) {
         glDeleteVertexArrays(resources.VAOs.size(), resources.VAOs.data());
-        glDeleteBuffers(resources.VBOs.size(), resources.VBOs.data());
-        glDeleteTextures(resources.textures.size(), resources.textures.data());
+        glDeleteBuffers(1, &resources.instanceVBO);
+        for (GLuint texture : resources.textures) mTextures.release(texture);
     }
     mModelResources.clear();
+    mShapeBuffers.clear();
+    mGeometryArena.clear();
+    mDefragmentPending = false;
+    mUnpulledShapes = 0;
+    mInstanceLayout.clear();
+}
+
+void OpenGLRender::updateInstances(const ModelPtr& model, OpenGLModelResources& resources, const glm::mat4& viewMatrix) const {
+    resources.referenceMatrix = model->getModelMatrix();
+    if (model->isInstanced() != resources.instanced) {
+        resources.instanced = model->isInstanced();
+        resources.cullSpheres = resources.boundingSpheres;
+        resources.cullExtents = resources.boxExtents;
+        for (GLuint VAO : resources.VAOs) {
+            glBindVertexArray(VAO);
+            for (GLuint location = 4; location <= 11; ++location) {
+                if (resources.instanced) glEnableVertexAttribArray(location);
+                else glDisableVertexAttribArray(location);
+            }
+        }
+        glBindVertexArray(0);
+    }
+    if (!resources.instanced) return;
+
+    // Rebuild the buffer when instances change: visible ones only, the selected instance first
+    if (resources.instanceVersion != model->getInstanceVersion()) {
+        std::vector<OpenGLInstance> instances;
+        instances.reserve(model->getInstanceCount());
+        for (int pass = 0; pass < 2; ++pass) {
+            for (size_t i = 0; i < model->getInstanceCount(); ++i) {
+                const ModelInstance& instance = model->getInstance(i);
+                if (instance.visible && instance.selected == (pass == 0)) {
+                    instances.push_back({instance.matrix, static_cast<uint32_t>(i), {}, normalMatrix(instance.matrix)});
+                }
+            }
+            if (pass == 0) resources.selectedInstances = static_cast<GLsizei>(instances.size());
+        }
+        resources.visibleInstances = static_cast<GLsizei>(instances.size());
+
+        // Cull each shape by the box around all its visible instances
+        for (size_t i = 0; i < resources.boundingSpheres.size(); ++i) {
+            glm::vec3 minBound(0.0f), maxBound(0.0f);
+            for (size_t k = 0; k < instances.size(); ++k) {
+                glm::vec3 center, extent;
+                transformBox(instances[k].matrix, glm::vec3(resources.boundingSpheres[i]), resources.boxExtents[i], center, extent);
+                minBound = k == 0 ? center - extent : glm::min(minBound, center - extent);
+                maxBound = k == 0 ? center + extent : glm::max(maxBound, center + extent);
+            }
+            glm::vec3 extent = (maxBound - minBound) * 0.5f;
+            resources.cullSpheres[i] = glm::vec4((minBound + maxBound) * 0.5f, glm::length(extent));
+            resources.cullExtents[i] = extent;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, resources.instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(OpenGLInstance), instances.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        resources.instanceVersion = model->getInstanceVersion();
+    }
+
+    // LODs and texture levels are picked for the instance nearest to the camera
+    float nearest = std::numeric_limits<float>::max();
+    glm::mat4 modelView = viewMatrix * model->getModelMatrix();
+    for (size_t i = 0; i < model->getInstanceCount(); ++i) {
+        const ModelInstance& instance = model->getInstance(i);
+        if (!instance.visible) continue;
+        float distance = glm::length(glm::vec3(modelView * instance.matrix * glm::vec4(glm::vec3(resources.modelSphere), 1.0f)));
+        if (distance < nearest) {
+            nearest = distance;
+            resources.referenceMatrix = model->getModelMatrix() * instance.matrix;
+        }
+    }
+}
+
+void OpenGLRender::cullShapes(const std::vector<ModelPtr>& models, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
+    // First bounds of each model in the flat arrays
+    std::vector<size_t> firstShapes(models.size() + 1, 0);
+    for (size_t m = 0; m < models.size(); ++m) firstShapes[m + 1] = firstShapes[m] + models[m]->getShapeCount();
+    mCullBounds.resize(firstShapes.back());
+
+    parallelFor(models.size(), 64, [&](size_t begin, size_t end) {
+        for (size_t m = begin; m < end; ++m) {
+            const OpenGLModelResources& resources = mModelResources.at(models[m]);
+            const glm::mat4& modelMatrix = models[m]->getModelMatrix();
+            float scale = maxScale(modelMatrix);
+            for (size_t i = 0; i < resources.cullSpheres.size(); ++i) {
+                glm::vec3 center, extent;
+                transformBox(modelMatrix, glm::vec3(resources.cullSpheres[i]), resources.cullExtents[i], center, extent);
+                mCullBounds.set(firstShapes[m] + i, center, extent, resources.cullSpheres[i].w * scale);
+            }
+        }
+    });
+
+    size_t visible = cullFrustum(mCullBounds, extractFrustumPlanes(projectionMatrix * viewMatrix), mCullResults);
+    for (size_t m = 0; m < models.size(); ++m) {
+        OpenGLModelResources& resources = mModelResources.at(models[m]);
+        std::copy(mCullResults.begin() + firstShapes[m], mCullResults.begin() + firstShapes[m + 1], resources.inFrustum.begin());
+    }
+    // Wireframe shows what's behind, nothing may be occluded there
+    mOccludedShapes = 0;
+    if (mOcclusionCulling && mCurrentShader.first != SHADER_TYPE::Wireframe) cullOccluded(models, firstShapes, viewMatrix, projectionMatrix);
+    mCulledShapes = mCullBounds.count - visible + mOccludedShapes;
+    for (size_t m = 0; m < models.size(); ++m) {
+        OpenGLModelResources& resources = mModelResources.at(models[m]);
+        std::copy(mCullResults.begin() + firstShapes[m], mCullResults.begin() + firstShapes[m + 1], resources.inView.begin());
+    }
 }
 
-void OpenGLRender::loadTexture(const std::string& path, GLuint& textureID) {
-    // Learn from: https://learnopengl-cn.github.io/01%20Getting%20started/06%20Textures/
-
-    stbi_set_flip_vertically_on_load(true);
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);        
+void OpenGLRender::cullOccluded(const std::vector<ModelPtr>& models, const std::vector<size_t>& firstShapes,
+                                const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
+    // Occluders are shapes whose bounding sphere spans at least this much of the screen height
+    constexpr float kMinOccluderSize = 0.1f;
+    constexpr size_t kMaxOccluders = 64;
+    constexpr size_t kOccluderTriangles = 65536;
+
+    struct Occluder {
+        float size;
+        float maxError;     // Coarsest LOD allowed, in model units
+        size_t model, shape;
+    };
+    std::vector<Occluder> occluders;
+    bool perspective = projectionMatrix[3][3] == 0.0f;
+    for (size_t m = 0; m < models.size(); ++m) {
+        // Instances may be hidden or selected away from the shading pass, only plain models occlude
+        const OpenGLModelResources& resources = mModelResources.at(models[m]);
+        if (resources.instanced) continue;
+        const glm::mat4& modelMatrix = models[m]->getModelMatrix();
+        float scale = maxScale(modelMatrix);
+        for (size_t i = 0; i < resources.shapes.size(); ++i) {
+            size_t k = firstShapes[m] + i;
+            if (!mCullResults[k] || !models[m]->isShapeVisible(i) || resources.primitives[i] != GL_TRIANGLES) continue;
+            glm::vec3 center(mCullBounds.centerX[k], mCullBounds.centerY[k], mCullBounds.centerZ[k]);
+            float distance = perspective ? std::max(-(viewMatrix * glm::vec4(center, 1.0f)).z, 1e-3f) : 1.0f;
+            float unitsPerNDC = distance / projectionMatrix[1][1];
+            float size = mCullBounds.radius[k] / unitsPerNDC;
+            // Half a texel of the occlusion buffer, its rows span 2 NDC units
+            if (size >= kMinOccluderSize) occluders.push_back({size, unitsPerNDC / static_cast<float>(mOcclusion.getHeight()) / scale, m, i});
+        }
+    }
+    if (occluders.empty()) return;
+
+    std::sort(occluders.begin(), occluders.end(), [](const Occluder& a, const Occluder& b) { return a.size > b.size; });
+    mOcclusion.begin(projectionMatrix * viewMatrix);
+    size_t used = 0, triangles = 0;
+    for (const Occluder& occluder : occluders) {
+        if (used == kMaxOccluders) break;
+        // Coarsest level that stays within half a texel, the buffer can't resolve more
+        const Shape& shape = *mModelResources.at(models[occluder.model]).shapes[occluder.shape];
+        const std::vector<uint32_t>* indices = &shape.indices;
+        for (const ShapeLOD& lod : shape.lods) {
+            if (lod.error > occluder.maxError) break;
+            indices = &lod.indices;
+        }
+        size_t count = indices->size() / 3;
+        if (triangles + count > kOccluderTriangles) continue;
+        mOcclusion.addOccluder(shape.vertices, *indices, 0, indices->size(), models[occluder.model]->getModelMatrix());
+        triangles += count;
+        used++;
+    }
+    if (used == 0) return;
+    mOcclusion.rasterize();
+
+    std::atomic<size_t> occluded{0};
+    parallelFor(mCullBounds.count, 1024, [&](size_t begin, size_t end) {
+        size_t count = 0;
+        for (size_t k = begin; k < end; ++k) {
+            if (!mCullResults[k]) continue;
+            glm::vec3 center(mCullBounds.centerX[k], mCullBounds.centerY[k], mCullBounds.centerZ[k]);
+            glm::vec3 extent(mCullBounds.extentX[k], mCullBounds.extentY[k], mCullBounds.extentZ[k]);
+            if (!mOcclusion.isVisible(center, extent)) {
+                mCullResults[k] = 0;
+                count++;
+            }
+        }
+        occluded += count;
+    });
+    mOccludedShapes = occluded;
+}
+
+void OpenGLRender::selectLODs(OpenGLModelResources& resources, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                              float viewportHeight) const {
+    // A coarser level is only taken once its error is this far below the threshold, so levels don't flicker at the boundary
+    constexpr float kLODHysteresis = 0.75f;
+
+    const glm::mat4& modelMatrix = resources.referenceMatrix;
+    float scale = maxScale(modelMatrix);
+    bool perspective = projectionMatrix[3][3] == 0.0f;
+    float pixelsPerUnit = projectionMatrix[1][1] * viewportHeight * 0.5f;      // At distance 1 for perspective
+
+    for (size_t i = 0; i < resources.lods.size(); ++i) {
+        const std::vector<OpenGLLOD>& levels = resources.lods[i];
+        if (levels.size() <= 1 || mLODErrorThreshold <= 0.0f) {
+            resources.currentLODs[i] = 0;
+            continue;
+        }
+
+        // Error in pixels at the sphere's nearest point to the camera
+        float projection = scale * pixelsPerUnit;
+        if (perspective) {
+            glm::vec3 center = glm::vec3(viewMatrix * modelMatrix * glm::vec4(glm::vec3(resources.boundingSpheres[i]), 1.0f));
+            float distance = -center.z - resources.boundingSpheres[i].w * scale;
+            projection /= std::max(distance, 1e-3f);
+        }
+
+        size_t target = 0;
+        while (target + 1 < levels.size() && levels[target + 1].error * projection <= mLODErrorThreshold) target++;
+        size_t& current = resources.currentLODs[i];
+        while (target > current && levels[target].error * projection > mLODErrorThreshold * kLODHysteresis) target--;
+        current = target;
+    }
+}
+
+void OpenGLRender::requestTextures(const ModelPtr& model, const OpenGLModelResources& resources, const glm::mat4& viewMatrix,
+                                   const glm::mat4& projectionMatrix, float viewportHeight) {
+    const glm::mat4& modelMatrix = resources.referenceMatrix;
+    float scale = maxScale(modelMatrix);
+    bool perspective = projectionMatrix[3][3] == 0.0f;
+    float pixelsPerUnit = projectionMatrix[1][1] * viewportHeight * 0.5f;      // At distance 1 for perspective
+
+    for (size_t i = 0; i < resources.textures.size(); ++i) {
+        if (!resources.textures[i] || !model->isShapeVisible(i) || !resources.inView[i]) continue;
+
+        // Projected diameter of the bounding sphere, shapes behind the camera only keep their coarse levels
+        const glm::vec4& sphere = resources.boundingSpheres[i];
+        float pixels = 2.0f * sphere.w * scale * pixelsPerUnit;
+        if (perspective) {
+            glm::vec3 center = glm::vec3(viewMatrix * modelMatrix * glm::vec4(glm::vec3(sphere), 1.0f));
+            if (-center.z + sphere.w * scale <= 0.0f) continue;
+            pixels /= std::max(-center.z, 1e-3f);
+        }
+        mTextures.request(resources.textures[i], pixels);
+    }
+}
+
+void OpenGLRender::cullMeshlets(const ModelPtr& model, OpenGLModelResources& resources, const glm::mat4& viewMatrix,
+                                const glm::mat4& projectionMatrix) const {
+    // Everything is tested in model space: frustum planes of the full MVP, and the camera position (or direction)
+    glm::mat4 modelView = viewMatrix * model->getModelMatrix();
+    std::array<glm::vec4, 6> planes = extractFrustumPlanes(projectionMatrix * modelView);
+
+    // Backface tests are exact in model space (face normals and view vectors transform inversely), unless mirrored
+    glm::mat4 inverseModelView = glm::inverse(modelView);
+    bool perspective = projectionMatrix[3][3] == 0.0f;
+    glm::vec3 cameraPosition = glm::vec3(inverseModelView * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    glm::vec3 viewDirection = glm::normalize(glm::vec3(inverseModelView * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f)));
+    bool coneCulling = mConeCulling && glm::determinant(glm::mat3(model->getModelMatrix())) > 0.0f;
+
+    for (size_t i = 0; i < resources.meshletDraws.size(); ++i) {
+        const std::vector<Meshlet>& meshlets = model->getMeshlets(i);
+        std::vector<GLsizei>& counts = resources.visibleCounts[i];
+        std::vector<const void*>& offsets = resources.visibleOffsets[i];
+        counts.clear();
+        offsets.clear();
+        // Instances share one draw, so their meshlets aren't culled
+        resources.meshletDraws[i] = !meshlets.empty() && resources.currentLODs[i] == 0 && !resources.instanced && resources.inView[i];
+        if (!resources.meshletDraws[i]) continue;
+
+        size_t rangeEnd = ~size_t(0);
+        for (const Meshlet& meshlet : meshlets) {
+            glm::vec3 center(meshlet.boundingSphere);
+            float radius = meshlet.boundingSphere.w;
+
+            bool visible = true;
+            for (const auto& plane : planes) {
+                if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) { visible = false; break; }
+            }
+            if (visible && coneCulling && meshlet.cone.w < 1.0f) {
+                glm::vec3 axis(meshlet.cone);
+                if (perspective) {
+                    glm::vec3 toCenter = center - cameraPosition;
+                    visible = glm::dot(toCenter, axis) < meshlet.cone.w * glm::length(toCenter) + radius;
+                } else {
+                    visible = glm::dot(viewDirection, axis) < meshlet.cone.w;
+                }
+            }
+            if (!visible) continue;
+
+            if (meshlet.indexOffset == rangeEnd) {
+                counts.back() += static_cast<GLsizei>(meshlet.indexCount);
+            } else {
+                counts.push_back(static_cast<GLsizei>(meshlet.indexCount));
+                offsets.push_back((void*)((resources.firstIndices[i] + meshlet.indexOffset) * sizeof(uint32_t)));
+            }
+            rangeEnd = meshlet.indexOffset + meshlet.indexCount;
+        }
+    }
+}
+
+void OpenGLRender::drawShape(const ShaderProgram& shader, const OpenGLShaderUniforms& uniforms, const OpenGLModelResources& resources,
+                             size_t shapeIndex, GLsizei firstInstance, GLsizei instanceCount) {
+    const OpenGLVertexDecode& decode = resources.decodes[shapeIndex];
+    shader.set(uniforms.positionOffset, decode.positionOffset);
+    shader.set(uniforms.positionScale, decode.positionScale);
+    shader.set(uniforms.octNormals, decode.octNormals);
+
+    // All instances of the shape in one call
+    if (instanceCount > 0) {
+        auto baseInstance = static_cast<GLuint>(firstInstance);
+        if (resources.primitives[shapeIndex] == GL_POINTS) {
+            glDrawArraysInstancedBaseInstance(GL_POINTS, 0, static_cast<GLsizei>(resources.drawCounts[shapeIndex]), instanceCount, baseInstance);
+        } else {
+            const OpenGLLOD& lod = resources.lods[shapeIndex][resources.currentLODs[shapeIndex]];
+            glDrawElementsInstancedBaseInstance(GL_TRIANGLES, static_cast<GLsizei>(lod.indexCount), GL_UNSIGNED_INT,
+                                                (void*)((resources.firstIndices[shapeIndex] + lod.indexOffset) * sizeof(uint32_t)),
+                                                instanceCount, baseInstance);
+        }
+        return;
+    }
+
+    if (resources.primitives[shapeIndex] == GL_POINTS) {
+        glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(resources.drawCounts[shapeIndex]));
+    } else if (resources.meshletDraws[shapeIndex]) {
+        const std::vector<GLsizei>& counts = resources.visibleCounts[shapeIndex];
+        if (counts.empty()) return;
+        glMultiDrawElements(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, resources.visibleOffsets[shapeIndex].data(),
+                            static_cast<GLsizei>(counts.size()));
     } else {
-        std::cerr << "Failed to load texture: " << path << std::endl;
+        const OpenGLLOD& lod = resources.lods[shapeIndex][resources.currentLODs[shapeIndex]];
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(lod.indexCount), GL_UNSIGNED_INT,
+                       (void*)((resources.firstIndices[shapeIndex] + lod.indexOffset) * sizeof(uint32_t)));
+    }
+}
+
+void OpenGLRender::resetInstanceAttributes() {
+    // Non-instanced draws read the instance attributes' current values: an identity matrix and instance 0
+    glVertexAttrib4f(4, 1.0f, 0.0f, 0.0f, 0.0f);
+    glVertexAttrib4f(5, 0.0f, 1.0f, 0.0f, 0.0f);
+    glVertexAttrib4f(6, 0.0f, 0.0f, 1.0f, 0.0f);
+    glVertexAttrib4f(7, 0.0f, 0.0f, 0.0f, 1.0f);
+    glVertexAttribI4ui(8, 0, 0, 0, 0);
+    glVertexAttrib3f(9, 1.0f, 0.0f, 0.0f);
+    glVertexAttrib3f(10, 0.0f, 1.0f, 0.0f);
+    glVertexAttrib3f(11, 0.0f, 0.0f, 1.0f);
+}
+
+void OpenGLRender::updateFrameBlocks(const std::vector<ModelPtr>& models, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
+    OpenGLCameraBlock camera{viewMatrix, projectionMatrix, projectionMatrix * viewMatrix};
+    glBindBuffer(GL_UNIFORM_BUFFER, mCameraUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(camera), &camera);
+
+    mObjectData.assign(std::max<size_t>(models.size(), 1) * mObjectStride, 0);
+    mObjects.resize(models.size());
+    for (size_t i = 0; i < models.size(); ++i) {
+        OpenGLObjectBlock object{models[i]->getModelMatrix(), normalMatrix(models[i]->getModelMatrix())};
+        mObjects[i] = object;
+        std::memcpy(mObjectData.data() + i * mObjectStride, &object, sizeof(object));
+        mModelResources.at(models[i]).objectOffset = static_cast<GLintptr>(i * mObjectStride);
     }
+    // Orphan last frame's storage rather than wait for draws still reading it
+    glBindBuffer(GL_UNIFORM_BUFFER, mObjectUBO);
+    glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(mObjectData.size()), mObjectData.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
 
-    stbi_image_free(data);
-    glBindTexture(GL_TEXTURE_2D, 0);
-}
\ No newline at end of file
+void OpenGLRender::bindObjectBlock(const OpenGLModelResources& resources) const {
+    glBindBufferRange(GL_UNIFORM_BUFFER, kObjectBlockBinding, mObjectUBO, resources.objectOffset, sizeof(OpenGLObjectBlock));
+}
@@ -1,14 +1,211 @@
 #pragma once
 
+#include <tuple>
 #include <vector>
 #include <glad/glad.h>
 #include "render.h"
+#include "buffer_arena_OpenGL.h"
+#include "culling.h"
+#include "occlusion.h"
+#include "texture_OpenGL.h"
+
+// How the vertex shaders decode a shape's vertex buffer
+struct OpenGLVertexDecode {
+    glm::vec3 positionOffset = glm::vec3(0.0f);     // Quantized positions are offset + scale * [0, 1]
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    bool octNormals = false;
+};
+
+// A range of a shape's element buffer
+struct OpenGLLOD {
+    size_t indexOffset = 0;
+    size_t indexCount = 0;
+    float error = 0.0f;     // Deviation from the full-detail shape, in model units
+};
+
+// std140 uniform blocks shared by all programs, at fixed binding points (the Camera and Object blocks in the shaders)
+constexpr GLuint kCameraBlockBinding = 0;
+constexpr GLuint kObjectBlockBinding = 1;
+
+// Written once per frame
+struct OpenGLCameraBlock {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+};
+
+// One per model, all in one buffer written once per frame and bound by range
+struct OpenGLObjectBlock {
+    glm::mat4 model;
+    glm::mat4 normalMatrix;     // Inverse transpose of the upper 3x3, so vertex shaders don't invert per vertex
+};
+
+// Uniforms of the OpenGL shaders, resolved once per program (invalid where a program lacks one)
+struct OpenGLShaderUniforms {
+    OpenGLShaderUniforms() = default;
+    explicit OpenGLShaderUniforms(const ShaderProgram& shader);
+
+    Uniform<glm::vec3> positionOffset, positionScale;
+    Uniform<bool> octNormals;
+    Uniform<bool> hasTexture, hasNormal, hasColor, isPoint;
+    Uniform<int> textureDiffuse;
+    Uniform<int> modelIdx;
+    Uniform<float> offset;
+    Uniform<unsigned int> firstCommand;
+    // Compute programs of GPU culling
+    Uniform<int> sourceLevel;
+    Uniform<unsigned int> commandCount, threadCount;
+    Uniform<glm::mat4> viewProjection, hiZViewProjection;
+    Uniform<glm::vec2> hiZViewport;
+    Uniform<bool> occlusion;
+    // Post passes of the outline
+    Uniform<int> jump;
+    Uniform<bool> fromMask;
+    Uniform<float> width;
+    Uniform<glm::vec2> viewportOrigin;
+};
+
+// Storage buffer bindings of the indirect path, see vertex.glsl. Vertices are read from the arena block of the batch.
+constexpr GLuint kSceneVerticesBinding = 0;
+constexpr GLuint kDrawRecordsBinding = 1;
+constexpr GLuint kCommandRecordsBinding = 2;
+constexpr GLuint kObjectsBinding = 3;
+constexpr GLuint kInstancesBinding = 4;
+constexpr GLuint kInstanceIndicesBinding = 5;
+
+// Further bindings of cull.comp, which also reads the objects and instances
+constexpr GLuint kCullCommandsBinding = 6;
+constexpr GLuint kCulledCommandsBinding = 7;
+constexpr GLuint kCulledInstancesBinding = 8;
+
+// FLAG_* in common.glsl
+enum OpenGLDrawFlags : uint32_t {
+    kDrawFlagTexture = 1,
+    kDrawFlagNormal = 2,
+    kDrawFlagColor = 4,
+    kDrawFlagPoint = 8,
+    kDrawFlagQuantized = 16,
+    kDrawFlagOctNormals = 32,
+};
+
+// Where the indirect path finds a shape of a model, per frame (std430 DrawRecord in vertex.glsl).
+// Offsets and strides are in 4-byte words of the shape's arena block.
+struct OpenGLDrawRecord {
+    glm::vec4 positionOffset;
+    glm::vec4 positionScale;
+    uint32_t vertexBase;
+    uint32_t vertexStride;
+    uint32_t normalOffset;      // 0 if missing
+    uint32_t texCoordOffset;
+    uint32_t colorOffset;
+    uint32_t flags;             // OpenGLDrawFlags
+    uint32_t object;            // Index of the model
+    uint32_t pickId;
+};
+
+// glMultiDrawElementsIndirect command. Point commands use the glMultiDrawArraysIndirect layout in the first four
+// fields, so both kinds share one buffer and stride. The base instance indexes the instance indices, not the instances.
+struct OpenGLDrawCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;           // First index, or first vertex
+    GLint baseVertex;       // Base instance of point commands
+    GLuint baseInstance;
+};
+
+// A queued command as cull.comp sees it (std430 CullCommand), with the bounds of its shape
+struct OpenGLCullCommand {
+    glm::vec4 center;           // Model-space box center, bounding sphere radius in w
+    glm::vec4 extent;           // Half size of the box, w unused
+    uint32_t command;           // Into the frame's commands, the culled one has the same index
+    uint32_t firstInstance;     // Of the queued command
+    uint32_t firstThread;       // Invocation of the first instance, also where its survivors' indices start
+    uint32_t object;
+};
+
+// One shape of one model in one pass of the per-VAO path, drawn in key order
+struct OpenGLDrawPacket {
+    uint64_t key;               // Pass, program, texture, buffer, depth from most to least significant
+    uint32_t model;             // Into the frame's model list
+    uint32_t shape;
+    GLsizei firstInstance;
+    GLsizei instanceCount;      // 0 draws the model without instancing
+};
+
+// Consecutive commands drawn by one multi-draw call
+struct OpenGLDrawBatch {
+    GLuint buffer = 0;      // Arena block holding the vertices and indices
+    bool points = false;
+    GLuint texture = 0;
+    size_t firstCommand = 0;
+    size_t commandCount = 0;
+};
+
+// GPU copy of a shape, shared by every model that uses the same ShapePtr
+struct OpenGLShapeBuffers {
+    ShapePtr shape;         // Keeps the key alive
+    size_t users = 0;       // Models holding the buffers
+    // One arena allocation: the vertices, then the indices of all LODs
+    uint32_t allocation = OpenGLBufferArena::kInvalidHandle;
+    GLuint buffer = 0;          // Arena block, refreshed by locateShapeBuffers
+    size_t vertexOffset = 0;    // In bytes
+    size_t firstIndex = 0;      // Of the full-detail indices, counted from the start of the block
+    bool pullable = true;       // Fits one storage buffer binding, else the indirect path draws it through its VAO
+    size_t drawCount = 0;   // Index count, or vertex count for point clouds
+    GLenum primitive = GL_TRIANGLES;
+    OpenGLVertexDecode decode;
+    std::vector<OpenGLLOD> lods;
+    size_t vertexBytes = 0;
+    glm::vec4 boundingSphere = glm::vec4(0.0f);    // Around the center of the AABB
+    glm::vec3 boxExtent = glm::vec3(0.0f);          // Half size of the AABB
+    // Vertex layout for the models' VAOs, offset 0 marks a missing attribute (the position is always first)
+    size_t stride = 0;
+    size_t normalOffset = 0;
+    size_t texCoordOffset = 0;
+    size_t colorOffset = 0;
+};
+
+// Per-instance vertex data of instanced models (attributes 4-7, 8 and 9-11)
+struct OpenGLInstance {
+    glm::mat4 matrix;
+    uint32_t index;         // Into the model's instances, for picking
+    uint32_t padding[3];
+    glm::mat4 normalMatrix; // Upper 3x3 only
+};
 
 struct OpenGLModelResources {
     std::vector<GLuint> VAOs;
-    std::vector<GLuint> VBOs;
-    std::vector<GLuint> textures;
-    std::vector<size_t> vertexCounts;
+    std::vector<ShapePtr> shapes;       // Their buffers are in OpenGLRender::mShapeBuffers, one reference per shape
+    std::vector<GLuint> textures;       // Owned by the texture manager, one reference per shape
+    std::vector<size_t> drawCounts;     // Index count, or vertex count for point clouds
+    std::vector<GLenum> primitives;
+    std::vector<OpenGLVertexDecode> decodes;
+    std::vector<std::vector<OpenGLLOD>> lods;   // Level 0 is the full-detail shape
+    std::vector<size_t> currentLODs;            // Level drawn last frame, for hysteresis
+    std::vector<glm::vec4> boundingSpheres;     // Center and radius in model space
+    std::vector<glm::vec3> boxExtents;          // Half size of the AABB around the sphere's center
+    // Bounds frustum culling tests, in model space: the shape's own, or around all visible instances of it
+    std::vector<glm::vec4> cullSpheres;
+    std::vector<glm::vec3> cullExtents;
+    std::vector<uint8_t> inView;                // In the frustum and not occluded this frame, culled shapes skip every pass
+    std::vector<uint8_t> inFrustum;             // Only in the frustum, what the outline pass draws: the outline shows through
+    // Meshlet ranges of the full-detail level that survived culling this frame, merged where contiguous
+    std::vector<bool> meshletDraws;             // Whether the shape is drawn from these ranges this frame
+    std::vector<std::vector<GLsizei>> visibleCounts;
+    std::vector<std::vector<const void*>> visibleOffsets;     // Byte offsets in the shape's arena block
+    std::vector<size_t> firstIndices;           // Of each shape in its arena block, as bound in its VAO
+    // Instancing: visible instances, the selected ones first, shared by the VAOs of all shapes
+    GLuint instanceVBO = 0;
+    bool instanced = false;                     // Whether the instance attributes are enabled in the VAOs
+    uint64_t instanceVersion = ~uint64_t(0);    // Model::getInstanceVersion() the buffer was built from
+    GLsizei visibleInstances = 0;
+    GLsizei selectedInstances = 0;
+    glm::vec4 modelSphere = glm::vec4(0.0f);    // Bounds of all shapes, in model space
+    glm::mat4 referenceMatrix = glm::mat4(1.0f);    // Model matrix of the nearest instance, for LODs and textures
+    GLintptr objectOffset = 0;                  // Of the model's OpenGLObjectBlock in the object buffer
+    // Indirect path, per frame
+    uint32_t firstRecord = 0;                   // Draw record of shape 0
+    uint32_t firstInstance = 0;                 // In the instance storage buffer, entry 0 is the identity instance of non-instanced models
 };
 
 class OpenGLRender : public Render {
@@ -33,7 +230,138 @@ public:
     [[nodiscard]] RENDERER_TYPE getType() const override;
     
 private:
-    static void loadTexture(const std::string& path, GLuint& textureID);
+    const OpenGLShapeBuffers& acquireShapeBuffers(const ShapePtr& shape);
+    void releaseShapeBuffers(const ShapePtr& shape);
+    // Point a shape's VAO at its arena range
+    void bindShapeVertices(OpenGLModelResources& resources, size_t shapeIndex) const;
+    // Refresh every shape's arena range and VAOs after the arena moved ranges
+    void locateShapeBuffers();
+    void updateInstances(const ModelPtr& model, OpenGLModelResources& resources, const glm::mat4& viewMatrix) const;
+    // Test every shape's bounds against the frustum, then against the occluders, fills OpenGLModelResources::inFrustum
+    // with the first and inView with both
+    void cullShapes(const std::vector<ModelPtr>& models, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+    // Rasterize the largest shapes in the frustum into mOcclusion and clear mCullResults of the shapes they hide
+    void cullOccluded(const std::vector<ModelPtr>& models, const std::vector<size_t>& firstShapes,
+                      const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+    void selectLODs(OpenGLModelResources& resources, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                    float viewportHeight) const;
+    void requestTextures(const ModelPtr& model, const OpenGLModelResources& resources, const glm::mat4& viewMatrix,
+                         const glm::mat4& projectionMatrix, float viewportHeight);
+    void cullMeshlets(const ModelPtr& model, OpenGLModelResources& resources, const glm::mat4& viewMatrix,
+                      const glm::mat4& projectionMatrix) const;
+    // Draw one shape, instances [firstInstance, firstInstance + instanceCount) of an instanced model
+    static void drawShape(const ShaderProgram& shader, const OpenGLShaderUniforms& uniforms, const OpenGLModelResources& resources,
+                          size_t shapeIndex, GLsizei firstInstance = 0, GLsizei instanceCount = 0);
+    static void resetInstanceAttributes();
+    // Write the camera block and the object blocks of all models
+    void updateFrameBlocks(const std::vector<ModelPtr>& models, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+    void bindObjectBlock(const OpenGLModelResources& resources) const;
+
+    enum class RenderPass { Shading, Outline, Index };
+    // Instances of a model drawn in a pass (count 1 without instancing), false if the pass skips the model
+    bool passInstances(const ModelPtr& model, const OpenGLModelResources& resources, RenderPass pass,
+                       GLsizei& firstInstance, GLsizei& instanceCount) const;
+    // Queue a packet per visible shape of the shading and outline passes, sorted by key. With `unpulledOnly`, only
+    // the shapes the indirect path can't pull.
+    void queueDrawPackets(const std::vector<ModelPtr>& models, const glm::mat4& viewMatrix, bool unpulledOnly = false);
+    // Draw the queued packets of one pass, returns the binds made. The caller wraps the outline pass in begin/endOutline.
+    size_t submitDrawPackets(const std::vector<ModelPtr>& models, RenderPass pass);
+    [[nodiscard]] bool hasOutlinePackets() const;
+
+    // Indirect path (render_OpenGL_indirect.cpp)
+    [[nodiscard]] bool useIndirectDraws() const { return mIndirectDraws && mIndirectSupported; }
+    void initIndirect();
+    // Objects, instances and draw records of all models, then clear the commands
+    void beginIndirectFrame(const std::shared_ptr<Scene>& scene, const std::vector<ModelPtr>& models);
+    void updateIndirectInstances(const std::vector<ModelPtr>& models);
+    // Append the commands of a pass, grouped by primitive and texture
+    std::vector<OpenGLDrawBatch> queueRenderPass(const std::vector<ModelPtr>& models, RenderPass pass);
+    void uploadIndirectCommands();
+    // Returns the buffer and texture binds made. Batches index into `commandBuffer`.
+    size_t drawIndirectBatches(const ShaderProgram& shader, const OpenGLShaderUniforms& uniforms, const std::vector<OpenGLDrawBatch>& batches,
+                               GLuint commandBuffer);
+
+    // GPU culling of the indirect path (render_OpenGL_gpu_culling.cpp)
+    [[nodiscard]] bool useGPUCulling() const { return useIndirectDraws() && mGPUCulling && mGPUCullingSupported; }
+    void initGPUCulling();
+    // Cull every instance of the batches' commands on the GPU, the outline's aren't as it shows through. The culled commands in mCulledCommandBuffer keep the
+    // indices of the queued ones, with only the surviving instances.
+    void cullIndirectCommands(const std::vector<std::vector<OpenGLDrawBatch>*>& passes, const glm::mat4& viewProjection);
+    // Copy the depth buffer and rebuild the Hi-Z pyramid from it, for the next frame's culling
+    void updateHiZ(const glm::mat4& viewProjection);
 
+    // Screen-space outline of the selection (render_OpenGL_outline.cpp)
+    void initOutline();
+    // Send the outline pass into the selection mask, draw it with the Outline program right after
+    void beginOutline();
+    // Flood the mask and blend the outline over the frame the pass was redirected from
+    void endOutline();
+
+    std::unordered_map<SHADER_TYPE, OpenGLShaderUniforms> mUniforms;
+    GLuint mCameraUBO = 0;
+    GLuint mObjectUBO = 0;
+    size_t mObjectStride = sizeof(OpenGLObjectBlock);    // Rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    std::vector<unsigned char> mObjectData;
     std::unordered_map<ModelPtr, OpenGLModelResources> mModelResources;
+    std::unordered_map<const Shape*, OpenGLShapeBuffers> mShapeBuffers;
+    CullBounds mCullBounds;
+    std::vector<uint8_t> mCullResults;
+    OcclusionBuffer mOcclusion;
+    std::vector<OpenGLDrawPacket> mDrawPackets;
+    std::vector<OpenGLDrawPacket> mPacketScratch;
+    size_t mUnsortedStateChanges = 0;   // Binds the frame's packets would need in model order
+    OpenGLBufferArena mGeometryArena;
+    bool mDefragmentPending = false;    // Set when shapes are released, handled before the next frame
+    size_t mMaxStorageBlockBytes = SIZE_MAX;   // GL_MAX_SHADER_STORAGE_BLOCK_SIZE, the most vertex pulling can bind
+    size_t mUnpulledShapes = 0;         // Shape buffers past that
+
+    // Indirect path
+    bool mIndirectSupported = false;
+    std::unordered_map<SHADER_TYPE, std::shared_ptr<ShaderProgram>> mIndirectShaders;    // Vertex pulling variants
+    std::unordered_map<SHADER_TYPE, OpenGLShaderUniforms> mIndirectUniforms;
+    GLuint mIndirectVAO = 0;            // No attributes, only the element buffer of the batch's arena block
+    GLuint mDrawRecordBuffer = 0;
+    GLuint mCommandRecordBuffer = 0;
+    GLuint mObjectBuffer = 0;
+    GLuint mInstanceBuffer = 0;
+    GLuint mInstanceIndexBuffer = 0;    // Identity, for draws that aren't culled on the GPU
+    GLuint mCommandBuffer = 0;
+    std::vector<OpenGLDrawRecord> mDrawRecords;
+    std::vector<OpenGLDrawCommand> mDrawCommands;
+    std::vector<uint32_t> mCommandRecords;
+    std::vector<OpenGLObjectBlock> mObjects;    // Tightly packed, filled by updateFrameBlocks
+    std::vector<std::tuple<const Model*, GLuint, uint64_t>> mInstanceLayout;    // Instanced models, buffers and versions the instances came from
+    std::vector<glm::vec4> mRecordSpheres;      // Model-space bounds of each draw record's shape
+    std::vector<glm::vec3> mRecordExtents;
+
+    // GPU culling
+    bool mGPUCullingSupported = false;
+    std::shared_ptr<ShaderProgram> mCullShader;
+    std::shared_ptr<ShaderProgram> mHiZShader;
+    OpenGLShaderUniforms mCullUniforms;
+    OpenGLShaderUniforms mHiZUniforms;
+    GLuint mCullCommandBuffer = 0;
+    GLuint mCulledCommandBuffer = 0;
+    GLuint mCulledInstanceBuffer = 0;   // Indices of the surviving instances, one range per command
+    std::vector<OpenGLCullCommand> mCullCommands;
+    std::vector<OpenGLDrawCommand> mCulledCommands;
+    GLuint mDepthCopy = 0;              // Depth of the last shading pass
+    GLuint mHiZTexture = 0;             // Max-depth pyramid, level 0 is half the viewport
+    glm::ivec2 mHiZSize = glm::ivec2(0);    // Of the viewport the textures were made for
+    bool mHiZValid = false;
+    glm::mat4 mHiZViewProjection = glm::mat4(1.0f);
+
+    // Outline
+    std::shared_ptr<ShaderProgram> mFloodShader;
+    std::shared_ptr<ShaderProgram> mCompositeShader;
+    OpenGLShaderUniforms mFloodUniforms;
+    OpenGLShaderUniforms mCompositeUniforms;
+    GLuint mScreenVAO = 0;              // No attributes, for full-screen triangles
+    GLuint mOutlineMask = 0;            // R8, non-zero where the selection is
+    GLuint mOutlineSeeds[2] = {};       // RG16I, ping-ponged by the flood passes
+    GLuint mOutlineFramebuffers[3] = {};    // Mask, then both seed textures
+    glm::ivec2 mOutlineSize = glm::ivec2(0);
+    GLint mOutlineTarget = 0;           // Draw framebuffer and viewport beginOutline redirected from
+    GLint mOutlineViewport[4] = {};
+    OpenGLTextureManager mTextures;     // Shared between models, released per shape in cleanModel/cleanup
 };
@@ -0,0 +1,147 @@
+#include <glad/glad.h>
+#include "render_OpenGL.h"
+#include "utils/file.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// GPU culling of the indirect path: cull.comp tests every instance of every shading command against the frustum and
+// a max-depth pyramid of the previous frame's depth buffer (hiz.comp), packs the indices of the survivors into the
+// command's range and counts them into its copy in mCulledCommandBuffer. Commands are never read back, one that lost
+// all its instances stays in its multi-draw and draws nothing.
+// The pyramid lags a frame, so an object uncovered by a moving occluder may show up one frame late.
+
+namespace {
+
+constexpr GLuint kCullGroupSize = 64;       // local_size_x of cull.comp
+constexpr GLuint kHiZGroupSize = 8;         // Of hiz.comp, in both dimensions
+constexpr GLuint kMaxGroups = 65535;        // Per dimension of a dispatch
+
+// Orphan `buffer` and fill it with `size` bytes of `data`, undefined without data
+void uploadStorage(GLuint buffer, size_t size, const void* data) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(std::max<size_t>(size, 4)), size ? data : nullptr, GL_STREAM_DRAW);
+}
+
+}
+
+void OpenGLRender::initGPUCulling() {
+    mCullShader = ShaderProgram::createCompute(findFile("assets/shaders/glsl/cull.comp"));
+    mHiZShader = ShaderProgram::createCompute(findFile("assets/shaders/glsl/hiz.comp"));
+    mGPUCullingSupported = mCullShader->isLinked() && mHiZShader->isLinked();
+    if (!mGPUCullingSupported) {
+        std::cout << "GPU culling is not supported, culling on the CPU only" << std::endl;
+        return;
+    }
+    mCullUniforms = OpenGLShaderUniforms(*mCullShader);
+    mHiZUniforms = OpenGLShaderUniforms(*mHiZShader);
+    GLuint* buffers[] = { &mCullCommandBuffer, &mCulledCommandBuffer, &mCulledInstanceBuffer };
+    for (GLuint* buffer : buffers) glGenBuffers(1, buffer);
+}
+
+void OpenGLRender::cullIndirectCommands(const std::vector<std::vector<OpenGLDrawBatch>*>& passes, const glm::mat4& viewProjection) {
+    // Culled commands start as the queued ones without instances, and point at their own range of instance indices,
+    // as large as the command's instances. One invocation per instance.
+    mCullCommands.clear();
+    mCulledCommands = mDrawCommands;
+    uint32_t threads = 0;
+    for (const std::vector<OpenGLDrawBatch>* batches : passes) {
+        for (const OpenGLDrawBatch& batch : *batches) {
+            for (size_t c = batch.firstCommand; c < batch.firstCommand + batch.commandCount; ++c) {
+                uint32_t record = mCommandRecords[c];
+                OpenGLDrawCommand& culled = mCulledCommands[c];
+                OpenGLCullCommand command{};
+                command.center = mRecordSpheres[record];
+                command.extent = glm::vec4(mRecordExtents[record], 0.0f);
+                command.command = static_cast<uint32_t>(c);
+                command.firstInstance = batch.points ? static_cast<uint32_t>(culled.baseVertex) : culled.baseInstance;
+                command.firstThread = threads;
+                command.object = mDrawRecords[record].object;
+                mCullCommands.push_back(command);
+                if (batch.points) culled.baseVertex = static_cast<GLint>(threads);
+                else culled.baseInstance = threads;
+                threads += culled.instanceCount;
+                culled.instanceCount = 0;
+            }
+        }
+    }
+
+    uploadStorage(mCullCommandBuffer, mCullCommands.size() * sizeof(OpenGLCullCommand), mCullCommands.data());
+    uploadStorage(mCulledCommandBuffer, mCulledCommands.size() * sizeof(OpenGLDrawCommand), mCulledCommands.data());
+    uploadStorage(mCulledInstanceBuffer, threads * sizeof(uint32_t), nullptr);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kCullCommandsBinding, mCullCommandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kCulledCommandsBinding, mCulledCommandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kCulledInstancesBinding, mCulledInstanceBuffer);
+    // The vertex shaders now find their instances through the compacted indices
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kInstanceIndicesBinding, mCulledInstanceBuffer);
+    if (threads == 0) return;
+
+    // Wireframe shows what's behind, nothing may be occluded there
+    bool occlusion = mHiZValid && mCurrentShader.first != SHADER_TYPE::Wireframe;
+    mCullShader->use();
+    mCullShader->set(mCullUniforms.commandCount, static_cast<unsigned int>(mCullCommands.size()));
+    mCullShader->set(mCullUniforms.threadCount, threads);
+    mCullShader->set(mCullUniforms.viewProjection, viewProjection);
+    mCullShader->set(mCullUniforms.hiZViewProjection, mHiZViewProjection);
+    mCullShader->set(mCullUniforms.hiZViewport, glm::vec2(mHiZSize));
+    mCullShader->set(mCullUniforms.occlusion, occlusion);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, occlusion ? mHiZTexture : 0);
+    GLuint groups = (threads + kCullGroupSize - 1) / kCullGroupSize;
+    GLuint groupsX = std::min(groups, kMaxGroups);
+    mCullShader->dispatch(groupsX, (groups + groupsX - 1) / groupsX);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void OpenGLRender::updateHiZ(const glm::mat4& viewProjection) {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glm::ivec2 size(viewport[2], viewport[3]);
+    if (size.x <= 0 || size.y <= 0) {
+        mHiZValid = false;
+        return;
+    }
+    if (size != mHiZSize) {
+        GLuint textures[] = { mDepthCopy, mHiZTexture };
+        glDeleteTextures(2, textures);
+        glm::ivec2 pyramid = (size + 1) / 2;
+        auto levels = static_cast<GLsizei>(std::floor(std::log2(static_cast<float>(std::max(pyramid.x, pyramid.y))))) + 1;
+        glGenTextures(1, &mDepthCopy);
+        glBindTexture(GL_TEXTURE_2D, mDepthCopy);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, size.x, size.y);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glGenTextures(1, &mHiZTexture);
+        glBindTexture(GL_TEXTURE_2D, mHiZTexture);
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_R32F, pyramid.x, pyramid.y);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        mHiZSize = size;
+    }
+
+    // The default framebuffer's depth can't be sampled, it's copied first
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, mDepthCopy);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1], size.x, size.y);
+
+    mHiZShader->use();
+    glm::ivec2 levelSize = (size + 1) / 2;
+    for (GLint level = 0; ; ++level) {
+        glBindTexture(GL_TEXTURE_2D, level == 0 ? mDepthCopy : mHiZTexture);
+        mHiZShader->set(mHiZUniforms.sourceLevel, std::max(level - 1, 0));
+        glBindImageTexture(0, mHiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        mHiZShader->dispatch((levelSize.x + kHiZGroupSize - 1) / kHiZGroupSize, (levelSize.y + kHiZGroupSize - 1) / kHiZGroupSize);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        if (levelSize.x == 1 && levelSize.y == 1) break;
+        levelSize = glm::max(levelSize / 2, glm::ivec2(1));     // Mip sizes round down, hiz.comp folds the odd texels in
+    }
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    mHiZViewProjection = viewProjection;
+    mHiZValid = true;
+}
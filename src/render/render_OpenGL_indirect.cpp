@@ -0,0 +1,216 @@
+#include <glad/glad.h>
+#include "render_OpenGL.h"
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <numeric>
+#include <tuple>
+
+// Indirect path of OpenGLRender: shapes live in a few geometry arena blocks, the vertex shaders fetch and decode
+// vertices themselves (VERTEX_PULLING in vertex.glsl), and each pass is one multi-draw per block, primitive and
+// texture. Shaders find the draw record of a command through gl_DrawIDARB.
+
+void OpenGLRender::initIndirect() {
+    GLuint* buffers[] = { &mDrawRecordBuffer, &mCommandRecordBuffer, &mObjectBuffer, &mInstanceBuffer, &mInstanceIndexBuffer, &mCommandBuffer };
+    for (GLuint* buffer : buffers) glGenBuffers(1, buffer);
+    glGenVertexArrays(1, &mIndirectVAO);
+}
+
+void OpenGLRender::updateIndirectInstances(const std::vector<ModelPtr>& models) {
+    // Entry 0 is the identity instance every non-instanced model draws, instanced models' buffers follow
+    std::vector<std::tuple<const Model*, GLuint, uint64_t>> layout;
+    uint32_t instanceCount = 1;
+    for (const auto& model : models) {
+        OpenGLModelResources& resources = mModelResources.at(model);
+        resources.firstInstance = 0;
+        if (!resources.instanced) continue;
+        resources.firstInstance = instanceCount;
+        instanceCount += static_cast<uint32_t>(resources.visibleInstances);
+        layout.emplace_back(model.get(), resources.instanceVBO, resources.instanceVersion);
+    }
+    if (layout == mInstanceLayout) return;
+    mInstanceLayout = std::move(layout);
+
+    OpenGLInstance identity{glm::mat4(1.0f), 0, {}, glm::mat4(1.0f)};
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mInstanceBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(instanceCount * sizeof(OpenGLInstance)), nullptr, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(identity), &identity);
+    for (const auto& model : models) {
+        const OpenGLModelResources& resources = mModelResources.at(model);
+        if (!resources.instanced || resources.visibleInstances <= 0) continue;
+        glBindBuffer(GL_COPY_READ_BUFFER, resources.instanceVBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, static_cast<GLintptr>(resources.firstInstance * sizeof(OpenGLInstance)),
+                            static_cast<GLsizeiptr>(resources.visibleInstances * sizeof(OpenGLInstance)));
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    // Draws the GPU culling didn't compact read their instances through an identity mapping
+    std::vector<uint32_t> indices(instanceCount);
+    std::iota(indices.begin(), indices.end(), 0u);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mInstanceIndexBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(instanceCount * sizeof(uint32_t)), indices.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void OpenGLRender::beginIndirectFrame(const std::shared_ptr<Scene>& scene, const std::vector<ModelPtr>& models) {
+    updateIndirectInstances(models);
+
+    bool quantized = mVertexEncoding != VERTEX_ENCODING::Float;
+    mDrawRecords.clear();
+    mRecordSpheres.clear();
+    mRecordExtents.clear();
+    uint32_t pickId = 1;    // 0 is the background, as in the per-VAO index pass
+    for (size_t m = 0; m < models.size(); ++m) {
+        const ModelPtr& model = models[m];
+        OpenGLModelResources& resources = mModelResources.at(model);
+        resources.firstRecord = static_cast<uint32_t>(mDrawRecords.size());
+        for (size_t i = 0; i < resources.shapes.size(); ++i) {
+            const OpenGLShapeBuffers& buffers = mShapeBuffers.at(resources.shapes[i].get());
+            OpenGLDrawRecord record{};
+            record.positionOffset = glm::vec4(buffers.decode.positionOffset, 0.0f);
+            record.positionScale = glm::vec4(buffers.decode.positionScale, 0.0f);
+            record.vertexBase = static_cast<uint32_t>(buffers.vertexOffset / 4);
+            record.vertexStride = static_cast<uint32_t>(buffers.stride / 4);
+            record.normalOffset = static_cast<uint32_t>(buffers.normalOffset / 4);
+            record.texCoordOffset = static_cast<uint32_t>(buffers.texCoordOffset / 4);
+            record.colorOffset = static_cast<uint32_t>(buffers.colorOffset / 4);
+            uint32_t flags = 0;
+            if (mTextures.isResident(resources.textures[i])) flags |= kDrawFlagTexture;
+            if (buffers.normalOffset) flags |= kDrawFlagNormal;
+            if (buffers.colorOffset) flags |= kDrawFlagColor;
+            if (buffers.primitive == GL_POINTS) flags |= kDrawFlagPoint;
+            if (quantized) flags |= kDrawFlagQuantized;
+            if (buffers.decode.octNormals) flags |= kDrawFlagOctNormals;
+            record.flags = flags;
+            record.object = static_cast<uint32_t>(m);
+            record.pickId = pickId;
+            mDrawRecords.push_back(record);
+            mRecordSpheres.push_back(resources.boundingSpheres[i]);
+            mRecordExtents.push_back(resources.boxExtents[i]);
+        }
+        pickId += static_cast<uint32_t>(scene->getPickIdCount(model));
+    }
+
+    // Orphaned every frame like the object uniform buffer
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mDrawRecordBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(std::max<size_t>(mDrawRecords.size(), 1) * sizeof(OpenGLDrawRecord)),
+                 mDrawRecords.empty() ? nullptr : mDrawRecords.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mObjectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(std::max<size_t>(mObjects.size(), 1) * sizeof(OpenGLObjectBlock)),
+                 mObjects.empty() ? nullptr : mObjects.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kDrawRecordsBinding, mDrawRecordBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kObjectsBinding, mObjectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kInstancesBinding, mInstanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kInstanceIndicesBinding, mInstanceIndexBuffer);
+
+    mDrawCommands.clear();
+    mCommandRecords.clear();
+}
+
+std::vector<OpenGLDrawBatch> OpenGLRender::queueRenderPass(const std::vector<ModelPtr>& models, RenderPass pass) {
+    bool wireframe = mCurrentShader.first == SHADER_TYPE::Wireframe;
+    bool textured = pass == RenderPass::Shading && !wireframe;
+
+    // Commands are gathered per batch first, so each batch ends up contiguous
+    std::vector<OpenGLDrawBatch> batches;
+    std::vector<std::vector<std::pair<OpenGLDrawCommand, uint32_t>>> batchCommands;
+    std::map<std::tuple<GLuint, bool, GLuint>, size_t> batchIndices;
+    auto queue = [&](GLuint buffer, bool points, GLuint texture, const OpenGLDrawCommand& command, uint32_t record) {
+        auto [it, inserted] = batchIndices.try_emplace({buffer, points, texture}, batches.size());
+        if (inserted) {
+            batches.push_back({buffer, points, texture});
+            batchCommands.emplace_back();
+        }
+        batchCommands[it->second].emplace_back(command, record);
+    };
+
+    for (const auto& model : models) {
+        const OpenGLModelResources& resources = mModelResources.at(model);
+
+        GLsizei firstInstance, instanceCount;
+        if (!passInstances(model, resources, pass, firstInstance, instanceCount)) continue;
+        GLuint baseInstance = resources.instanced ? resources.firstInstance + static_cast<GLuint>(firstInstance) : 0;
+        auto instances = static_cast<GLuint>(instanceCount);
+
+        // The outline is drawn without depth, occluded shapes still show in it
+        const std::vector<uint8_t>& visible = pass == RenderPass::Outline ? resources.inFrustum : resources.inView;
+        for (size_t i = 0; i < resources.shapes.size(); ++i) {
+            if (!model->isShapeVisible(i) || !visible[i]) continue;
+            const OpenGLShapeBuffers& buffers = mShapeBuffers.at(resources.shapes[i].get());
+            uint32_t record = resources.firstRecord + static_cast<uint32_t>(i);
+            GLuint texture = textured && mTextures.isResident(resources.textures[i]) ? resources.textures[i] : 0;
+
+            if (resources.primitives[i] == GL_POINTS) {
+                queue(buffers.buffer, true, texture, {static_cast<GLuint>(resources.drawCounts[i]), instances, 0, static_cast<GLint>(baseInstance), 0}, record);
+            } else if (resources.meshletDraws[i]) {
+                // One command per range of visible meshlets
+                const std::vector<GLsizei>& counts = resources.visibleCounts[i];
+                const std::vector<const void*>& offsets = resources.visibleOffsets[i];
+                for (size_t range = 0; range < counts.size(); ++range) {
+                    auto first = static_cast<GLuint>(reinterpret_cast<uintptr_t>(offsets[range]) / sizeof(uint32_t));
+                    queue(buffers.buffer, false, texture, {static_cast<GLuint>(counts[range]), instances, first, 0, baseInstance}, record);
+                    if (pass == RenderPass::Shading) mRenderedTriangles += static_cast<size_t>(counts[range]) / 3;
+                }
+            } else {
+                const OpenGLLOD& lod = resources.lods[i][resources.currentLODs[i]];
+                auto first = static_cast<GLuint>(buffers.firstIndex + lod.indexOffset);
+                queue(buffers.buffer, false, texture, {static_cast<GLuint>(lod.indexCount), instances, first, 0, baseInstance}, record);
+                if (pass == RenderPass::Shading) mRenderedTriangles += lod.indexCount / 3 * instances;
+            }
+        }
+    }
+
+    for (size_t b = 0; b < batches.size(); ++b) {
+        batches[b].firstCommand = mDrawCommands.size();
+        batches[b].commandCount = batchCommands[b].size();
+        for (const auto& [command, record] : batchCommands[b]) {
+            mDrawCommands.push_back(command);
+            mCommandRecords.push_back(record);
+        }
+    }
+    return batches;
+}
+
+void OpenGLRender::uploadIndirectCommands() {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, static_cast<GLsizeiptr>(std::max<size_t>(mDrawCommands.size(), 1) * sizeof(OpenGLDrawCommand)),
+                 mDrawCommands.empty() ? nullptr : mDrawCommands.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCommandRecordBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(std::max<size_t>(mCommandRecords.size(), 1) * sizeof(uint32_t)),
+                 mCommandRecords.empty() ? nullptr : mCommandRecords.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kCommandRecordsBinding, mCommandRecordBuffer);
+}
+
+size_t OpenGLRender::drawIndirectBatches(const ShaderProgram& shader, const OpenGLShaderUniforms& uniforms,
+                                         const std::vector<OpenGLDrawBatch>& batches, GLuint commandBuffer) {
+    size_t binds = 0;
+    glBindVertexArray(mIndirectVAO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    GLuint buffer = 0;
+    for (const OpenGLDrawBatch& batch : batches) {
+        // The VAO is bound, so the element buffer binding goes into it
+        if (batch.buffer != buffer) {
+            buffer = batch.buffer;
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kSceneVerticesBinding, buffer);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+            binds += 2;
+        }
+        // gl_DrawIDARB restarts at 0 in every multi-draw
+        shader.set(uniforms.firstCommand, static_cast<unsigned int>(batch.firstCommand));
+        if (batch.texture) {
+            glBindTexture(GL_TEXTURE_2D, batch.texture);
+            binds++;
+        }
+        const void* offset = (void*)(batch.firstCommand * sizeof(OpenGLDrawCommand));
+        auto count = static_cast<GLsizei>(batch.commandCount);
+        if (batch.points) glMultiDrawArraysIndirect(GL_POINTS, offset, count, sizeof(OpenGLDrawCommand));
+        else glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, offset, count, sizeof(OpenGLDrawCommand));
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    return binds;
+}
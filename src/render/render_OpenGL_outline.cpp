@@ -0,0 +1,104 @@
+#include <glad/glad.h>
+#include "render_OpenGL.h"
+#include "utils/file.h"
+
+// Screen-space outline: the outline pass draws the selection filled into a mask, jump flood passes (outline-flood.frag)
+// find the nearest selected pixel of every pixel, and a full-screen pass (outline-composite.frag) blends the band
+// around the mask over the frame. Past the mask, the cost depends on the resolution and the log of the width only.
+
+namespace {
+
+GLuint createOutlineTexture(GLenum format, glm::ivec2 size) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, format, size.x, size.y);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    return texture;
+}
+
+}
+
+void OpenGLRender::initOutline() {
+    std::string screen = findFile("assets/shaders/glsl/screen.vert");
+    mFloodShader = std::make_shared<ShaderProgram>(screen, findFile("assets/shaders/glsl/outline-flood.frag"));
+    mCompositeShader = std::make_shared<ShaderProgram>(screen, findFile("assets/shaders/glsl/outline-composite.frag"));
+    mFloodUniforms = OpenGLShaderUniforms(*mFloodShader);
+    mCompositeUniforms = OpenGLShaderUniforms(*mCompositeShader);
+    glGenVertexArrays(1, &mScreenVAO);
+    glGenFramebuffers(3, mOutlineFramebuffers);
+}
+
+void OpenGLRender::beginOutline() {
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &mOutlineTarget);
+    glGetIntegerv(GL_VIEWPORT, mOutlineViewport);
+    glm::ivec2 size(mOutlineViewport[2], mOutlineViewport[3]);
+    if (size.x <= 0 || size.y <= 0) return;     // Nothing is drawn, endOutline does nothing either
+    if (size != mOutlineSize) {
+        GLuint textures[] = { mOutlineMask, mOutlineSeeds[0], mOutlineSeeds[1] };
+        glDeleteTextures(3, textures);
+        mOutlineMask = createOutlineTexture(GL_R8, size);
+        // Seeds are pixel coordinates, 16 bits reach 32767
+        mOutlineSeeds[0] = createOutlineTexture(GL_RG16I, size);
+        mOutlineSeeds[1] = createOutlineTexture(GL_RG16I, size);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        GLuint targets[] = { mOutlineMask, mOutlineSeeds[0], mOutlineSeeds[1] };
+        for (int i = 0; i < 3; ++i) {
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mOutlineFramebuffers[i]);
+            glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targets[i], 0);
+        }
+        mOutlineSize = size;
+    }
+
+    // The mask has no depth, it holds the whole silhouette of what the pass draws
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mOutlineFramebuffers[0]);
+    glViewport(0, 0, mOutlineSize.x, mOutlineSize.y);
+    const GLfloat clear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, clear);
+    glDisable(GL_DEPTH_TEST);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+}
+
+void OpenGLRender::endOutline() {
+    if (mOutlineViewport[2] <= 0 || mOutlineViewport[3] <= 0) return;
+    glBindVertexArray(mScreenVAO);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, mOutlineMask);
+    glActiveTexture(GL_TEXTURE0);
+
+    // Each pass reads the seeds the last one wrote, and draws into the other texture
+    int source = 1;
+    mFloodShader->use();
+    auto flood = [&](int jump, bool fromMask) {
+        glBindTexture(GL_TEXTURE_2D, mOutlineSeeds[source]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mOutlineFramebuffers[2 - source]);
+        mFloodShader->set(mFloodUniforms.jump, jump);
+        mFloodShader->set(mFloodUniforms.fromMask, fromMask);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        source = 1 - source;
+    };
+    // Seeds up to width + 1 pixels away matter, the first jump must reach half that
+    int firstJump = 1;
+    while (static_cast<float>(firstJump * 2) < mOutlineWidth + 1.0f) firstJump *= 2;
+    flood(1, true);
+    for (int jump = firstJump; jump >= 1; jump /= 2) flood(jump, false);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, static_cast<GLuint>(mOutlineTarget));
+    glViewport(mOutlineViewport[0], mOutlineViewport[1], mOutlineViewport[2], mOutlineViewport[3]);
+    glBindTexture(GL_TEXTURE_2D, mOutlineSeeds[source]);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    mCompositeShader->use();
+    mCompositeShader->set(mCompositeUniforms.width, mOutlineWidth);
+    mCompositeShader->set(mCompositeUniforms.viewportOrigin, glm::vec2(mOutlineViewport[0], mOutlineViewport[1]));
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(0);
+}
@@ -1,6 +1,9 @@
 #include <glad/glad.h>
 #include "shader.h"
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <unordered_set>
 #include <sstream>
 #include <iostream>
 
@@ -9,47 +12,157 @@
 ShaderProgram::ShaderProgram(
         const std::string& vertexPath, 
         const std::string& fragmentPath,
-        const std::string& geometryPath
+        const std::string& geometryPath,
+        const std::string& defines
     ) {
-    GLuint vertexShader = loadShader(vertexPath, GL_VERTEX_SHADER);
-    GLuint fragmentShader = loadShader(fragmentPath, GL_FRAGMENT_SHADER);
-    GLuint geometryShader = 0;
+    std::vector<GLuint> shaders = { loadShader(vertexPath, GL_VERTEX_SHADER, defines), loadShader(fragmentPath, GL_FRAGMENT_SHADER, defines) };
     if (!geometryPath.empty()) {
-        geometryShader = loadShader(geometryPath, GL_GEOMETRY_SHADER);
+        shaders.push_back(loadShader(geometryPath, GL_GEOMETRY_SHADER, defines));
     }
+    link(shaders);
+}
+
+std::shared_ptr<ShaderProgram> ShaderProgram::createCompute(const std::string& computePath, const std::string& defines) {
+    std::shared_ptr<ShaderProgram> program(new ShaderProgram());
+    program->link({ loadShader(computePath, GL_COMPUTE_SHADER, defines) });
+    return program;
+}
 
+void ShaderProgram::link(const std::vector<GLuint>& shaders) {
     mProgram = glCreateProgram();
-    glAttachShader(mProgram, vertexShader);
-    glAttachShader(mProgram, fragmentShader);
-    if (geometryShader) { glAttachShader(mProgram, geometryShader); }
+    for (GLuint shader : shaders) glAttachShader(mProgram, shader);
     glLinkProgram(mProgram);
 
     GLint success;
     glGetProgramiv(mProgram, GL_LINK_STATUS, &success);
+    mLinked = success;
     if (!success) {
         GLchar infoLog[512];
         glGetProgramInfoLog(mProgram, 512, nullptr, infoLog);
         std::cerr << "Error linking shader program: " << infoLog << std::endl;
     }
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-    if (geometryShader) { glDeleteShader(geometryShader); }
+    for (GLuint shader : shaders) glDeleteShader(shader);
+
+    if (success) reflect();
+}
+
+void ShaderProgram::reflect() {
+    GLint uniformCount = 0, maxNameLength = 0;
+    glGetProgramiv(mProgram, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(mProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    std::vector<GLchar> name(std::max(maxNameLength, 1));
+    for (GLint i = 0; i < uniformCount; ++i) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(mProgram, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), &length, &size, &type, name.data());
+        UniformInfo uniform;
+        uniform.name.assign(name.data(), length);
+        uniform.location = glGetUniformLocation(mProgram, uniform.name.c_str());
+        uniform.type = type;
+        if (uniform.location < 0) continue;     // Member of a uniform block
+        // Arrays are reported as "name[0]", they are looked up by their plain name
+        if (uniform.name.size() > 3 && uniform.name.compare(uniform.name.size() - 3, 3, "[0]") == 0) uniform.name.resize(uniform.name.size() - 3);
+        mUniformSlots[uniform.name] = static_cast<int>(mUniforms.size());
+        mUniforms.push_back(std::move(uniform));
+    }
+
+    GLint blockCount = 0;
+    glGetProgramiv(mProgram, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+    glGetProgramiv(mProgram, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxNameLength);
+    name.resize(std::max(maxNameLength, 1));
+    for (GLint i = 0; i < blockCount; ++i) {
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(mProgram, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), &length, name.data());
+        UniformBlockInfo block;
+        block.index = static_cast<GLuint>(i);
+        glGetActiveUniformBlockiv(mProgram, block.index, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+        mUniformBlocks[std::string(name.data(), length)] = block;
+    }
+}
+
+int ShaderProgram::findUniform(const std::string& name, const GLenum* types, size_t typeCount) const {
+    auto it = mUniformSlots.find(name);
+    // Uniforms the compiler dropped are common (e.g. unused in one shader type), setting them is a no-op
+    if (it == mUniformSlots.end()) return -1;
+    if (std::find(types, types + typeCount, mUniforms[it->second].type) == types + typeCount) {
+        std::cerr << "Uniform " << name << " set with the wrong type" << std::endl;
+        return -1;
+    }
+    return it->second;
+}
+
+void ShaderProgram::upload(int slot, const void* value, size_t size) const {
+    if (slot < 0) return;
+    UniformInfo& uniform = mUniforms[slot];
+    if (uniform.cached && std::memcmp(uniform.value.data(), value, size) == 0) return;
+    std::memcpy(uniform.value.data(), value, size);
+    uniform.cached = true;
+
+    switch (uniform.type) {
+        case GL_FLOAT: glUniform1fv(uniform.location, 1, static_cast<const GLfloat*>(value)); break;
+        case GL_FLOAT_VEC2: glUniform2fv(uniform.location, 1, static_cast<const GLfloat*>(value)); break;
+        case GL_FLOAT_VEC3: glUniform3fv(uniform.location, 1, static_cast<const GLfloat*>(value)); break;
+        case GL_FLOAT_MAT4: glUniformMatrix4fv(uniform.location, 1, GL_FALSE, static_cast<const GLfloat*>(value)); break;
+        case GL_UNSIGNED_INT: glUniform1uiv(uniform.location, 1, static_cast<const GLuint*>(value)); break;
+        default: glUniform1iv(uniform.location, 1, static_cast<const GLint*>(value)); break;    // Bools, ints and samplers
+    }
+}
+
+GLint ShaderProgram::getUniformBlockSize(const std::string& name) const {
+    auto it = mUniformBlocks.find(name);
+    return it != mUniformBlocks.end() ? it->second.dataSize : 0;
+}
+
+bool ShaderProgram::bindUniformBlock(const std::string& name, GLuint binding) const {
+    auto it = mUniformBlocks.find(name);
+    if (it == mUniformBlocks.end()) return false;
+    glUniformBlockBinding(mProgram, it->second.index, binding);
+    return true;
 }
 
-GLuint ShaderProgram::loadShader(const std::string& path, GLenum type) {
+std::string ShaderProgram::readSource(const std::filesystem::path& path, std::unordered_set<std::string>& included) {
     std::ifstream file;
     std::stringstream buffer;
-    std::string code;
     file.exceptions (std::ifstream::failbit | std::ifstream::badbit);
 
     try {
         file.open(path);
         buffer << file.rdbuf();
-        code = buffer.str();
     } catch (std::ifstream::failure& e) {
-        std::cerr << "Error opening shader file: " << path << std::endl << e.what() << std::endl;
+        std::cerr << "Error opening shader file: " << path.string() << std::endl << e.what() << std::endl;
+        return "";
     }
+
+    // Resolve `#include "file"` relative to the including file, each file once per shader
+    std::string code, line;
+    while (std::getline(buffer, line)) {
+        size_t start = line.find_first_not_of(" \t");
+        if (start != std::string::npos && line.compare(start, 8, "#include") == 0) {
+            size_t open = line.find('"', start), close = line.rfind('"');
+            if (open == std::string::npos || close <= open) {
+                std::cerr << "Malformed include in shader file: " << path.string() << std::endl;
+                continue;
+            }
+            std::filesystem::path includePath = path.parent_path() / line.substr(open + 1, close - open - 1);
+            if (included.insert(includePath.lexically_normal().string()).second) code += readSource(includePath, included);
+            continue;
+        }
+        code += line;
+        code += '\n';
+    }
+    return code;
+}
+
+GLuint ShaderProgram::loadShader(const std::string& path, GLenum type, const std::string& defines) {
+    std::unordered_set<std::string> included;
+    std::string code = readSource(path, included);
+    // Defines go right after the #version line
+    size_t version = code.find("#version");
+    size_t insert = version == std::string::npos ? 0 : code.find('\n', version);
+    insert = insert == std::string::npos ? code.size() : insert + 1;
+    code.insert(insert, defines);
     
     const char* shaderCode = code.c_str();
     GLuint shader = glCreateShader(type);
@@ -82,22 +195,7 @@ void ShaderProgram::use() const {
     glUseProgram(mProgram);
 }
 
-void ShaderProgram::setBool(const std::string &name, bool value) const {
-    glUniform1i(glGetUniformLocation(mProgram, name.c_str()), static_cast<int>(value));
+void ShaderProgram::dispatch(GLuint groupsX, GLuint groupsY, GLuint groupsZ) const {
+    if (!mLinked) return;
+    glDispatchCompute(groupsX, groupsY, groupsZ);
 }
-
-void ShaderProgram::setInt(const std::string &name, int value) const {
-    glUniform1i(glGetUniformLocation(mProgram, name.c_str()), value);
-}
-
-void ShaderProgram::setFloat(const std::string &name, float value) const {
-    glUniform1f(glGetUniformLocation(mProgram, name.c_str()), value);
-}
-
-void ShaderProgram::setVec3(const std::string &name, const glm::vec3 &value) const {
-    glUniform3fv(glGetUniformLocation(mProgram, name.c_str()), 1, glm::value_ptr(value));
-}
-
-void ShaderProgram::setMat4(const std::string &name, const glm::mat4 &mat) const {
-    glUniformMatrix4fv(glGetUniformLocation(mProgram, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
-}
\ No newline at end of file
@@ -2,23 +2,117 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <array>
+#include <filesystem>
+#include <memory>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Pre-resolved uniform of a ShaderProgram, invalid (setting it does nothing) if the program has no such
+// active uniform of type T. Only valid with the program it came from.
+template <typename T>
+struct Uniform {
+    int slot = -1;      // Into the program's reflected uniforms
+    [[nodiscard]] bool valid() const { return slot >= 0; }
+};
 
 class ShaderProgram {
 public:
-    ShaderProgram(const std::string& vertexPath, const std::string& fragmentPath, const std::string& geometryPath = "");
+    // Sources may `#include "file"` relative to themselves. `defines` (e.g. "#define FOO\n") is inserted after #version.
+    ShaderProgram(const std::string& vertexPath, const std::string& fragmentPath, const std::string& geometryPath = "",
+                  const std::string& defines = "");
+    // Compute program, its source handled the same way
+    static std::shared_ptr<ShaderProgram> createCompute(const std::string& computePath, const std::string& defines = "");
     ~ShaderProgram();
 
     void use() const;
     void cleanup();
+    [[nodiscard]] bool isLinked() const { return mLinked; }
+    // Run a compute program over a grid of work groups, it must be in use. Follow with glMemoryBarrier for
+    // whatever reads its results.
+    void dispatch(GLuint groupsX, GLuint groupsY = 1, GLuint groupsZ = 1) const;
+
+    // Uniforms are reflected once at link time. Look handles up once, then `set` costs a compare,
+    // and a glUniform call only when the value differs from the last one sent. Like glUniform, the
+    // program must be in use.
+    template <typename T>
+    [[nodiscard]] Uniform<T> getUniform(const std::string& name) const;
+    void set(Uniform<bool> uniform, bool value) const { int v = value; upload(uniform.slot, &v, sizeof(v)); }
+    void set(Uniform<int> uniform, int value) const { upload(uniform.slot, &value, sizeof(value)); }
+    void set(Uniform<unsigned int> uniform, unsigned int value) const { upload(uniform.slot, &value, sizeof(value)); }
+    void set(Uniform<float> uniform, float value) const { upload(uniform.slot, &value, sizeof(value)); }
+    void set(Uniform<glm::vec2> uniform, const glm::vec2& value) const { upload(uniform.slot, glm::value_ptr(value), sizeof(value)); }
+    void set(Uniform<glm::vec3> uniform, const glm::vec3& value) const { upload(uniform.slot, glm::value_ptr(value), sizeof(value)); }
+    void set(Uniform<glm::mat4> uniform, const glm::mat4& value) const { upload(uniform.slot, glm::value_ptr(value), sizeof(value)); }
+
+    // By name, for one-off values
+    void setBool(const std::string &name, bool value) const { set(getUniform<bool>(name), value); }
+    void setInt(const std::string &name, int value) const { set(getUniform<int>(name), value); }
+    void setFloat(const std::string &name, float value) const { set(getUniform<float>(name), value); }
+    void setVec3(const std::string &name, const glm::vec3 &value) const { set(getUniform<glm::vec3>(name), value); }
+    void setMat4(const std::string &name, const glm::mat4 &mat) const { set(getUniform<glm::mat4>(name), mat); }
 
-    void setBool(const std::string &name, bool value) const;
-    void setInt(const std::string &name, int value) const;
-    void setFloat(const std::string &name, float value) const;
-    void setVec3(const std::string &name, const glm::vec3 &value) const;
-    void setMat4(const std::string &name, const glm::mat4 &mat) const;
+    // Uniform blocks: data size in bytes (0 if the block isn't active) and binding to a buffer binding point
+    [[nodiscard]] GLint getUniformBlockSize(const std::string& name) const;
+    bool bindUniformBlock(const std::string& name, GLuint binding) const;
 
 private:
-    GLuint mProgram;
-    static GLuint loadShader(const std::string& path, GLenum type);
+    struct UniformInfo {
+        std::string name;
+        GLint location = -1;
+        GLenum type = 0;
+        bool cached = false;    // Whether `value` holds what was last sent
+        std::array<unsigned char, sizeof(glm::mat4)> value{};
+    };
+
+    struct UniformBlockInfo {
+        GLuint index = 0;
+        GLint dataSize = 0;
+    };
+
+    GLuint mProgram = 0;
+    bool mLinked = false;
+    mutable std::vector<UniformInfo> mUniforms;
+    std::unordered_map<std::string, int> mUniformSlots;
+    std::unordered_map<std::string, UniformBlockInfo> mUniformBlocks;
+
+    ShaderProgram() = default;
+    // Link the compiled stages into a new program, then delete them
+    void link(const std::vector<GLuint>& shaders);
+    static std::string readSource(const std::filesystem::path& path, std::unordered_set<std::string>& included);
+    static GLuint loadShader(const std::string& path, GLenum type, const std::string& defines);
+    void reflect();
+    [[nodiscard]] int findUniform(const std::string& name, const GLenum* types, size_t typeCount) const;
+    void upload(int slot, const void* value, size_t size) const;
 };
+
+template <typename T>
+Uniform<T> ShaderProgram::getUniform(const std::string& name) const {
+    // GL types a T may be uploaded to, ints also set samplers
+    if constexpr (std::is_same_v<T, bool>) {
+        static constexpr GLenum types[] = { GL_BOOL };
+        return { findUniform(name, types, 1) };
+    } else if constexpr (std::is_same_v<T, int>) {
+        static constexpr GLenum types[] = { GL_INT, GL_SAMPLER_2D, GL_SAMPLER_2D_ARRAY, GL_SAMPLER_CUBE };
+        return { findUniform(name, types, 4) };
+    } else if constexpr (std::is_same_v<T, unsigned int>) {
+        static constexpr GLenum types[] = { GL_UNSIGNED_INT };
+        return { findUniform(name, types, 1) };
+    } else if constexpr (std::is_same_v<T, float>) {
+        static constexpr GLenum types[] = { GL_FLOAT };
+        return { findUniform(name, types, 1) };
+    } else if constexpr (std::is_same_v<T, glm::vec2>) {
+        static constexpr GLenum types[] = { GL_FLOAT_VEC2 };
+        return { findUniform(name, types, 1) };
+    } else if constexpr (std::is_same_v<T, glm::vec3>) {
+        static constexpr GLenum types[] = { GL_FLOAT_VEC3 };
+        return { findUniform(name, types, 1) };
+    } else {
+        static_assert(std::is_same_v<T, glm::mat4>, "Unsupported uniform type");
+        static constexpr GLenum types[] = { GL_FLOAT_MAT4 };
+        return { findUniform(name, types, 1) };
+    }
+}
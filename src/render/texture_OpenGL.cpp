@@ -0,0 +1,298 @@
+#include "texture_OpenGL.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "utils/parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT         // EXT_texture_compression_s3tc isn't in the core profile loader
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace {
+
+std::string canonicalPath(const std::string& path) {
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    return error ? path : canonical.string();
+}
+
+GLenum glFormat(TEXTURE_FORMAT format) {
+    switch (format) {
+        case TEXTURE_FORMAT::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case TEXTURE_FORMAT::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case TEXTURE_FORMAT::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default: return GL_RGBA8;
+    }
+}
+
+// Levels this small are uploaded as soon as a texture is loaded, so every shape is textured from then on
+constexpr uint32_t kTailSize = 64;
+
+BakedTexture loadImage(const std::string& path, TEXTURE_COMPRESSION compression) {
+    BakedTexture image;
+    if (TextureCache::instance().load(path, compression, image)) return image;
+
+    stbi_set_flip_vertically_on_load_thread(true);
+    int width, height, components;
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &components, 4);
+    if (!data) return image;
+    image = bakeTexture(data, static_cast<uint32_t>(width), static_cast<uint32_t>(height), compression);
+    stbi_image_free(data);
+    TextureCache::instance().store(path, compression, image);
+    return image;
+}
+
+}
+
+OpenGLTextureManager::~OpenGLTextureManager() {
+    clear();
+    for (auto& load : mLoads) load.wait();
+}
+
+std::vector<GLuint> OpenGLTextureManager::acquire(const std::vector<std::string>& paths, TEXTURE_COMPRESSION compression) {
+    std::vector<GLuint> textures(paths.size(), 0);
+
+    // Resolve paths, new files get an empty texture now and their contents once loaded
+    std::vector<std::string> missing;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (paths[i].empty()) continue;
+        std::string key = canonicalPath(paths[i]);
+        auto it = mTextures.find(key);
+        if (it == mTextures.end()) {
+            GLuint texture = 0;
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            it = mTextures.emplace(key, texture).first;
+            mEntries[texture].key = key;
+            missing.push_back(key);
+        }
+        textures[i] = it->second;
+        mEntries.at(textures[i]).references++;
+    }
+    if (missing.empty()) return textures;
+
+    // Read from the cache (or bake) in parallel on a background thread, `update` attaches the results
+    TEXTURE_COMPRESSION supported = supportedCompression(compression);
+    mPendingLoads += missing.size();
+    mLoads.push_back(std::async(std::launch::async, [this, missing = std::move(missing), supported] {
+        parallelTasks(missing.size(), [&](size_t task) {
+            LoadResult result{missing[task], {}, false};
+            try {
+                result.image = loadImage(missing[task], supported);
+                result.loaded = !result.image.levels.empty();
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+            }
+            std::lock_guard<std::mutex> lock(mFinishedMutex);
+            mFinished.push_back(std::move(result));
+        });
+    }));
+    return textures;
+}
+
+void OpenGLTextureManager::release(GLuint texture) {
+    auto it = mEntries.find(texture);
+    if (it == mEntries.end() || --it->second.references > 0) return;
+    glDeleteTextures(1, &texture);
+    mTextures.erase(it->second.key);
+    mTextureBytes -= it->second.bytes;
+    mEntries.erase(it);
+}
+
+void OpenGLTextureManager::clear() {
+    for (const auto& [texture, entry] : mEntries) glDeleteTextures(1, &texture);
+    mTextures.clear();
+    mEntries.clear();
+    mTextureBytes = 0;
+}
+
+void OpenGLTextureManager::request(GLuint texture, float pixels) {
+    auto it = mEntries.find(texture);
+    if (it != mEntries.end()) it->second.pixels = std::max(it->second.pixels, pixels);
+}
+
+void OpenGLTextureManager::update(size_t uploadBudget, size_t memoryBudget) {
+    // Finished loads, results of released textures are dropped
+    mLoads.erase(std::remove_if(mLoads.begin(), mLoads.end(), [](std::future<void>& load) {
+        return load.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }), mLoads.end());
+    std::vector<LoadResult> finished;
+    {
+        std::lock_guard<std::mutex> lock(mFinishedMutex);
+        finished.swap(mFinished);
+    }
+    for (auto& result : finished) {
+        mPendingLoads--;
+        attach(result);
+    }
+
+    std::vector<std::pair<GLuint, Entry*>> streamed;
+    for (auto& [texture, entry] : mEntries) {
+        if (entry.loaded) streamed.emplace_back(texture, &entry);
+    }
+    // Largest on screen first, textures of hidden shapes last
+    std::sort(streamed.begin(), streamed.end(), [](const auto& a, const auto& b) {
+        return a.second->pixels != b.second->pixels ? a.second->pixels > b.second->pixels : a.first < b.first;
+    });
+    auto isTail = [](const Entry& entry, size_t level) {
+        const TextureLevel& textureLevel = entry.image.levels[level];
+        return std::max(textureLevel.width, textureLevel.height) <= kTailSize;
+    };
+
+    // Levels finer than wanted go first once over the memory budget, smallest shapes first
+    for (auto it = streamed.rbegin(); it != streamed.rend() && mTextureBytes > memoryBudget; ++it) {
+        Entry& entry = *it->second;
+        while (mTextureBytes > memoryBudget && entry.residentBase < wantedBase(entry) && !isTail(entry, entry.residentBase)) {
+            dropLevel(it->first, entry);
+        }
+    }
+
+    // Stream one level per texture per round, finest-needed last, until the frame's upload budget is spent.
+    // The first level of the frame always goes, so levels larger than the budget still get through.
+    size_t uploaded = 0;
+    bool progress = true;
+    while (progress && (uploaded < uploadBudget || uploaded == 0)) {
+        progress = false;
+        for (size_t i = 0; i < streamed.size(); ++i) {
+            auto [texture, entry] = streamed[i];
+            if (entry->residentBase <= wantedBase(*entry)) continue;
+            size_t level = entry->residentBase - 1;
+            size_t size = entry->image.levels[level].size;
+            if (uploaded > 0 && uploaded + size > uploadBudget) continue;
+
+            // Make room from shapes smaller on screen, finest levels first, unless even that wouldn't be enough
+            if (mTextureBytes + size > memoryBudget) {
+                size_t freeable = 0;
+                for (size_t j = i + 1; j < streamed.size(); ++j) {
+                    const Entry& victim = *streamed[j].second;
+                    if (victim.pixels >= entry->pixels) continue;
+                    for (size_t k = victim.residentBase; k < victim.image.levels.size() && !isTail(victim, k); ++k) {
+                        freeable += victim.image.levels[k].size;
+                    }
+                }
+                if (mTextureBytes - freeable + size > memoryBudget) continue;
+            }
+            for (size_t j = streamed.size(); j-- > i + 1 && mTextureBytes + size > memoryBudget;) {
+                Entry& victim = *streamed[j].second;
+                if (victim.pixels >= entry->pixels) break;
+                while (mTextureBytes + size > memoryBudget && victim.residentBase < victim.image.levels.size() &&
+                       !isTail(victim, victim.residentBase)) {
+                    dropLevel(streamed[j].first, victim);
+                }
+            }
+            if (mTextureBytes + size > memoryBudget) continue;
+
+            uploadLevel(texture, *entry, level);
+            uploaded += size;
+            progress = true;
+            if (uploaded >= uploadBudget) break;
+        }
+    }
+
+    for (auto& [texture, entry] : mEntries) entry.pixels = 0.0f;
+}
+
+bool OpenGLTextureManager::isResident(GLuint texture) const {
+    auto it = mEntries.find(texture);
+    return it != mEntries.end() && it->second.loaded && it->second.residentBase < it->second.image.levels.size();
+}
+
+void OpenGLTextureManager::attach(LoadResult& result) {
+    auto it = mTextures.find(result.key);
+    if (it == mTextures.end()) return;
+    Entry& entry = mEntries.at(it->second);
+    if (entry.loaded) return;       // Released and acquired again while loading, the first load won
+    if (!result.loaded) {
+        std::cerr << "Failed to load texture: " << result.key << std::endl;
+        return;
+    }
+
+    entry.image = std::move(result.image);
+    entry.loaded = true;
+    entry.residentBase = entry.image.levels.size();
+    glBindTexture(GL_TEXTURE_2D, it->second);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(entry.image.levels.size()) - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // The mip tail (at least the last level) right away, outside the budgets
+    do {
+        uploadLevel(it->second, entry, entry.residentBase - 1);
+    } while (entry.residentBase > 0 && std::max(entry.image.levels[entry.residentBase - 1].width,
+                                                entry.image.levels[entry.residentBase - 1].height) <= kTailSize);
+}
+
+void OpenGLTextureManager::uploadLevel(GLuint texture, Entry& entry, size_t level) {
+    const TextureLevel& textureLevel = entry.image.levels[level];
+    const uint8_t* data = entry.image.data() + textureLevel.offset;
+    GLenum format = glFormat(entry.image.format);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    if (entry.image.format == TEXTURE_FORMAT::RGBA8) {
+        glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), static_cast<GLint>(format), textureLevel.width, textureLevel.height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, data);
+    } else {
+        glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), format, textureLevel.width, textureLevel.height, 0,
+                               static_cast<GLsizei>(textureLevel.size), data);
+    }
+    // Sampling is limited to the resident levels
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(level));
+    glBindTexture(GL_TEXTURE_2D, 0);
+    entry.residentBase = level;
+    entry.bytes += textureLevel.size;
+    mTextureBytes += textureLevel.size;
+}
+
+void OpenGLTextureManager::dropLevel(GLuint texture, Entry& entry) {
+    size_t level = entry.residentBase;
+    const TextureLevel& textureLevel = entry.image.levels[level];
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(level + 1));
+    // Respecifying the level as empty releases its storage
+    if (entry.image.format == TEXTURE_FORMAT::RGBA8) {
+        glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    } else {
+        glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), glFormat(entry.image.format), 0, 0, 0, 0, nullptr);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    entry.residentBase = level + 1;
+    entry.bytes -= textureLevel.size;
+    mTextureBytes -= textureLevel.size;
+}
+
+size_t OpenGLTextureManager::wantedBase(const Entry& entry) {
+    size_t coarsest = entry.image.levels.size() - 1;
+    if (entry.pixels <= 0.0f) return coarsest;
+    // The finest level still at least as large as the shape on screen
+    float size = static_cast<float>(std::max(entry.image.levels[0].width, entry.image.levels[0].height));
+    auto level = static_cast<size_t>(std::max(0.0f, std::floor(std::log2(size / entry.pixels))));
+    return std::min(level, coarsest);
+}
+
+TEXTURE_COMPRESSION OpenGLTextureManager::supportedCompression(TEXTURE_COMPRESSION compression) {
+    if (mCompressedFormats.empty()) {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+        mCompressedFormats.resize(std::max(count, 0));
+        if (count > 0) glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, mCompressedFormats.data());
+        mCompressedFormats.push_back(GL_RGBA8);     // Also marks the list as queried
+    }
+    auto supports = [this](GLenum format) {
+        return std::find(mCompressedFormats.begin(), mCompressedFormats.end(), static_cast<GLint>(format)) != mCompressedFormats.end();
+    };
+
+    // Fall back from BC7 to BC1/BC3 to uncompressed
+    if (compression == TEXTURE_COMPRESSION::BC7 && !supports(GL_COMPRESSED_RGBA_BPTC_UNORM)) compression = TEXTURE_COMPRESSION::BC1_BC3;
+    if (compression == TEXTURE_COMPRESSION::BC1_BC3 &&
+        (!supports(GL_COMPRESSED_RGB_S3TC_DXT1_EXT) || !supports(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT))) {
+        compression = TEXTURE_COMPRESSION::None;
+    }
+    return compression;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "loaders/texture_cache.h"
+#include "utils/enum.h"
+
+// Shared GL textures keyed by the canonical path of the image file.
+// Each file is loaded once and shapes referencing it share the texture. Textures are reference counted
+// and deleted when the last shape releases them.
+//
+// Textures stream in: files are read from the TextureCache (or decoded and baked) on a background thread,
+// the coarse mip tail is uploaded as soon as a file is ready, and finer levels follow over later frames.
+// Each frame the renderer requests every texture it draws at the shape's projected size; `update` then
+// uploads the levels needed by the largest shapes first, within a per-frame upload budget, and drops fine
+// levels of the smallest ones when resident levels would exceed the memory budget.
+// All methods must be called from the thread owning the GL context.
+class OpenGLTextureManager {
+public:
+    OpenGLTextureManager() = default;
+    ~OpenGLTextureManager();
+    OpenGLTextureManager(const OpenGLTextureManager&) = delete;
+    OpenGLTextureManager& operator=(const OpenGLTextureManager&) = delete;
+
+    // Return one texture per path (0 for empty paths), adding a reference to each. Returns immediately,
+    // files not loaded yet are loaded in the background, so pass all paths of a model at once.
+    // `compression` only applies to newly loaded files and falls back to what the GPU supports.
+    std::vector<GLuint> acquire(const std::vector<std::string>& paths, TEXTURE_COMPRESSION compression);
+    // Drop one reference, the texture is deleted with its last reference (0 is ignored)
+    void release(GLuint texture);
+    // Delete every texture regardless of references
+    void clear();
+
+    // Ask for `texture` to be sharp over `pixels` screen pixels this frame (the largest request of the frame wins)
+    void request(GLuint texture, float pixels);
+    // Attach finished loads and stream levels for this frame's requests, then start collecting the next frame's
+    void update(size_t uploadBudget, size_t memoryBudget);
+    // Whether any level of the texture can be sampled
+    [[nodiscard]] bool isResident(GLuint texture) const;
+
+    [[nodiscard]] size_t getTextureCount() const { return mEntries.size(); }
+    [[nodiscard]] size_t getTextureBytes() const { return mTextureBytes; }
+    [[nodiscard]] size_t getPendingLoads() const { return mPendingLoads; }
+
+private:
+    struct Entry {
+        std::string key;
+        size_t references = 0;
+        BakedTexture image;         // Source of the levels still to stream, mapped from the cache when possible
+        bool loaded = false;
+        size_t residentBase = 0;    // Finest resident level, `image.levels.size()` while nothing is resident
+        size_t bytes = 0;           // Resident levels
+        float pixels = 0.0f;        // Largest projected size requested this frame
+    };
+
+    struct LoadResult {
+        std::string key;
+        BakedTexture image;
+        bool loaded = false;
+    };
+
+    std::unordered_map<std::string, GLuint> mTextures;      // Canonical path -> texture
+    std::unordered_map<GLuint, Entry> mEntries;
+    size_t mTextureBytes = 0;                               // VRAM of all resident levels
+    std::vector<GLint> mCompressedFormats;                  // Queried on first use
+
+    std::vector<std::future<void>> mLoads;                  // Background load batches
+    std::mutex mFinishedMutex;
+    std::vector<LoadResult> mFinished;                      // Filled by the load batches
+    size_t mPendingLoads = 0;
+
+    TEXTURE_COMPRESSION supportedCompression(TEXTURE_COMPRESSION compression);
+    void attach(LoadResult& result);
+    void uploadLevel(GLuint texture, Entry& entry, size_t level);
+    void dropLevel(GLuint texture, Entry& entry);
+    [[nodiscard]] static size_t wantedBase(const Entry& entry);
+};
@@ -0,0 +1,350 @@
+#include "block_compress.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr int kBC7Weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Principal axis of the block's colors (first `channels` channels), by power iteration on the covariance
+void principalAxis(const uint8_t* rgba, int channels, float* mean, float* axis) {
+    for (int c = 0; c < channels; ++c) {
+        mean[c] = 0.0f;
+        for (int i = 0; i < 16; ++i) mean[c] += rgba[4 * i + c];
+        mean[c] /= 16.0f;
+    }
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; ++i) {
+        for (int a = 0; a < channels; ++a) {
+            for (int b = a; b < channels; ++b) {
+                covariance[a][b] += (rgba[4 * i + a] - mean[a]) * (rgba[4 * i + b] - mean[b]);
+            }
+        }
+    }
+    for (int a = 0; a < channels; ++a)
+        for (int b = 0; b < a; ++b) covariance[a][b] = covariance[b][a];
+
+    for (int c = 0; c < channels; ++c) axis[c] = 1.0f;
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = {};
+        float length = 0.0f;
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) next[a] += covariance[a][b] * axis[b];
+            length = std::max(length, std::abs(next[a]));
+        }
+        if (length <= 0.0f) break;
+        for (int c = 0; c < channels; ++c) axis[c] = next[c] / length;
+    }
+}
+
+// Block colors projected on the principal axis, returns the extremes as endpoints
+void axisEndpoints(const uint8_t* rgba, int channels, float* low, float* high) {
+    float mean[4], axis[4];
+    principalAxis(rgba, channels, mean, axis);
+    float minProjection = 0.0f, maxProjection = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float projection = 0.0f;
+        for (int c = 0; c < channels; ++c) projection += (rgba[4 * i + c] - mean[c]) * axis[c];
+        minProjection = std::min(minProjection, projection);
+        maxProjection = std::max(maxProjection, projection);
+    }
+    float axisLength2 = 0.0f;
+    for (int c = 0; c < channels; ++c) axisLength2 += axis[c] * axis[c];
+    if (axisLength2 <= 0.0f) axisLength2 = 1.0f;
+    for (int c = 0; c < channels; ++c) {
+        low[c] = std::clamp(mean[c] + axis[c] * minProjection / axisLength2, 0.0f, 255.0f);
+        high[c] = std::clamp(mean[c] + axis[c] * maxProjection / axisLength2, 0.0f, 255.0f);
+    }
+}
+
+uint16_t packRGB565(const float* color) {
+    auto r = static_cast<uint16_t>(std::lround(color[0] * 31.0f / 255.0f));
+    auto g = static_cast<uint16_t>(std::lround(color[1] * 63.0f / 255.0f));
+    auto b = static_cast<uint16_t>(std::lround(color[2] * 31.0f / 255.0f));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void unpackRGB565(uint16_t packed, int* color) {
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// Indices of the nearest 4-color palette entries, returns the squared error
+int fitBC1Indices(const uint8_t* rgba, uint16_t color0, uint16_t color1, uint32_t& indices) {
+    int palette[4][3];
+    unpackRGB565(color0, palette[0]);
+    unpackRGB565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    indices = 0;
+    int total = 0;
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, bestError = 1 << 30;
+        for (int p = 0; p < 4; ++p) {
+            int error = 0;
+            for (int c = 0; c < 3; ++c) {
+                int d = rgba[4 * i + c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                best = p;
+            }
+        }
+        indices |= uint32_t(best) << (2 * i);
+        total += bestError;
+    }
+    return total;
+}
+
+// Least-squares endpoints for fixed palette weights, `weights[i]` being the blend towards `high` in [0, 1]
+void refineEndpoints(const uint8_t* rgba, int channels, const float* weights, float* low, float* high) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+    for (int i = 0; i < 16; ++i) {
+        float b = weights[i], a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < channels; ++c) {
+            ax[c] += a * rgba[4 * i + c];
+            bx[c] += b * rgba[4 * i + c];
+        }
+    }
+    float determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) < 1e-6f) return;
+    for (int c = 0; c < channels; ++c) {
+        low[c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+        high[c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+    }
+}
+
+void encodeColorBlock(const uint8_t* rgba, uint8_t* out) {
+    float low[4], high[4];
+    axisEndpoints(rgba, 3, low, high);
+
+    auto encode = [rgba](const float* first, const float* second, uint16_t& color0, uint16_t& color1, uint32_t& indices) {
+        color0 = packRGB565(first);
+        color1 = packRGB565(second);
+        // color0 > color1 selects the 4-color mode, equal endpoints would select 3 colors plus black
+        if (color0 < color1) std::swap(color0, color1);
+        if (color0 == color1) {
+            indices = 0;
+            int palette[3];
+            unpackRGB565(color0, palette);
+            int error = 0;
+            for (int i = 0; i < 16; ++i)
+                for (int c = 0; c < 3; ++c) error += (rgba[4 * i + c] - palette[c]) * (rgba[4 * i + c] - palette[c]);
+            return error;
+        }
+        return fitBC1Indices(rgba, color0, color1, indices);
+    };
+
+    uint16_t color0, color1;
+    uint32_t indices;
+    int error = encode(high, low, color0, color1, indices);
+
+    // One least-squares pass over the fitted indices
+    if (error > 0 && color0 != color1) {
+        constexpr float kPaletteWeights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};     // Towards color1
+        float weights[16];
+        for (int i = 0; i < 16; ++i) weights[i] = kPaletteWeights[(indices >> (2 * i)) & 3];
+        int first[3], second[3];
+        unpackRGB565(color0, first);
+        unpackRGB565(color1, second);
+        float refinedLow[4], refinedHigh[4];
+        for (int c = 0; c < 3; ++c) {
+            refinedLow[c] = static_cast<float>(first[c]);
+            refinedHigh[c] = static_cast<float>(second[c]);
+        }
+        refineEndpoints(rgba, 3, weights, refinedLow, refinedHigh);
+        uint16_t refined0, refined1;
+        uint32_t refinedIndices;
+        int refinedError = encode(refinedLow, refinedHigh, refined0, refined1, refinedIndices);
+        if (refinedError < error) {
+            color0 = refined0;
+            color1 = refined1;
+            indices = refinedIndices;
+        }
+    }
+
+    out[0] = static_cast<uint8_t>(color0 & 0xff);
+    out[1] = static_cast<uint8_t>(color0 >> 8);
+    out[2] = static_cast<uint8_t>(color1 & 0xff);
+    out[3] = static_cast<uint8_t>(color1 >> 8);
+    for (int i = 0; i < 4; ++i) out[4 + i] = static_cast<uint8_t>(indices >> (8 * i));
+}
+
+void encodeAlphaBlock(const uint8_t* rgba, uint8_t* out) {
+    int minAlpha = 255, maxAlpha = 0;
+    for (int i = 0; i < 16; ++i) {
+        minAlpha = std::min<int>(minAlpha, rgba[4 * i + 3]);
+        maxAlpha = std::max<int>(maxAlpha, rgba[4 * i + 3]);
+    }
+    // alpha0 > alpha1 selects 8 interpolated levels
+    int palette[8] = {maxAlpha, minAlpha};
+    for (int i = 1; i < 7; ++i) palette[i + 1] = ((7 - i) * maxAlpha + i * minAlpha) / 7;
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, bestError = 1 << 30;
+        for (int p = 0; p < (maxAlpha > minAlpha ? 8 : 1); ++p) {
+            int error = std::abs(rgba[4 * i + 3] - palette[p]);
+            if (error < bestError) {
+                bestError = error;
+                best = p;
+            }
+        }
+        bits |= uint64_t(best) << (3 * i);
+    }
+    out[0] = static_cast<uint8_t>(maxAlpha);
+    out[1] = static_cast<uint8_t>(minAlpha);
+    for (int i = 0; i < 6; ++i) out[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+}
+
+// Mode 6 endpoint channels are 7 bits plus a p-bit shared by the endpoint's four channels
+void quantizeBC7Endpoint(const float* color, uint8_t* quantized, uint8_t& pBit) {
+    float bestError = 1e30f;
+    for (int p = 0; p < 2; ++p) {
+        float error = 0.0f;
+        uint8_t candidate[4];
+        for (int c = 0; c < 4; ++c) {
+            int q = std::clamp(static_cast<int>(std::lround((color[c] - p) / 2.0f)), 0, 127);
+            candidate[c] = static_cast<uint8_t>(q);
+            float d = color[c] - static_cast<float>((q << 1) | p);
+            error += d * d;
+        }
+        if (error < bestError) {
+            bestError = error;
+            pBit = static_cast<uint8_t>(p);
+            std::memcpy(quantized, candidate, 4);
+        }
+    }
+}
+
+// Returns the squared error of the best palette index per pixel
+int fitBC7Indices(const uint8_t* rgba, const uint8_t* endpoint0, uint8_t p0, const uint8_t* endpoint1, uint8_t p1, uint8_t* indices) {
+    int palette[16][4];
+    for (int c = 0; c < 4; ++c) {
+        int e0 = (endpoint0[c] << 1) | p0, e1 = (endpoint1[c] << 1) | p1;
+        for (int i = 0; i < 16; ++i) palette[i][c] = ((64 - kBC7Weights[i]) * e0 + kBC7Weights[i] * e1 + 32) >> 6;
+    }
+    int total = 0;
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, bestError = 1 << 30;
+        for (int p = 0; p < 16; ++p) {
+            int error = 0;
+            for (int c = 0; c < 4; ++c) {
+                int d = rgba[4 * i + c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                best = p;
+            }
+        }
+        indices[i] = static_cast<uint8_t>(best);
+        total += bestError;
+    }
+    return total;
+}
+
+// Little-endian bit writer for the 128-bit BC7 block
+struct BitWriter {
+    uint8_t* out;
+    int position = 0;
+
+    void write(uint32_t value, int count) {
+        for (int i = 0; i < count; ++i, ++position) {
+            if ((value >> i) & 1) out[position >> 3] |= static_cast<uint8_t>(1 << (position & 7));
+        }
+    }
+};
+
+}
+
+void encodeBC1Block(const uint8_t* rgba, uint8_t* out) {
+    encodeColorBlock(rgba, out);
+}
+
+void encodeBC3Block(const uint8_t* rgba, uint8_t* out) {
+    encodeAlphaBlock(rgba, out);
+    encodeColorBlock(rgba, out + 8);
+}
+
+void encodeBC7Block(const uint8_t* rgba, uint8_t* out) {
+    float low[4], high[4];
+    axisEndpoints(rgba, 4, low, high);
+
+    uint8_t endpoint0[4], endpoint1[4], p0 = 0, p1 = 0, indices[16];
+    quantizeBC7Endpoint(low, endpoint0, p0);
+    quantizeBC7Endpoint(high, endpoint1, p1);
+    int error = fitBC7Indices(rgba, endpoint0, p0, endpoint1, p1, indices);
+
+    // One least-squares pass over the fitted indices
+    if (error > 0) {
+        float weights[16];
+        for (int i = 0; i < 16; ++i) weights[i] = kBC7Weights[indices[i]] / 64.0f;
+        float refinedLow[4], refinedHigh[4];
+        std::memcpy(refinedLow, low, sizeof(low));
+        std::memcpy(refinedHigh, high, sizeof(high));
+        refineEndpoints(rgba, 4, weights, refinedLow, refinedHigh);
+        uint8_t refined0[4], refined1[4], refinedP0 = 0, refinedP1 = 0, refinedIndices[16];
+        quantizeBC7Endpoint(refinedLow, refined0, refinedP0);
+        quantizeBC7Endpoint(refinedHigh, refined1, refinedP1);
+        if (fitBC7Indices(rgba, refined0, refinedP0, refined1, refinedP1, refinedIndices) < error) {
+            std::memcpy(endpoint0, refined0, 4);
+            std::memcpy(endpoint1, refined1, 4);
+            std::memcpy(indices, refinedIndices, 16);
+            p0 = refinedP0;
+            p1 = refinedP1;
+        }
+    }
+
+    // The first index's top bit is implicitly 0, swap the endpoints if it isn't
+    if (indices[0] & 8) {
+        std::swap_ranges(endpoint0, endpoint0 + 4, endpoint1);
+        std::swap(p0, p1);
+        for (uint8_t& index : indices) index = static_cast<uint8_t>(15 - index);
+    }
+
+    std::memset(out, 0, 16);
+    BitWriter writer{out};
+    writer.write(1u << 6, 7);       // Mode 6
+    for (int c = 0; c < 4; ++c) {
+        writer.write(endpoint0[c], 7);
+        writer.write(endpoint1[c], 7);
+    }
+    writer.write(p0, 1);
+    writer.write(p1, 1);
+    writer.write(indices[0], 3);
+    for (int i = 1; i < 16; ++i) writer.write(indices[i], 4);
+}
+
+std::vector<uint8_t> compressImage(const uint8_t* rgba, uint32_t width, uint32_t height, size_t blockBytes,
+                                   void (*encodeBlock)(const uint8_t*, uint8_t*)) {
+    size_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    std::vector<uint8_t> out(blocksX * blocksY * blockBytes);
+    parallelFor(blocksY, 16, [&](size_t begin, size_t end) {
+        uint8_t block[64];
+        for (size_t by = begin; by < end; ++by) {
+            for (size_t bx = 0; bx < blocksX; ++bx) {
+                for (size_t y = 0; y < 4; ++y) {
+                    size_t sourceY = std::min<size_t>(by * 4 + y, height - 1);
+                    for (size_t x = 0; x < 4; ++x) {
+                        size_t sourceX = std::min<size_t>(bx * 4 + x, width - 1);
+                        std::memcpy(block + 4 * (y * 4 + x), rgba + 4 * (sourceY * width + sourceX), 4);
+                    }
+                }
+                encodeBlock(block, out.data() + (by * blocksX + bx) * blockBytes);
+            }
+        }
+    });
+    return out;
+}
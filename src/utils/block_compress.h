@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Encoders for the BCn (S3TC/BPTC) texture formats GPUs sample directly.
+// A block is 4x4 RGBA8 pixels in row order (64 bytes).
+
+// BC1: 565 endpoints and 2-bit indices, opaque (8 bytes per block)
+void encodeBC1Block(const uint8_t* rgba, uint8_t* out);
+// BC3: a BC1 color block after an 8-level interpolated alpha block (16 bytes per block)
+void encodeBC3Block(const uint8_t* rgba, uint8_t* out);
+// BC7 mode 6 only: one RGBA line with 7-bit endpoints plus p-bits and 4-bit indices (16 bytes per block)
+void encodeBC7Block(const uint8_t* rgba, uint8_t* out);
+
+// Compress a whole RGBA8 image with one of the encoders above, in parallel over block rows.
+// Edge blocks of sizes not divisible by 4 repeat their last row/column.
+std::vector<uint8_t> compressImage(const uint8_t* rgba, uint32_t width, uint32_t height, size_t blockBytes,
+                                   void (*encodeBlock)(const uint8_t*, uint8_t*));
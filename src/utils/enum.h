@@ -18,4 +18,33 @@ enum class SHADER_TYPE {
     Outline,
     Index,
     Custom,
+};
+
+enum class PRIMITIVE_TYPE {
+    Triangles,  // Indexed triangle list
+    Points,     // Point cloud, one vertex per point and no indices
+};
+
+enum class VERTEX_ENCODING {
+    Float,          // 32-bit floats, 32 bytes per vertex with normals and texcoords
+    Octahedral16,   // 16-bit positions in the shape bounds, octahedral 2x16-bit normals, half float texcoords (16 bytes)
+    Packed1010102,  // 16-bit positions in the shape bounds, 10:10:10:2 normals, half float texcoords (16 bytes)
+};
+
+enum class NORMAL_WEIGHTING {
+    Area,       // Face normals weighted by triangle area
+    Angle,      // Face normals weighted by the corner angle at each vertex
+};
+
+enum class TEXTURE_COMPRESSION {
+    None,       // RGBA8, 4 bytes per texel
+    BC1_BC3,    // BC1 for opaque textures (0.5 bytes per texel), BC3 with alpha (1 byte per texel)
+    BC7,        // BC7 for every texture (1 byte per texel), higher quality than BC1/BC3
+};
+
+enum class TEXTURE_FORMAT {
+    RGBA8,
+    BC1,
+    BC3,
+    BC7,
 };
\ No newline at end of file
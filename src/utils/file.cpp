@@ -17,3 +17,7 @@ std::string findFile(const std::string& filename, int maxLevels) {
 
     throw std::runtime_error("File not found: " + filename);
 }
+
+int64_t fileModificationTime(const std::string& path) {
+    return static_cast<int64_t>(std::filesystem::last_write_time(path).time_since_epoch().count());
+}
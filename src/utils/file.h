@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 
-std::string findFile(const std::string& filename, int maxLevels = 3);
\ No newline at end of file
+std::string findFile(const std::string& filename, int maxLevels = 3);
+
+// Last write time as a raw clock count, only meaningful for comparing against an earlier call
+int64_t fileModificationTime(const std::string& path);
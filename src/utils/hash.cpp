@@ -0,0 +1,32 @@
+#include "hash.h"
+#include "mapped_file.h"
+
+namespace {
+
+constexpr size_t kHashSamples = 64;
+constexpr size_t kHashSampleSize = 4096;
+
+}
+
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash) {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t sampledContentHash(const std::string& path) {
+    MappedFile file(path);
+    uint64_t size = file.size();
+    uint64_t hash = fnv1a(&size, sizeof(size));
+    if (size <= kHashSamples * kHashSampleSize) {
+        return fnv1a(file.data(), file.size(), hash);
+    }
+    for (size_t i = 0; i < kHashSamples; ++i) {
+        size_t offset = (file.size() - kHashSampleSize) * i / (kHashSamples - 1);
+        hash = fnv1a(file.data() + offset, kHashSampleSize, hash);
+    }
+    return hash;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 64-bit FNV-1a, `hash` continues a previous hash
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 1469598103934665603ull);
+
+// Hash of evenly spaced samples of a file (always including its head and tail), for validating caches.
+// Hashing everything would cost as much I/O as the parse a cache is there to skip.
+uint64_t sampledContentHash(const std::string& path);
@@ -0,0 +1,84 @@
+#include "mapped_file.h"
+#include <stdexcept>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    mFileHandle = file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        throw std::runtime_error("Failed to get file size: " + path);
+    }
+    mSize = static_cast<size_t>(fileSize.QuadPart);
+    if (mSize == 0) return;     // Empty files can't be mapped, leave data as nullptr
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        throw std::runtime_error("Failed to map file: " + path);
+    }
+    mMappingHandle = mapping;
+
+    mData = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!mData) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error("Failed to map file: " + path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (mData) UnmapViewOfFile(mData);
+    if (mMappingHandle) CloseHandle(static_cast<HANDLE>(mMappingHandle));
+    if (mFileHandle) CloseHandle(static_cast<HANDLE>(mFileHandle));
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) {
+    mFileDescriptor = open(path.c_str(), O_RDONLY);
+    if (mFileDescriptor < 0) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+
+    struct stat fileStat{};
+    if (fstat(mFileDescriptor, &fileStat) != 0) {
+        close(mFileDescriptor);
+        throw std::runtime_error("Failed to get file size: " + path);
+    }
+    mSize = static_cast<size_t>(fileStat.st_size);
+    if (mSize == 0) return;     // Empty files can't be mapped, leave data as nullptr
+
+    void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, mFileDescriptor, 0);
+    if (data == MAP_FAILED) {
+        close(mFileDescriptor);
+        throw std::runtime_error("Failed to map file: " + path);
+    }
+    madvise(data, mSize, MADV_SEQUENTIAL);
+    mData = static_cast<const char*>(data);
+}
+
+MappedFile::~MappedFile() {
+    if (mData) munmap(const_cast<char*>(mData), mSize);
+    if (mFileDescriptor >= 0) close(mFileDescriptor);
+}
+
+#endif
@@ -0,0 +1,79 @@
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+thread_local bool tInParallel = false;      // Nested calls run inline instead of multiplying threads
+
+// Run `body(threadIndex)` on `threadCount` threads (the caller being thread 0) and rethrow the first failure
+void runOnThreads(size_t threadCount, const std::function<void(size_t)>& body) {
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto guarded = [&](size_t threadIndex) {
+        bool wasInParallel = tInParallel;
+        tInParallel = true;
+        try {
+            body(threadIndex);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error) error = std::current_exception();
+        }
+        tInParallel = wasInParallel;
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (size_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(guarded, i);
+    }
+    guarded(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (error) std::rethrow_exception(error);
+}
+
+}
+
+size_t getWorkerCount() {
+    static const size_t workerCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+    return workerCount;
+}
+
+void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& func) {
+    if (count == 0) return;
+    grain = std::max<size_t>(1, grain);
+    size_t rangeCount = tInParallel ? 1 : std::min(getWorkerCount(), (count + grain - 1) / grain);
+    if (rangeCount <= 1) {
+        func(0, count);
+        return;
+    }
+
+    runOnThreads(rangeCount, [&](size_t range) {
+        size_t begin = count * range / rangeCount;
+        size_t end = count * (range + 1) / rangeCount;
+        func(begin, end);
+    });
+}
+
+void parallelTasks(size_t count, const std::function<void(size_t)>& func) {
+    if (count == 0) return;
+    size_t threadCount = tInParallel ? 1 : std::min(getWorkerCount(), count);
+    if (threadCount <= 1) {
+        for (size_t i = 0; i < count; ++i) func(i);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    runOnThreads(threadCount, [&](size_t) {
+        for (size_t task = next++; task < count; task = next++) {
+            func(task);
+        }
+    });
+}
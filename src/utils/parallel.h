@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// Calls nested inside another parallelFor/parallelTasks run serially on the calling thread,
+// so parallel code can call parallel code without multiplying threads.
+
+// Number of threads the parallel helpers below fan out to (hardware concurrency, at least 1)
+size_t getWorkerCount();
+
+// Split [0, count) into at most getWorkerCount() contiguous ranges of at least `grain` items
+// and call `func(begin, end)` for each range in parallel. The calling thread runs one range itself.
+// Blocks until every range is done; the first exception thrown by any range is rethrown.
+void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& func);
+
+// Call `func(task)` for every task in [0, count), handing tasks out dynamically so uneven tasks
+// (e.g. file chunks or shapes of very different sizes) still balance across threads.
+void parallelTasks(size_t count, const std::function<void(size_t)>& func);
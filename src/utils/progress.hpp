@@ -0,0 +1,26 @@
+#pragma once
+
+#include <atomic>
+#include <stdexcept>
+
+// Thrown by a loader when its load has been cancelled
+class LoadCancelledError : public std::runtime_error {
+public:
+    LoadCancelledError() : std::runtime_error("Load cancelled") {}
+};
+
+// Progress and cancellation state shared between a background load and the UI thread
+class LoadProgress {
+public:
+    void set(float fraction) { mFraction.store(fraction, std::memory_order_relaxed); }
+    [[nodiscard]] float get() const { return mFraction.load(std::memory_order_relaxed); }
+
+    void cancel() { mCancelled.store(true, std::memory_order_relaxed); }
+    [[nodiscard]] bool isCancelled() const { return mCancelled.load(std::memory_order_relaxed); }
+    // Loaders call this between steps to bail out of a cancelled load
+    void checkCancelled() const { if (isCancelled()) throw LoadCancelledError(); }
+
+private:
+    std::atomic<float> mFraction{0.0f};
+    std::atomic<bool> mCancelled{false};
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <glm/glm.hpp>
+
+// Vertex attribute quantization, decoded by the GPU (normalized integer / half float attributes)
+// or by the vertex shaders (octahedral normals, positions relative to the shape bounds)
+
+// Map [0, 1] to the full uint16 range
+inline uint16_t quantizeUnorm16(float value) {
+    return static_cast<uint16_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+// Map [-1, 1] to int16, decoded with the GL_SHORT normalized rule (max(x / 32767, -1))
+inline int16_t quantizeSnorm16(float value) {
+    return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+// IEEE half float, round to nearest even, handles denormals and overflows to infinity
+inline uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+    uint32_t exponent = (bits >> 23) & 0xFFu;
+    uint32_t mantissa = bits & 0x7FFFFFu;
+
+    if (exponent == 0xFFu) {    // Inf or NaN
+        return static_cast<uint16_t>(sign | 0x7C00u | (mantissa ? 0x200u : 0u));
+    }
+    int halfExponent = static_cast<int>(exponent) - 127 + 15;
+    if (halfExponent >= 31) return static_cast<uint16_t>(sign | 0x7C00u);
+    if (halfExponent <= 0) {
+        if (halfExponent < -10) return sign;
+        // Denormal, shift the mantissa with its implicit bit
+        mantissa |= 0x800000u;
+        uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1u);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1u))) half++;
+        return static_cast<uint16_t>(sign | half);
+    }
+    uint32_t half = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) half++;     // May carry into the exponent, which is correct
+    return static_cast<uint16_t>(sign | half);
+}
+
+// Octahedral encoding of a unit vector into [-1, 1]^2
+inline glm::vec2 octEncode(const glm::vec3& n) {
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 == 0.0f) return glm::vec2(0.0f);
+    glm::vec2 p(n.x / l1, n.y / l1);
+    if (n.z < 0.0f) {
+        glm::vec2 folded((1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+                         (1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+        p = folded;
+    }
+    return p;
+}
+
+// Inverse of octEncode, mirrors the GLSL decodeNormal in the vertex shaders
+inline glm::vec3 octDecode(const glm::vec2& p) {
+    glm::vec3 n(p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y));
+    if (n.z < 0.0f) {
+        float x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        float y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+        n.x = x;
+        n.y = y;
+    }
+    return glm::normalize(n);
+}
+
+// Signed normalized 10:10:10:2 (GL_INT_2_10_10_10_REV), x in the low bits, w is left as 0
+inline uint32_t packSnorm1010102(const glm::vec3& n) {
+    auto pack = [](float value) {
+        return static_cast<uint32_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 511.0f)) & 0x3FFu;
+    };
+    return pack(n.x) | (pack(n.y) << 10) | (pack(n.z) << 20);
+}
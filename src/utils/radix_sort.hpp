@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Stable LSD radix sort of `items` by a 64-bit `key(item)`, 8 bits per pass. Passes over digits that are the same
+// for every item are skipped, so keys whose high bits rarely vary only cost the digits that do.
+// `scratch` is reusable storage, its contents are overwritten.
+template <typename T, typename KeyFunc>
+void radixSort(std::vector<T>& items, std::vector<T>& scratch, KeyFunc key) {
+    if (items.size() < 2) return;
+
+    // Histograms of all digits in one read
+    size_t counts[8][256] = {};
+    for (const T& item : items) {
+        uint64_t k = key(item);
+        for (int digit = 0; digit < 8; ++digit) counts[digit][(k >> (8 * digit)) & 0xFF]++;
+    }
+
+    scratch.resize(items.size());
+    for (int digit = 0; digit < 8; ++digit) {
+        int shift = 8 * digit;
+        if (counts[digit][(key(items[0]) >> shift) & 0xFF] == items.size()) continue;
+
+        size_t offsets[256];
+        size_t sum = 0;
+        for (int bucket = 0; bucket < 256; ++bucket) {
+            offsets[bucket] = sum;
+            sum += counts[digit][bucket];
+        }
+        for (const T& item : items) scratch[offsets[(key(item) >> shift) & 0xFF]++] = item;
+        items.swap(scratch);
+    }
+}
@@ -1,8 +1,15 @@
 #include "scene.h"
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
+#include "loaders/obj_loader.h"
+#include "loaders/ply_loader.h"
+#include "loaders/mesh_cache.h"
+#include "loaders/mesh_registry.h"
+#include "geometry/normals.h"
+#include "geometry/mesh_optimizer.h"
+#include "geometry/simplify.h"
+#include "geometry/meshlets.h"
 #include "happly.h"
 #include <iostream>
+#include <cmath>
 #include <filesystem>
 #include <algorithm>
 
@@ -11,6 +18,11 @@ Scene::~Scene() {
 }
 
 void Scene::cleanup() {
+    // Cancel pending loads and wait for their threads to bail out
+    for (auto& task : mPendingLoads) {
+        task->cancel();
+    }
+    mPendingLoads.clear();
     mModels.clear();
 }
 
@@ -24,7 +36,7 @@ const std::unordered_map<std::string, Scene::LoadModelFunc> Scene::loadModelFunc
     {".ply", loadPLYModel}
 };
 
-ModelPtr Scene::addModel(const std::string& path) {
+ModelPtr Scene::loadModel(const std::string& path, LoadProgress& progress) {
     std::filesystem::path filePath(path);
     std::string ext = filePath.extension().string();
 
@@ -32,17 +44,67 @@ ModelPtr Scene::addModel(const std::string& path) {
 
     auto it = loadModelFunctions.find(ext);
     if (it != loadModelFunctions.end()) {
-        // Use the function pointer to load model
         ModelPtr model = std::make_shared<Model>();
-        it->second(path, model);
-        mModels.push_back(model);
-        selectModel(model);
+        // Geometry already in memory is shared, not loaded again
+        if (MeshRegistry::instance().load(path, *model)) {
+            progress.set(1.0f);
+            return model;
+        }
+        if (MeshCache::instance().load(path, *model)) {
+            MeshRegistry::instance().store(path, *model);
+            progress.set(1.0f);
+            return model;
+        }
+        // Use the function pointer to load model
+        it->second(path, model, progress);
+        progress.checkCancelled();
+        // Reorder for the GPU and build LODs and meshlets before caching, so cache hits skip all of it
+        optimizeModel(*model);
+        progress.checkCancelled();
+        generateModelLODs(*model);
+        progress.checkCancelled();
+        buildModelMeshlets(*model);
+        MeshCache::instance().store(path, *model);
+        MeshRegistry::instance().store(path, *model);
+        progress.set(1.0f);
         return model;
     } else {
         throw std::runtime_error("Unsupported file format");
     }
 }
 
+ModelPtr Scene::addModel(const std::string& path) {
+    LoadProgress progress;
+    ModelPtr model = loadModel(path, progress);
+    addModel(model);
+    return model;
+}
+
+void Scene::addModel(const ModelPtr& model) {
+    mModels.push_back(model);
+    selectModel(model);
+}
+
+LoadTaskPtr Scene::loadModelAsync(const std::string& path) {
+    auto progress = std::make_shared<LoadProgress>();
+    std::future<ModelPtr> result = std::async(std::launch::async, [path, progress]() {
+        return loadModel(path, *progress);
+    });
+    auto task = std::make_shared<LoadTask>(path, std::move(result), progress);
+    mPendingLoads.push_back(task);
+    return task;
+}
+
+std::vector<LoadTaskPtr> Scene::takeFinishedLoads() {
+    std::vector<LoadTaskPtr> finished;
+    auto it = std::stable_partition(mPendingLoads.begin(), mPendingLoads.end(), [](const LoadTaskPtr& task) {
+        return !task->isFinished();
+    });
+    finished.assign(it, mPendingLoads.end());
+    mPendingLoads.erase(it, mPendingLoads.end());
+    return finished;
+}
+
 void Scene::removeModel(const ModelPtr& model) {
     auto it = std::find(mModels.begin(), mModels.end(), model);
     if (it != mModels.end()) {
@@ -61,6 +123,8 @@ size_t Scene::getTotalShapeCount() const {
 void Scene::selectModel(const ModelPtr& model) {
     for (auto & _model : mModels) {
         _model->setSelected(false);
+        long selected = _model->getSelectedInstance();
+        if (selected >= 0) _model->setInstanceSelected(selected, false);
     }
     if (model != nullptr)   
     model->setSelected(true);
@@ -71,37 +135,108 @@ void Scene::toggleSelectModel(const ModelPtr& model) {
     else selectModel(model);
 }
 
-void Model::updateModelMatrix() {
+void Scene::selectInstance(const ModelPtr& model, size_t instanceIndex) {
+    selectModel(nullptr);
+    model->setInstanceSelected(instanceIndex, true);
+}
+
+void Scene::toggleSelectInstance(const ModelPtr& model, size_t instanceIndex) {
+    if (model->getInstance(instanceIndex).selected) selectModel(nullptr);
+    else selectInstance(model, instanceIndex);
+}
+
+void Scene::createInstances(const ModelPtr& model, size_t count, float spacing) {
+    if (count == 0) return;
+    glm::vec3 minBound(0.0f), maxBound(0.0f);
+    bool first = true;
+    for (size_t i = 0; i < model->getShapeCount(); ++i) {
+        for (const auto& v : model->getVertices(i)) {
+            minBound = first ? v : glm::min(minBound, v);
+            maxBound = first ? v : glm::max(maxBound, v);
+            first = false;
+        }
+    }
+    float step = std::max(glm::length(maxBound - minBound), 1e-3f) * spacing;
+
+    // Continue the grid after the existing instances. The first instance sits at the model's own placement,
+    // so instancing a model keeps it where it was.
+    size_t total = model->getInstanceCount() + count;
+    auto side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(total))));
+    for (size_t i = model->getInstanceCount(); i < total; ++i) {
+        model->addInstance(glm::vec3(step * static_cast<float>(i % side), 0.0f, step * static_cast<float>(i / side)));
+    }
+}
+
+bool Scene::findPickId(uint32_t id, ModelPtr& model, long& instanceIndex) const {
+    if (id == 0) return false;
+    uint32_t base = 1;
+    for (const auto& candidate : mModels) {
+        uint32_t count = getPickIdCount(candidate);
+        if (id < base + count) {
+            model = candidate;
+            instanceIndex = candidate->isInstanced() ? static_cast<long>(id - base) : -1;
+            return true;
+        }
+        base += count;
+    }
+    return false;
+}
 
-    glm::mat4 translationMatrix = glm::translate(glm::mat4(1.0f), mPosition);
-    glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), glm::radians(mRotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-    rotationMatrix = glm::rotate(rotationMatrix, glm::radians(mRotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-    rotationMatrix = glm::rotate(rotationMatrix, glm::radians(mRotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-    glm::mat4 scaleMatrix = glm::scale(glm::mat4(1.0f), mScale);
+glm::mat4 composeTransform(const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale) {
+    glm::mat4 translationMatrix = glm::translate(glm::mat4(1.0f), position);
+    glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+    rotationMatrix = glm::rotate(rotationMatrix, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+    rotationMatrix = glm::rotate(rotationMatrix, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+    glm::mat4 scaleMatrix = glm::scale(glm::mat4(1.0f), scale);
 
-    mModelMatrix = translationMatrix * rotationMatrix * scaleMatrix;
+    return translationMatrix * rotationMatrix * scaleMatrix;
 }
 
-glm::vec3 Scene::calcVertNormal(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2) {
-    glm::vec3 edge1 = v1 - v0;
-    glm::vec3 edge2 = v2 - v0;
-    return glm::normalize(glm::cross(edge1, edge2));
+void Model::updateModelMatrix() {
+    mModelMatrix = composeTransform(mPosition, mRotation, mScale);
 }
 
+size_t Model::addInstance(const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale) {
+    ModelInstance instance;
+    instance.position = position;
+    instance.rotation = rotation;
+    instance.scale = scale;
+    instance.matrix = composeTransform(position, rotation, scale);
+    mInstances.push_back(instance);
+    mInstanceVersion++;
+    return mInstances.size() - 1;
+}
 
-void Scene::loadOBJModel(const std::string& path, const ModelPtr& model) {
+void Model::removeInstance(size_t instanceIndex) {
+    mInstances.erase(mInstances.begin() + static_cast<long long>(instanceIndex));
+    mInstanceVersion++;
+}
 
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
+void Model::setInstanceTransform(size_t instanceIndex, const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale) {
+    ModelInstance& instance = mInstances[instanceIndex];
+    instance.position = position;
+    instance.rotation = rotation;
+    instance.scale = scale;
+    instance.matrix = composeTransform(position, rotation, scale);
+    mInstanceVersion++;
+}
 
-    std::filesystem::path base_dir = std::filesystem::path(path).parent_path(); // For MTL
+Shape& Model::getShape(size_t shapeIndex) {
+    std::shared_ptr<Shape>& shape = mShapes[shapeIndex].shape;
+    if (shape.use_count() > 1) shape = std::make_shared<Shape>(*shape);
+    return *shape;
+}
 
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str(), base_dir.string().c_str())) {
-        std::cerr << "Failed to load model: " << warn << err << std::endl;
-        throw std::runtime_error("Failed to load model");
+long Model::getSelectedInstance() const {
+    for (size_t i = 0; i < mInstances.size(); ++i) {
+        if (mInstances[i].selected) return static_cast<long>(i);
     }
+    return -1;
+}
+
+void Scene::loadOBJModel(const std::string& path, const ModelPtr& model, LoadProgress& progress) {
+
+    std::vector<Shape> shapes = readOBJ(path, progress);
 
     if (!shapes.empty()) {
         model->setName(std::filesystem::path(path).stem().string());
@@ -110,170 +245,91 @@ void Scene::loadOBJModel(const std::string& path, const ModelPtr& model) {
         throw std::runtime_error("No shapes found in model");
     }
 
-    // load vertices information(pos, normal, texcoord)
-    for (const auto& shape : shapes) {
-        Shape _shape;
-        _shape.name = shape.name;
-        for (const auto& index : shape.mesh.indices) {
-            glm::vec3 vertex = {
-                attrib.vertices[3 * index.vertex_index + 0],
-                attrib.vertices[3 * index.vertex_index + 1],
-                attrib.vertices[3 * index.vertex_index + 2]
-            };
-            _shape.vertices.push_back(vertex);
-
-            if (!attrib.normals.empty()) {
-                glm::vec3 normal = {
-                    attrib.normals[3 * index.normal_index + 0],
-                    attrib.normals[3 * index.normal_index + 1],
-                    attrib.normals[3 * index.normal_index + 2]
-                };
-                _shape.normals.push_back(normal);
-            }
-            // TODO: Calculate normals if not provided in the model file
-
-            if (!attrib.texcoords.empty()) {
-                glm::vec2 texCoord = {
-                    attrib.texcoords[2 * index.texcoord_index + 0],
-                    attrib.texcoords[2 * index.texcoord_index + 1]
-                };
-                _shape.texCoords.push_back(texCoord);
-            }
-        }
-
-        // load texture path
-        if (!materials.empty() && shape.mesh.material_ids[0] >= 0) {
-            size_t material_id = shape.mesh.material_ids[0];
-            if (material_id < materials.size() && !materials[material_id].diffuse_texname.empty()) {
-                std::filesystem::path texture_path = base_dir / materials[material_id].diffuse_texname;
-                _shape.texturePath = texture_path.string();
-            }
-        }
-
-        model->addShape(_shape);
+    for (auto& shape : shapes) {
+        model->addShape(std::move(shape));
     }
 }
 
-void Scene::loadPLYModel(const std::string& path, const ModelPtr& model) {
-    
-    happly::PLYData plyIn(path);
-    std::vector<std::array<double, 3>> vPos = plyIn.getVertexPositions();
-    std::vector<std::vector<size_t>> fInd;
-    if (plyIn.hasElement("face") && plyIn.getElement("face").hasProperty("vertex_indices")) {
-        fInd = plyIn.getFaceIndices<size_t>();
-    }
-    
-    std::string name;
-    if (!vPos.empty()) {
-        name = std::filesystem::path(path).stem().string();
-        model->setName(name);
-    } else {
-        std::cerr << "No vertices found in model" << std::endl;
-        throw std::runtime_error("No vertices found in model");
-    }
+void Scene::loadPLYModel(const std::string& path, const ModelPtr& model, LoadProgress& progress) {
 
     Shape _shape;    // One ply file only has one shape
-    _shape.name = name;
 
-    if (fInd.empty()) {
-        // Only vertices, no faces, create small triangles to show in renderer
+    // Binary files are decoded straight from a memory mapping, ASCII ones go through happly
+    if (!readBinaryPLY(path, _shape, progress)) {
+        happly::PLYData plyIn(path);
+        progress.checkCancelled();
+        progress.set(0.5f);
+        std::vector<std::array<double, 3>> vPos = plyIn.getVertexPositions();
+        _shape.vertices.reserve(vPos.size());
         for (const auto& vertex : vPos) {
-            glm::vec3 v = {
+            _shape.vertices.emplace_back(
                 static_cast<float>(vertex[0]),
                 static_cast<float>(vertex[1]),
                 static_cast<float>(vertex[2])
-            };
-
-            float epsilon = 0.0001f;
-            glm::vec3 v0 = v + glm::vec3(epsilon, 0.0f, 0.0f);
-            glm::vec3 v1 = v + glm::vec3(0.0f, epsilon, 0.0f);
-            glm::vec3 v2 = v + glm::vec3(0.0f, 0.0f, epsilon);
-            _shape.vertices.push_back(v0);
-            _shape.vertices.push_back(v1);
-            _shape.vertices.push_back(v2);
-
-            glm::vec3 normal = calcVertNormal(v0, v1, v2);
-            _shape.normals.push_back(normal);
-            _shape.normals.push_back(normal);
-            _shape.normals.push_back(normal);
+            );
         }
-    } else {
-        // Has faces, mesh-like
-        std::unordered_map<size_t, glm::vec3> vertNormals;
-        std::unordered_map<size_t, std::vector<size_t>> vertexIndices;
-
-        for (const auto& face: fInd) {
-            if (face.size() < 3) continue;
-            for (size_t i = 1; i < face.size() - 1; ++i) {
-                size_t idx0 = face[0];
-                size_t idx1 = face[i];
-                size_t idx2 = face[i + 1];
-                glm::vec3 v0 = {
-                    static_cast<float>(vPos[idx0][0]),
-                    static_cast<float>(vPos[idx0][1]),
-                    static_cast<float>(vPos[idx0][2])
-                };
-                glm::vec3 v1 = {
-                    static_cast<float>(vPos[idx1][0]),
-                    static_cast<float>(vPos[idx1][1]),
-                    static_cast<float>(vPos[idx1][2])
-                };
-                glm::vec3 v2 = {
-                    static_cast<float>(vPos[idx2][0]),
-                    static_cast<float>(vPos[idx2][1]),
-                    static_cast<float>(vPos[idx2][2])
-                };
-
-                _shape.vertices.push_back(v0);
-                _shape.vertices.push_back(v1);
-                _shape.vertices.push_back(v2);
-                _shape.normals.emplace_back(0.0f);
-                _shape.normals.emplace_back(0.0f);
-                _shape.normals.emplace_back(0.0f);
-
-                glm::vec3 normal = calcVertNormal(v0, v1, v2);
-                if (vertNormals.find(idx0) == vertNormals.end()) {
-                    vertNormals[idx0] = glm::vec3(0.0f);
-                    vertexIndices[idx0] = {};
-                }
-                vertNormals[idx0] += normal;
-                vertexIndices[idx0].push_back(_shape.vertices.size() - 3);
 
-                if (vertNormals.find(idx1) == vertNormals.end()) {
-                    vertNormals[idx1] = glm::vec3(0.0f);
-                    vertexIndices[idx1] = {};
+        happly::Element& vertexElement = plyIn.getElement("vertex");
+        if (vertexElement.hasProperty("nx") && vertexElement.hasProperty("ny") && vertexElement.hasProperty("nz")) {
+            std::vector<double> nx = vertexElement.getProperty<double>("nx");
+            std::vector<double> ny = vertexElement.getProperty<double>("ny");
+            std::vector<double> nz = vertexElement.getProperty<double>("nz");
+            _shape.normals.reserve(nx.size());
+            for (size_t i = 0; i < nx.size(); ++i) {
+                _shape.normals.emplace_back(static_cast<float>(nx[i]), static_cast<float>(ny[i]), static_cast<float>(nz[i]));
+            }
+        }
+        if (vertexElement.hasProperty("red") && vertexElement.hasProperty("green") && vertexElement.hasProperty("blue")) {
+            if (vertexElement.hasPropertyType<unsigned char>("red")) {
+                for (const auto& color : plyIn.getVertexColors()) {
+                    _shape.colors.push_back(glm::vec3(color[0], color[1], color[2]) / 255.0f);
                 }
-                vertNormals[idx1] += normal;
-                vertexIndices[idx1].push_back(_shape.vertices.size() - 2);
-
-                if (vertNormals.find(idx2) == vertNormals.end()) {
-                    vertNormals[idx2] = glm::vec3(0.0f);
-                    vertexIndices[idx2] = {};
+            } else {
+                // Float colors are already in [0, 1]
+                std::vector<double> r = vertexElement.getProperty<double>("red");
+                std::vector<double> g = vertexElement.getProperty<double>("green");
+                std::vector<double> b = vertexElement.getProperty<double>("blue");
+                for (size_t i = 0; i < r.size(); ++i) {
+                    _shape.colors.emplace_back(static_cast<float>(r[i]), static_cast<float>(g[i]), static_cast<float>(b[i]));
                 }
-                vertNormals[idx2] += normal;
-                vertexIndices[idx2].push_back(_shape.vertices.size() - 1);
             }
         }
 
-        for (auto& pair : vertNormals) {
-            pair.second = glm::normalize(pair.second);
-            for (size_t idx : vertexIndices[pair.first]) {
-                _shape.normals[idx] = pair.second;
+        if (plyIn.hasElement("face") && plyIn.getElement("face").hasProperty("vertex_indices")) {
+            std::vector<std::vector<size_t>> fInd = plyIn.getFaceIndices<size_t>();
+            for (const auto& face: fInd) {
+                if (face.size() < 3) continue;
+                for (size_t i = 1; i < face.size() - 1; ++i) {
+                    size_t idx0 = face[0];
+                    size_t idx1 = face[i];
+                    size_t idx2 = face[i + 1];
+                    if (idx0 >= vPos.size() || idx1 >= vPos.size() || idx2 >= vPos.size()) continue;
+                    _shape.indices.push_back(static_cast<uint32_t>(idx0));
+                    _shape.indices.push_back(static_cast<uint32_t>(idx1));
+                    _shape.indices.push_back(static_cast<uint32_t>(idx2));
+                }
             }
         }
+    }
 
-        // To slow:
-        // for (const auto& vertex : _shape.vertices) {
-        //     auto it = std::find_if(vPos.begin(), vPos.end(), [&](const std::array<double, 3>& pos) {
-        //         return pos[0] == vertex.x && pos[1] == vertex.y && pos[2] == vertex.z;
-        //     });
-        //     if (it != vPos.end()) {
-        //         unsigned int index = std::distance(vPos.begin(), it);
-        //         std::cout<<index<<std::endl;
-        //         _shape.normals.push_back(glm::normalize(vertNormals[index]));   
-        //     }
-        // }
+    std::string name;
+    if (!_shape.vertices.empty()) {
+        name = std::filesystem::path(path).stem().string();
+        model->setName(name);
+    } else {
+        std::cerr << "No vertices found in model" << std::endl;
+        throw std::runtime_error("No vertices found in model");
+    }
+    _shape.name = name;
+    progress.checkCancelled();
+
+    if (_shape.indices.empty()) {
+        // Only vertices, no faces, draw as a point cloud
+        _shape.primitive = PRIMITIVE_TYPE::Points;
+    } else if (_shape.normals.empty()) {
+        // Has faces, mesh-like
+        generateNormals(_shape);
     }
 
-    model->addShape(_shape);
-}
\ No newline at end of file
+    model->addShape(std::move(_shape));
+}
@@ -1,36 +1,92 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <functional>
+#include <future>
+#include <chrono>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "utils/progress.hpp"
+#include "utils/enum.h"
+
+// A coarser version of a shape, indexing the same vertex arrays
+struct ShapeLOD {
+    std::vector<uint32_t> indices;
+    float error = 0.0f;     // Largest deviation from the full-detail shape, in model units
+};
+
+constexpr uint32_t kMeshletMaxVertices = 64;
+constexpr uint32_t kMeshletMaxTriangles = 124;
+
+// A small cluster of a shape's full-detail triangles, the unit of CPU culling
+struct Meshlet {
+    uint32_t indexOffset = 0;       // Triangle range in `Shape::indices`
+    uint32_t indexCount = 0;
+    glm::vec4 boundingSphere = glm::vec4(0.0f);     // Center and radius
+    glm::vec4 cone = glm::vec4(0.0f);               // Normal cone axis and cutoff (sine of the half angle, 1 never culls)
+};
 
 struct Shape {
     std::vector<glm::vec3> vertices;
     std::vector<glm::vec3> normals;
     std::vector<glm::vec2> texCoords;
+    std::vector<glm::vec3> colors;      // Optional per-vertex colors in [0, 1]
+    std::vector<uint32_t> indices;      // Triangle list into the (deduplicated) vertex arrays above, empty for points
+    PRIMITIVE_TYPE primitive = PRIMITIVE_TYPE::Triangles;
+    std::vector<ShapeLOD> lods;         // Levels 1.., from fine to coarse, level 0 is `indices`
+    std::vector<Meshlet> meshlets;      // Clusters of `indices`
     std::string texturePath;
     std::string name;
+};
+
+// Shapes are shared between models with identical geometry (see MeshRegistry), so they are immutable once loaded
+using ShapePtr = std::shared_ptr<const Shape>;
+
+// One placement of an instanced model, relative to the model's own transform
+struct ModelInstance {
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 rotation = glm::vec3(0.0f);       // Euler angles, in degrees
+    glm::vec3 scale = glm::vec3(1.0f);
+    glm::mat4 matrix = glm::mat4(1.0f);         // From the three above
     bool visible = true;
+    bool selected = false;
 };
 
+// Translation * rotation (X, then Y, then Z, in degrees) * scale
+glm::mat4 composeTransform(const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale);
+
 class Model {
 public:
     Model() = default;
     ~Model() = default;
 
     // Shape level operations
-    void addShape(const Shape& shape) { mShapes.push_back(shape); };
+    void addShape(const Shape& shape) { addShape(std::make_shared<Shape>(shape)); };
+    void addShape(Shape&& shape) { addShape(std::make_shared<Shape>(std::move(shape))); };
+    void addShape(std::shared_ptr<Shape> shape) { std::string name = shape->name; addShape(std::move(shape), std::move(name)); };
+    void addShape(std::shared_ptr<Shape> shape, std::string name) { mShapes.push_back({std::move(shape), std::move(name), true}); };
+    // Mutable access for processing while loading, detaches the shape first if other models share it
+    [[nodiscard]] Shape& getShape(size_t shapeIndex);
+    [[nodiscard]] ShapePtr getShapePtr(size_t shapeIndex) const { return mShapes[shapeIndex].shape; };
+    // Swap in an identical shape, keeping the model's per-shape name and visibility
+    void shareShape(size_t shapeIndex, std::shared_ptr<Shape> shape) { mShapes[shapeIndex].shape = std::move(shape); };
     void removeShape(size_t shapeIndex) { mShapes.erase(mShapes.begin() + static_cast<long long>(shapeIndex)); };
 
-    [[nodiscard]] const std::vector<glm::vec3>& getVertices(size_t shapeIndex) const { return mShapes[shapeIndex].vertices; };
-    [[nodiscard]] const std::vector<glm::vec3>& getNormals(size_t shapeIndex) const { return mShapes[shapeIndex].normals; };
-    [[nodiscard]] const std::vector<glm::vec2>& getTexCoords(size_t shapeIndex) const { return mShapes[shapeIndex].texCoords; };
-    [[nodiscard]] const std::string& getTexturePath(size_t shapeIndex) const { return mShapes[shapeIndex].texturePath; };
+    [[nodiscard]] const std::vector<glm::vec3>& getVertices(size_t shapeIndex) const { return mShapes[shapeIndex].shape->vertices; };
+    [[nodiscard]] const std::vector<glm::vec3>& getNormals(size_t shapeIndex) const { return mShapes[shapeIndex].shape->normals; };
+    [[nodiscard]] const std::vector<glm::vec2>& getTexCoords(size_t shapeIndex) const { return mShapes[shapeIndex].shape->texCoords; };
+    [[nodiscard]] const std::vector<glm::vec3>& getColors(size_t shapeIndex) const { return mShapes[shapeIndex].shape->colors; };
+    [[nodiscard]] const std::vector<uint32_t>& getIndices(size_t shapeIndex) const { return mShapes[shapeIndex].shape->indices; };
+    [[nodiscard]] const std::vector<ShapeLOD>& getLODs(size_t shapeIndex) const { return mShapes[shapeIndex].shape->lods; };
+    [[nodiscard]] const std::vector<Meshlet>& getMeshlets(size_t shapeIndex) const { return mShapes[shapeIndex].shape->meshlets; };
+    [[nodiscard]] PRIMITIVE_TYPE getPrimitiveType(size_t shapeIndex) const { return mShapes[shapeIndex].shape->primitive; };
+    [[nodiscard]] const std::string& getTexturePath(size_t shapeIndex) const { return mShapes[shapeIndex].shape->texturePath; };
     [[nodiscard]] const std::string& getShapeName(size_t shapeIndex) const { return mShapes[shapeIndex].name; };
-    [[nodiscard]] const bool& isShapeVisible(size_t shapeIndex) const { return mShapes[shapeIndex].visible; };
+    [[nodiscard]] bool isShapeVisible(size_t shapeIndex) const { return mShapes[shapeIndex].visible; };
     void setShapeVisible(size_t shapeIndex, bool visible) { mShapes[shapeIndex].visible = visible; };
     
 
@@ -49,19 +105,66 @@ public:
     void setRotation(const glm::vec3& rotation) { mRotation = rotation; updateModelMatrix(); };
     [[nodiscard]] const glm::vec3& getScale() const { return mScale; };
     void setScale(const glm::vec3& scale) { mScale = scale; updateModelMatrix(); };
-    
+
+    // Instancing: a model with instances is drawn once per visible instance, at model matrix * instance matrix,
+    // sharing its GPU resources. Without instances it is drawn once at the model matrix.
+    [[nodiscard]] bool isInstanced() const { return !mInstances.empty(); };
+    [[nodiscard]] size_t getInstanceCount() const { return mInstances.size(); };
+    [[nodiscard]] const ModelInstance& getInstance(size_t instanceIndex) const { return mInstances[instanceIndex]; };
+    size_t addInstance(const glm::vec3& position, const glm::vec3& rotation = glm::vec3(0.0f), const glm::vec3& scale = glm::vec3(1.0f));
+    void removeInstance(size_t instanceIndex);
+    void clearInstances() { mInstances.clear(); mInstanceVersion++; };
+    void setInstanceTransform(size_t instanceIndex, const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale);
+    void setInstanceVisible(size_t instanceIndex, bool visible) { mInstances[instanceIndex].visible = visible; mInstanceVersion++; };
+    void setInstanceSelected(size_t instanceIndex, bool selected) { mInstances[instanceIndex].selected = selected; mInstanceVersion++; };
+    // Index of the selected instance, or -1
+    [[nodiscard]] long getSelectedInstance() const;
+    // Bumped on every instance change, so renderers know when to rebuild their instance buffers
+    [[nodiscard]] uint64_t getInstanceVersion() const { return mInstanceVersion; };
+
 private:
-    std::vector<Shape> mShapes;
+    // Geometry plus the state each model keeps for itself
+    struct ModelShape {
+        std::shared_ptr<Shape> shape;
+        std::string name;
+        bool visible = true;
+    };
+
+    std::vector<ModelShape> mShapes;
     std::string mName;
     bool mSelected = false;
     glm::vec3 mPosition = glm::vec3(0.0f);
     glm::vec3 mRotation = glm::vec3(0.0f);       // Euler angles, in degrees
     glm::vec3 mScale = glm::vec3(1.0f);
     glm::mat4 mModelMatrix = glm::mat4(1.0f);
+    std::vector<ModelInstance> mInstances;
+    uint64_t mInstanceVersion = 0;
 };
 
 using ModelPtr = std::shared_ptr<Model>;
 
+// A model being loaded on a background thread
+class LoadTask {
+public:
+    LoadTask(std::string path, std::future<ModelPtr> result, std::shared_ptr<LoadProgress> progress)
+        : mPath(std::move(path)), mResult(std::move(result)), mProgress(std::move(progress)) {}
+
+    [[nodiscard]] const std::string& getPath() const { return mPath; }
+    [[nodiscard]] float getProgress() const { return mProgress->get(); }
+    void cancel() { mProgress->cancel(); }
+    [[nodiscard]] bool isCancelled() const { return mProgress->isCancelled(); }
+    [[nodiscard]] bool isFinished() const { return mResult.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+    // Loaded model, rethrows the loader's exception (LoadCancelledError if cancelled). Only call once finished.
+    ModelPtr getModel() { return mResult.get(); }
+
+private:
+    std::string mPath;
+    std::future<ModelPtr> mResult;
+    std::shared_ptr<LoadProgress> mProgress;
+};
+
+using LoadTaskPtr = std::shared_ptr<LoadTask>;
+
 class Scene {
 public:
     Scene() = default;
@@ -69,9 +172,27 @@ public:
 
     [[nodiscard]] std::vector<ModelPtr> getModels() const { return mModels; };
     ModelPtr addModel(const std::string& path);
+    void addModel(const ModelPtr& model);
+    // Load a model on a background thread. The model is not part of the scene until the main thread
+    // picks the finished task up with `takeFinishedLoads()`, uploads it and adds it with `addModel(model)`.
+    LoadTaskPtr loadModelAsync(const std::string& path);
+    [[nodiscard]] const std::vector<LoadTaskPtr>& getPendingLoads() const { return mPendingLoads; };
+    std::vector<LoadTaskPtr> takeFinishedLoads();
     void removeModel(const ModelPtr& model);
+    // Selection is single: a whole model (all its instances) or one instance of a model
     void selectModel(const ModelPtr& model);
     void toggleSelectModel(const ModelPtr& model);
+    void selectInstance(const ModelPtr& model, size_t instanceIndex);
+    void toggleSelectInstance(const ModelPtr& model, size_t instanceIndex);
+
+    // Add `count` instances of the model on a square grid in the XZ plane, `spacing` model diameters apart
+    void createInstances(const ModelPtr& model, size_t count, float spacing = 1.5f);
+
+    // Pick ids number models in scene order from 1 (0 is the background), one id per model,
+    // or one per instance for instanced models. Renderers write them in `renderIdx`.
+    [[nodiscard]] uint32_t getPickIdCount(const ModelPtr& model) const { return model->isInstanced() ? static_cast<uint32_t>(model->getInstanceCount()) : 1; };
+    // Model and instance (-1 for non-instanced models) of a pick id, false for the background or stale ids
+    bool findPickId(uint32_t id, ModelPtr& model, long& instanceIndex) const;
     [[nodiscard]] size_t getModelCount() const { return mModels.size(); };
     [[nodiscard]] size_t getTotalShapeCount() const;
 
@@ -81,13 +202,12 @@ public:
 
 private:
     std::vector<ModelPtr> mModels;
+    std::vector<LoadTaskPtr> mPendingLoads;
 
-    using LoadModelFunc = std::function<void(const std::string&, ModelPtr)>;
+    using LoadModelFunc = std::function<void(const std::string&, ModelPtr, LoadProgress&)>;
     static const std::unordered_map<std::string, Scene::LoadModelFunc> loadModelFunctions;
 
-    static void loadOBJModel(const std::string& path, const ModelPtr& model);
-    static void loadPLYModel(const std::string& path, const ModelPtr& model);
-
-    static glm::vec3 calcVertNormal(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2);    // Calculate normals if not provided in the model file
-
+    static ModelPtr loadModel(const std::string& path, LoadProgress& progress);
+    static void loadOBJModel(const std::string& path, const ModelPtr& model, LoadProgress& progress);
+    static void loadPLYModel(const std::string& path, const ModelPtr& model, LoadProgress& progress);
 };
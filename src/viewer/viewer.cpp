@@ -103,6 +103,7 @@ void Viewer::mainLoop() {
 
         glfwPollEvents();
         processGamepadInput();
+        processFinishedLoads();
 
         if (mRender->getType() == RENDERER_TYPE::OpenGL) {
             ImGui_ImplOpenGL3_NewFrame();
@@ -191,6 +192,8 @@ void Viewer::keyboardCallback(GLFWwindow* window, int key, int scancode, int act
                 if (model->isSelected()) {
                     mRender->cleanModel(model);
                     mScene->removeModel(model);
+                } else if (model->getSelectedInstance() >= 0) {
+                    model->removeInstance(static_cast<size_t>(model->getSelectedInstance()));
                 }
             }
         }
@@ -260,10 +263,12 @@ void Viewer::mouseButtonCallback(GLFWwindow* window, int button, int action, int
             } else if (mRender->getType() == RENDERER_TYPE::Vulkan) {
                 // TODO
             }
-            int modelIdx = pixel[0] + (pixel[1] << 8) + (pixel[2] << 16) - 1;
-            if (modelIdx < mScene->getModels().size() && modelIdx >= 0) 
-                mScene->toggleSelectModel(mScene->getModels()[modelIdx]);
-            else mScene->selectModel(nullptr);
+            uint32_t pickId = pixel[0] + (pixel[1] << 8) + (pixel[2] << 16);
+            ModelPtr model;
+            long instanceIndex = -1;
+            if (!mScene->findPickId(pickId, model, instanceIndex)) mScene->selectModel(nullptr);
+            else if (instanceIndex >= 0) mScene->toggleSelectInstance(model, static_cast<size_t>(instanceIndex));
+            else mScene->toggleSelectModel(model);
         } 
     } else if (action == GLFW_RELEASE) {
         if (button == GLFW_MOUSE_BUTTON_MIDDLE) {
@@ -333,6 +338,23 @@ void Viewer::saveScreenshot() {
     createNotification("Screenshot saved to " + filename.string(), 3.0f);
 }
 
+void Viewer::processFinishedLoads() {
+    // Models are parsed on background threads, only the GPU upload happens here on the render thread
+    for (auto& task : mScene->takeFinishedLoads()) {
+        std::string fileName = std::filesystem::path(task->getPath()).filename().string();
+        try {
+            ModelPtr model = task->getModel();
+            mRender->setupModel(model);
+            mScene->addModel(model);
+        } catch (const LoadCancelledError&) {
+            // Cancelled by the user, nothing to report
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to load model: " << task->getPath() << std::endl << e.what() << std::endl;
+            createNotification("Failed to load " + fileName + ": " + e.what(), 3.0f);
+        }
+    }
+}
+
 void Viewer::createNotification(const std::string& msg, int duration) {
     mWidgets.erase(std::remove_if(mWidgets.begin(), mWidgets.end(),
         [](const std::shared_ptr<Widget>& widget) { return widget->getName() == "##Notification"; }),
@@ -60,6 +60,7 @@ protected:
     
     // Utility functions
     void saveScreenshot();
+    void processFinishedLoads();    // Upload and add models whose background load has finished
 
     std::vector<std::shared_ptr<Widget>> mWidgets;  // ImGUI widgets
     // ImGUI rendering functions
@@ -2,6 +2,7 @@
 
 #include "widget.h"
 #include "../viewer.h"
+#include "loaders/mesh_registry.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -13,12 +14,26 @@ public:
     void render(Viewer& viewer) override {
         if (!mVisible) return;
 
-        ImGui::SetNextWindowSize(ImVec2(360, 40), ImGuiCond_Once);
+        ImGui::SetNextWindowSize(ImVec2(360, 180), ImGuiCond_Once);
         ImGui::SetNextWindowPos(ImVec2(30, 50), ImGuiCond_Once);
         ImGui::SetNextWindowBgAlpha(0.0f);
 
         ImGui::Begin(mName.c_str(), &mVisible, ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoScrollbar);
         ImGui::TextWrapped("FPS: %.2f", 1.0f / viewer.getDeltaTime());
+        if (viewer.getRender()) {
+            ImGui::TextWrapped("Triangles: %zu", viewer.getRender()->getRenderedTriangles());
+            ImGui::TextWrapped("Culled shapes: %zu (%zu occluded)", viewer.getRender()->getCulledShapes(),
+                               viewer.getRender()->getOccludedShapes());
+            ImGui::TextWrapped("Draw calls: %zu", viewer.getRender()->getDrawCalls());
+            ImGui::TextWrapped("State changes: %zu (%zu saved by sorting)", viewer.getRender()->getStateChanges(),
+                               viewer.getRender()->getStateChangesSaved());
+            ImGui::TextWrapped("Textures: %.1f MB", static_cast<double>(viewer.getRender()->getTextureBytes()) / (1 << 20));
+            ImGui::TextWrapped("Geometry: %.1f MB in %zu unique shapes", static_cast<double>(MeshRegistry::instance().getGeometryBytes()) / (1 << 20),
+                               MeshRegistry::instance().getShapeCount());
+            ImGui::TextWrapped("Geometry buffers: %.1f / %.1f MB in %zu buffers", static_cast<double>(viewer.getRender()->getGeometryBytesUsed()) / (1 << 20),
+                               static_cast<double>(viewer.getRender()->getGeometryBufferBytes()) / (1 << 20), viewer.getRender()->getGeometryBufferCount());
+            ImGui::TextWrapped("Geometry repacked: %.1f MB", static_cast<double>(viewer.getRender()->getGeometryBytesMoved()) / (1 << 20));
+        }
         ImGui::End();
 
         drawCoordinateAxes(viewer);
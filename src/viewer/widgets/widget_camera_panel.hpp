@@ -54,6 +54,69 @@ public:
         ImGui::PopItemWidth();
         ImGui::Spacing();
 
+        ImGui::TextWrapped("Point Size");
+        float pointSize = viewer.getRender()->getPointSize();
+        ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x);
+        if (ImGui::SliderFloat("##Point Size", &pointSize, 1.0f, 16.0f)) {
+            viewer.getRender()->setPointSize(pointSize);
+        }
+        ImGui::PopItemWidth();
+        ImGui::Spacing();
+
+        ImGui::TextWrapped("Outline Width (px)");
+        float outlineWidth = viewer.getRender()->getOutlineWidth();
+        ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x);
+        if (ImGui::SliderFloat("##Outline Width", &outlineWidth, 1.0f, 32.0f)) {
+            viewer.getRender()->setOutlineWidth(outlineWidth);
+        }
+        ImGui::PopItemWidth();
+        ImGui::Spacing();
+
+        ImGui::TextWrapped("LOD Error (px)");
+        float lodError = viewer.getRender()->getLODErrorThreshold();
+        ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x);
+        if (ImGui::SliderFloat("##LOD Error", &lodError, 0.0f, 8.0f)) {
+            viewer.getRender()->setLODErrorThreshold(lodError);
+        }
+        ImGui::PopItemWidth();
+        ImGui::Spacing();
+
+        ImGui::TextWrapped("Texture Memory (MB)");
+        int textureMemory = static_cast<int>(viewer.getRender()->getTextureMemoryBudget() >> 20);
+        ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x);
+        if (ImGui::SliderInt("##Texture Memory", &textureMemory, 64, 4096)) {
+            viewer.getRender()->setTextureMemoryBudget(static_cast<size_t>(textureMemory) << 20);
+        }
+        ImGui::PopItemWidth();
+        ImGui::Spacing();
+
+        ImGui::TextWrapped("Texture Upload (MB/frame)");
+        int textureUpload = static_cast<int>(viewer.getRender()->getTextureUploadBudget() >> 20);
+        ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x);
+        if (ImGui::SliderInt("##Texture Upload", &textureUpload, 1, 64)) {
+            viewer.getRender()->setTextureUploadBudget(static_cast<size_t>(textureUpload) << 20);
+        }
+        ImGui::PopItemWidth();
+        ImGui::Spacing();
+
+        bool coneCulling = viewer.getRender()->getConeCulling();
+        if (ImGui::Checkbox("Backface Meshlet Culling", &coneCulling)) {
+            viewer.getRender()->setConeCulling(coneCulling);
+        }
+        bool occlusionCulling = viewer.getRender()->getOcclusionCulling();
+        if (ImGui::Checkbox("Occlusion Culling", &occlusionCulling)) {
+            viewer.getRender()->setOcclusionCulling(occlusionCulling);
+        }
+        bool indirectDraws = viewer.getRender()->getIndirectDraws();
+        if (ImGui::Checkbox("Indirect Draws", &indirectDraws)) {
+            viewer.getRender()->setIndirectDraws(indirectDraws);
+        }
+        bool gpuCulling = viewer.getRender()->getGPUCulling();
+        if (ImGui::Checkbox("GPU Culling", &gpuCulling)) {
+            viewer.getRender()->setGPUCulling(gpuCulling);
+        }
+        ImGui::Spacing();
+
         if (viewer.getCamera()->getType() == CAMERA_TYPE::Perspective) {
             ImGui::TextWrapped("FOV");
             float fov = viewer.getCamera()->getFOV();
@@ -2,6 +2,7 @@
 
 #include "widget.h"
 #include "../viewer.h"
+#include <algorithm>
 
 class ModelPanelWidget : public Widget {
 public:
@@ -11,11 +12,17 @@ public:
         if (!mVisible) return;
 
         ModelPtr selectModel = nullptr;
+        long selectInstance = -1;
         for (const auto &model : viewer.getScene()->getModels()){
             if (model->isSelected()){
                 selectModel = model;
                 break;
             }
+            if (model->getSelectedInstance() >= 0) {
+                selectModel = model;
+                selectInstance = model->getSelectedInstance();
+                break;
+            }
         }
         if (selectModel == nullptr) return; // No model selected
 
@@ -30,13 +37,40 @@ public:
             if (selectModel->isShapeVisible(i)) visibleShapes++;
 
         ImGui::TextWrapped("%d/%d shape%s visible.", visibleShapes, selectModel->getShapeCount(), visibleShapes > 1 ? "s are" : " is");
+        if (selectModel->isInstanced())
+            ImGui::TextWrapped("%zu instances.", selectModel->getInstanceCount());
+
+        // Create a grid of instances around the model
+        if (selectInstance < 0) {
+            static int instanceCount = 100;
+            ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x - ImGui::CalcTextSize("Instance").x - ImGui::GetStyle().ItemSpacing.x * 3);
+            ImGui::InputInt("##Instance Count", &instanceCount, 10, 100);
+            ImGui::PopItemWidth();
+            instanceCount = std::max(instanceCount, 0);
+            ImGui::SameLine();
+            if (ImGui::Button("Instance")) {
+                viewer.getScene()->createInstances(selectModel, static_cast<size_t>(instanceCount));
+            }
+        }
         ImGui::Separator();
-        ImGui::TextWrapped("Transform");
+        if (selectInstance >= 0) ImGui::TextWrapped("Instance %ld Transform", selectInstance);
+        else ImGui::TextWrapped("Transform");
         ImGui::Spacing();
 
-        glm::vec3 position = selectModel->getPosition();
-        glm::vec3 rotation = selectModel->getRotation();
-        glm::vec3 scale = selectModel->getScale();
+        // The selected instance is edited instead of the model when there is one
+        const ModelInstance* instance = selectInstance >= 0 ? &selectModel->getInstance(static_cast<size_t>(selectInstance)) : nullptr;
+        glm::vec3 position = instance ? instance->position : selectModel->getPosition();
+        glm::vec3 rotation = instance ? instance->rotation : selectModel->getRotation();
+        glm::vec3 scale = instance ? instance->scale : selectModel->getScale();
+        auto setTransform = [&](const glm::vec3& newPosition, const glm::vec3& newRotation, const glm::vec3& newScale) {
+            if (instance) {
+                selectModel->setInstanceTransform(static_cast<size_t>(selectInstance), newPosition, newRotation, newScale);
+            } else {
+                selectModel->setPosition(newPosition);
+                selectModel->setRotation(newRotation);
+                selectModel->setScale(newScale);
+            }
+        };
 
         float _pos[3] = { position.x, position.y, position.z };
         float _rot[3] = { rotation.x, rotation.y, rotation.z };
@@ -53,10 +87,10 @@ public:
             ImGui::SameLine();
             std::string id = "##pos" + std::to_string(i);
             if (ImGui::InputFloat(id.c_str(), &_pos[i], 0.01f, 0.0f, "%.3f", ImGuiInputTextFlags_EnterReturnsTrue)) {
-                selectModel->setPosition(glm::vec3(_pos[0], _pos[1], _pos[2]));
+                setTransform(glm::vec3(_pos[0], _pos[1], _pos[2]), glm::vec3(_rot[0], _rot[1], _rot[2]), glm::vec3(_scale[0], _scale[1], _scale[2]));
             }
             if (ImGui::IsItemDeactivatedAfterEdit()) {
-                selectModel->setPosition(glm::vec3(_pos[0], _pos[1], _pos[2]));
+                setTransform(glm::vec3(_pos[0], _pos[1], _pos[2]), glm::vec3(_rot[0], _rot[1], _rot[2]), glm::vec3(_scale[0], _scale[1], _scale[2]));
             }
         }
         ImGui::Spacing();
@@ -69,10 +103,10 @@ public:
             ImGui::SameLine();
             std::string id = "##rot" + std::to_string(i);
             if (ImGui::InputFloat(id.c_str(), &_rot[i], 1.0f, 0.0f, "%.3f", ImGuiInputTextFlags_EnterReturnsTrue)) {
-                selectModel->setRotation(glm::vec3(_rot[0], _rot[1], _rot[2]));
+                setTransform(glm::vec3(_pos[0], _pos[1], _pos[2]), glm::vec3(_rot[0], _rot[1], _rot[2]), glm::vec3(_scale[0], _scale[1], _scale[2]));
             }
             if (ImGui::IsItemDeactivatedAfterEdit()) {
-                selectModel->setRotation(glm::vec3(_rot[0], _rot[1], _rot[2]));
+                setTransform(glm::vec3(_pos[0], _pos[1], _pos[2]), glm::vec3(_rot[0], _rot[1], _rot[2]), glm::vec3(_scale[0], _scale[1], _scale[2]));
             }
         }
         ImGui::Spacing();
@@ -85,10 +119,10 @@ public:
             ImGui::SameLine();
             std::string id = "##scale" + std::to_string(i);
             if (ImGui::InputFloat(id.c_str(), &_scale[i], 0.01f, 0.0f, "%.3f", ImGuiInputTextFlags_EnterReturnsTrue)) {
-                selectModel->setScale(glm::vec3(_scale[0], _scale[1], _scale[2]));
+                setTransform(glm::vec3(_pos[0], _pos[1], _pos[2]), glm::vec3(_rot[0], _rot[1], _rot[2]), glm::vec3(_scale[0], _scale[1], _scale[2]));
             }
             if (ImGui::IsItemDeactivatedAfterEdit()) {
-                selectModel->setScale(glm::vec3(_scale[0], _scale[1], _scale[2]));
+                setTransform(glm::vec3(_pos[0], _pos[1], _pos[2]), glm::vec3(_rot[0], _rot[1], _rot[2]), glm::vec3(_scale[0], _scale[1], _scale[2]));
             }
         }
 
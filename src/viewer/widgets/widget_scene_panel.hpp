@@ -3,6 +3,7 @@
 #include "widget.h"
 #include "../viewer.h"
 #include <cstdio>
+#include <filesystem>
 #include <iostream>
 #include <nfd.h>  
 
@@ -22,6 +23,55 @@ public:
             addModel(viewer);
         }
 
+        float lineWidth = ImGui::GetContentRegionAvail().x;
+
+        // Texture format, reload every texture when it changes
+        const char* compressions[] = { "RGBA8", "BC1/BC3", "BC7" };
+        int currentCompression = static_cast<int>(viewer.getRender()->getTextureCompression());
+        ImGui::SameLine(lineWidth - 330.0f);
+        ImGui::PushItemWidth(160.0f);
+        if (ImGui::Combo("##Texture Compression", &currentCompression, compressions, IM_ARRAYSIZE(compressions))) {
+            viewer.getRender()->setTextureCompression(static_cast<TEXTURE_COMPRESSION>(currentCompression));
+            viewer.getRender()->setup(viewer.getScene());
+        }
+        ImGui::PopItemWidth();
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Texture Format");
+        }
+
+        // Vertex buffer format, re-upload every model when it changes
+        const char* encodings[] = { "Float (32B)", "Octahedral 16-bit", "Packed 10:10:10:2" };
+        int currentEncoding = static_cast<int>(viewer.getRender()->getVertexEncoding());
+        ImGui::SameLine(lineWidth - 160.0f);
+        ImGui::PushItemWidth(160.0f);
+        if (ImGui::Combo("##Vertex Encoding", &currentEncoding, encodings, IM_ARRAYSIZE(encodings))) {
+            viewer.getRender()->setVertexEncoding(static_cast<VERTEX_ENCODING>(currentEncoding));
+            viewer.getRender()->setup(viewer.getScene());
+        }
+        ImGui::PopItemWidth();
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Vertex Format");
+        }
+
+        // Background loads in progress
+        for (const auto& task : viewer.getScene()->getPendingLoads()) {
+            ImGui::PushID(task.get());
+            std::string fileName = std::filesystem::path(task->getPath()).filename().string();
+            // Read once, the button may cancel the task before the disabled block ends
+            bool cancelled = task->isCancelled();
+            std::string overlay = cancelled ? "Cancelling..." : fileName;
+            ImGui::ProgressBar(task->getProgress(), ImVec2(ImGui::GetContentRegionAvail().x - ImGui::CalcTextSize("Cancel").x - 20.0f, 0.0f), overlay.c_str());
+            ImGui::SameLine();
+            PushStyleRedButton();
+            if (cancelled) ImGui::BeginDisabled();
+            if (ImGui::Button("Cancel")) {
+                task->cancel();
+            }
+            if (cancelled) ImGui::EndDisabled();
+            ImGui::PopStyleColor(3);
+            ImGui::PopID();
+        }
+
         ImGui::Separator();
 
         ImGui::BeginChild("ModelList", ImVec2(0, 0), false);
@@ -124,9 +174,8 @@ private:
         if (result == NFD_OKAY) {
             // viewer.getScene()->addModel(outPath);
             // viewer.getRender()->setup(viewer.getScene());
-            viewer.getRender()->setupModel(
-                viewer.getScene()->addModel(outPath)
-            );
+            // Parse on a background thread, the viewer uploads the model once it's done
+            viewer.getScene()->loadModelAsync(outPath);
             NFD_FreePathU8(outPath);
         }
         else if (result == NFD_CANCEL) {